@@ -5,48 +5,179 @@
  * value present under sections PC:, LR: etc and
  * categorizes them using the kernel virtual
  * memory layout. If values come from code section,
- * the source file and line number is printed. The
+ * the function and source file and line number is
+ * printed, values pointing into a variable get its
+ * name and offset. The
  * Virtual memory layout is picked by "crash search".
  * from the kernel log, but if the log is incomplete,
  * only source file with line number will be available.
+ * 32-bit and 64-bit ARM Oopses are both understood; the
+ * batch, index, follow and JSON/CSV modes are listed by -h
+ * and described in README.md.
+ *
+ * zstd needs libzstd:
+ *	gcc -o crash_search crash_search.c -lz -lpthread
+ *	gcc -DHAVE_ZSTD -o crash_search crash_search.c -lz -lzstd -lpthread
  *
  * Author: Vinayak Menon <vinayakm.list@gmail.com>
  */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
 
-/*The program assumes that the maximum length
- *of a line in the crash dump will not exceed
- *160 chars
- */
-#define MAX_INPUT_READ_BUF_SIZE 161
-char input_read_buf[MAX_INPUT_READ_BUF_SIZE];
-int number_of_sections = 0;
-int virtual_mem_layout_found = 0;
+#include "symbolizer.h"
+
+#define LINE_READER_BUF_SIZE (1 << 20)
+#define OUTPUT_BUF_SIZE (1 << 20)
+#define MAX_TOKENS 16
+/*quiet time after which the Oops being followed is printed*/
+#define FOLLOW_IDLE_MS 500
+
+__thread int number_of_sections = 0;
+__thread int virtual_mem_layout_found = 0;
+__thread int region_index_valid = 0;
 char* input_file;
 char* vmlinux_path;
-int crash_search_start(FILE *input_fp, FILE *output_fp);
-int check_for_string_in_next_line(char* input_read_buf, FILE *input_fp, FILE *output_fp, const char* search);
+int batch_mode = 0;
+/*no report is printed, for batch mode and index only passes*/
+int quiet = 0;
+/*the Oopses and layouts are recorded for the index*/
+int indexing = 0;
+int follow_mode = 0;
+
+enum output_format {
+	FORMAT_TEXT,
+	FORMAT_JSON,
+	FORMAT_CSV,
+};
+
+/*structured results go to output_fp, the text report to stdout*/
+enum output_format output_format = FORMAT_TEXT;
+FILE *output_fp;
+/*one report is printed at a time when several inputs are followed*/
+pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct line_reader {
+	int fd;
+	char *buf;
+	size_t size;
+	size_t start;	/*start of the next line in buf*/
+	size_t end;	/*end of the valid data in buf*/
+	int eof;
+	off_t base;	/*file offset of buf[0]*/
+	off_t line_offset;	/*file offset of the last line returned*/
+	int follow;	/*wait for more data at the end of the input*/
+	int notify_fd;	/*inotify of a followed regular file, else -1*/
+	int idle;	/*set once the idle time passed, till data comes*/
+	struct decompressor *dec;	/*fd is the pipe it writes to*/
+};
+
+enum oops_state {
+	STATE_SCAN,	/*looking for the layout or "Flags:"*/
+	STATE_LAYOUT,	/*inside "Virtual kernel memory layout:"*/
+	STATE_FLAGS,	/*got "Flags:", "Control:" must follow*/
+	STATE_OOPS,	/*inside the PC:, LR: ... sections of an Oops*/
+	STATE_REGS64,	/*got "pstate:" of an arm64 Oops, registers follow*/
+	STATE_CALL_TRACE,	/*inside "Call trace:" of an arm64 Oops*/
+};
+
+__thread enum oops_state state = STATE_SCAN;
+/*set once a header is seen, dump lines are ignored till then*/
+__thread int in_section = 0;
+
+/*where the line being parsed, the current Oops and layout start*/
+__thread off_t cur_line_offset;
+__thread off_t oops_start_offset;
+__thread double oops_start_time;
+__thread int oops_is_arm64;
+__thread off_t layout_offset = -1;
+__thread unsigned long nr_flushed;
+/*printed before each report, to tell followed inputs apart*/
+__thread const char *output_label;
+/*the input being parsed, for the structured output*/
+__thread const char *input_name;
+
+int crash_search_start(struct line_reader *lr);
+int crash_search_line(char *line);
+void flush_oops(void);
+int is_oops_end(const char *line);
+void finish_oops_sig(void);
+void scan_oops_sig(char *line);
+void index_add_layout(void);
+double printk_time(const char *s);
+int add_batch_path(const char *path);
+int add_batch_list(const char *list);
+int batch_search(int nr_threads);
+int load_index(int fd);
+int save_index(int fd);
+int search_indexed(struct line_reader *lr, long number, double from, double to, const char *symbol);
+int add_follow_file(const char *path);
+int follow_search(void);
+void follow_idle(void);
+void finish_input(void);
+void crash_search_reset(void);
+int wait_for_input(struct line_reader *lr);
+void print_layout(int complete);
+int open_decompressor(struct line_reader *lr, const char *path);
+void close_decompressor(struct line_reader *lr);
+struct bucket;
+void write_oops_record(void);
+int close_output(void);
+void write_bucket_record(struct bucket *b);
 
 void show_help(void)
 {
 	printf("Usage: crash_search -i [path to crash file] -v [path to vmlinux]\n");
-	printf("options: i,v,h\n");
-	printf("i : path to the crash dump file\n");
+	printf("       crash_search -d [crash log dir] -l [list of crash logs] -j [threads] -v [path to vmlinux]\n");
+	printf("       crash_search -i [path to crash file] -v [path to vmlinux] -n [number] -t [from-to] -s [function]\n");
+	printf("       crash_search -f -i [crash file] -i [crash file] ... -v [path to vmlinux]\n");
+	printf("       crash_search ... -F [json or csv] -o [output file]\n");
+	printf("options: i,v,d,l,j,n,t,s,f,F,o,h\n");
+	printf("i : path to the crash dump file, - to read it from stdin\n");
 	printf("v : path to the vmlinux file\n");
+	printf("d : bucket the Oopses of every file under this directory\n");
+	printf("l : bucket the Oopses of the files listed in this file, one per line\n");
+	printf("j : number of threads for d and l, the number of CPUs by default\n");
+	printf("n : only the Oops with this number, counting from 1\n");
+	printf("t : only the Oopses in this time range, e.g. 100.5-200 or 100-\n");
+	printf("s : only the Oopses with the PC in this function\n");
+	printf("f : follow the input as it grows, -i can be given several times\n");
+	printf("F : json or csv, structured results instead of the text report\n");
+	printf("o : file for the structured results, stdout by default\n");
 	printf("h : help\n");
 	fflush(stdout);
 }
 
 int main(int argc, char *argv[])
 {
-	FILE *input_fp, *output_fp;
+	struct line_reader lr;
 	int ret;
-	int c, vm = 0, in = 0;
+	int c, vm = 0, in = 0, nr_threads = 0;
+	int select = 0, indexed;
+	long number = 0;
+	double from = -1, to = -1;
+	char *symbol = NULL, *output_file = NULL, *p;
 
-	while((c = getopt(argc, argv, ":v:i:h:")) != -1) {
+	/*a decompressor whose reader has gone gets EPIPE instead*/
+	signal(SIGPIPE, SIG_IGN);
+
+	while((c = getopt(argc, argv, ":v:i:d:l:j:n:t:s:fF:o:h:")) != -1) {
 		switch(c) {
 			case 'v':
 				vmlinux_path = optarg;
@@ -55,6 +186,55 @@ int main(int argc, char *argv[])
 			case 'i':
 				input_file = optarg;
 				in = 1;
+				if(add_follow_file(optarg))
+					exit(2);
+				break;
+			case 'f':
+				follow_mode = 1;
+				break;
+			case 'F':
+				if(!strcmp(optarg, "json"))
+					output_format = FORMAT_JSON;
+				else if(!strcmp(optarg, "csv"))
+					output_format = FORMAT_CSV;
+				else {
+					printf("Unknown output format %s\n", optarg);
+					show_help();
+					exit(2);
+				}
+				break;
+			case 'o':
+				output_file = optarg;
+				if(!output_format)
+					output_format = FORMAT_JSON;
+				break;
+			case 'd':
+				if(add_batch_path(optarg))
+					exit(2);
+				batch_mode = 1;
+				quiet = 1;
+				break;
+			case 'l':
+				if(add_batch_list(optarg))
+					exit(2);
+				batch_mode = 1;
+				quiet = 1;
+				break;
+			case 'j':
+				nr_threads = atoi(optarg);
+				break;
+			case 'n':
+				number = strtol(optarg, NULL, 0);
+				select = 1;
+				break;
+			case 't':
+				from = strtod(optarg, &p);
+				to = *p == '-' && p[1] ? strtod(p + 1, NULL) : -1;
+				select = 1;
+				break;
+			case 's':
+				symbol = optarg;
+				select = 1;
 				break;
 			case 'h':
 				show_help();
@@ -67,383 +247,2418 @@ int main(int argc, char *argv[])
 				break;
 		}
 	}
-	
+
 	if(!vm) {
 		printf("vmlinux path missing\n");
 		show_help();
 		exit(2);
 	}
 
+	if(output_format) {
+		if(!output_file || !strcmp(output_file, "-"))
+			output_fp = stdout;
+		else
+			output_fp = fopen(output_file, "w");
+		if(!output_fp) {
+			printf("Error opening the output file %s\n", output_file);
+			exit(2);
+		}
+		setvbuf(output_fp, NULL, _IOFBF, OUTPUT_BUF_SIZE);
+		if(output_format == FORMAT_CSV && !batch_mode)
+			fprintf(output_fp, "file,oops,time,kind,name,offset,value,symbol,source,regions,data\n");
+	}
+
+	if(batch_mode) {
+		if(symbolizer_open(vmlinux_path))
+			printf("Error loading symbols from vmlinux, symbols will not be available\n");
+		ret = batch_search(nr_threads);
+		symbolizer_close();
+		return close_output() ? -1 : ret;
+	}
+
 	if(!in) {
 		printf("crash dump file path missing\n");
 		show_help();
 		exit(2);
 	}
-		
-	input_fp = fopen(input_file, "r");
-	if(!input_fp) {
+
+	if(follow_mode) {
+		if(symbolizer_open(vmlinux_path))
+			printf("Error loading symbols from vmlinux, symbols will not be available\n");
+		ret = follow_search();
+		symbolizer_close();
+		if(close_output() || ret < 0) {
+			printf("Halt\n");
+			return -1;
+		}
+		if(!output_format)
+			printf("******************************END**************************************");
+		return 0;
+	}
+
+	memset(&lr, 0, sizeof(lr));
+	if(!strcmp(input_file, "-"))
+		lr.fd = STDIN_FILENO;
+	else
+		lr.fd = open(input_file, O_RDONLY);
+	if(lr.fd < 0) {
 		printf("Error opening the input file %s\n", input_file);
 		return -1;
 	}
+	if(open_decompressor(&lr, input_file))
+		return -1;
+	input_name = input_file;
+
+	if(symbolizer_open(vmlinux_path))
+		printf("Error loading symbols from vmlinux, symbols will not be available\n");
 
-	/*output_fp is unused at present*/
-	ret = crash_search_start(input_fp, output_fp);
-	if(ret < 0) {
+	/*a pipe can neither be indexed nor seeked*/
+	indexed = lr.fd != STDIN_FILENO && !lr.dec && !load_index(lr.fd);
+	indexing = lr.fd != STDIN_FILENO && !lr.dec && !indexed;
+
+	if(select) {
+		if(lr.fd == STDIN_FILENO || lr.dec) {
+			printf("Selecting Oopses needs an uncompressed input file\n");
+			symbolizer_close();
+			return -1;
+		}
+		if(!indexed) {
+			quiet = 1;
+			ret = crash_search_start(&lr);
+			quiet = 0;
+			if(ret >= 0)
+				save_index(lr.fd);
+			/*the selected Oopses are parsed again, not indexed again*/
+			indexing = 0;
+		}
+		ret = search_indexed(&lr, number, from, to, symbol);
+	} else {
+		ret = crash_search_start(&lr);
+		if(ret >= 0 && indexing)
+			save_index(lr.fd);
+	}
+	close_decompressor(&lr);
+	symbolizer_close();
+	if(close_output() || ret < 0) {
 		printf("Halt\n");
 		return -1;
 	}
-	printf("******************************END**************************************");
+	if(!output_format)
+		printf("******************************END**************************************");
 	return 0;
 }
 
-int crash_search_start(FILE *input_fp, FILE *output_fp)
+/*Flushes the structured results. Returns -1 if they could not be written*/
+int close_output(void)
 {
-#define INPUT_FP_ERR(x) {									\
-				if(!feof(input_fp)) {						\
-					fclose(input_fp);					\
-					fclose(output_fp);   					\
-					printf("Error reading from the input file, DP %d\n",x); \
-					return -1;           					\
-		     		} else								\
-					return 1;						\
-		       }									\
-	
+	int ret;
 
-#define GEN_ERR(x) {				\
-			fclose(input_fp);	\
-			fclose(output_fp);	\
-			printf("%s\n",x);	\
-			return -1;		\
-		   }				\
+	if(!output_fp)
+		return 0;
 
-	int ret;
-	long curr_position;
-	/*Read each line of the input file till eof*/
-	while(!(feof(input_fp))) {
+	ret = output_fp == stdout ? fflush(output_fp) : fclose(output_fp);
+	output_fp = NULL;
+	if(ret) {
+		printf("Error writing the output file\n");
+		return -1;
+	}
 
-		curr_position = ftell(input_fp);
-		/*Find the Virtual memory layout*/
-		ret = check_for_string_in_next_line(input_read_buf, input_fp, output_fp, "Virtual kernel memory layout:");
-		if(ret < 0)
-			return -1;
-		else if(!ret) {
-			/*Found the Virtual memory layout*/
-			parse_virtual_memory_layout(input_read_buf, input_fp, output_fp);
-		} else {
-			 if(fseek(input_fp, curr_position, SEEK_SET)) {
-                         	GEN_ERR("Error setting the input file position\n");
-                         }
-		}
+	return 0;
+}
 
-		/*Step 1: Check if we can find "Flags:" in the string*/
-		ret = check_for_string_in_next_line(input_read_buf, input_fp, output_fp, "Flags:");
-		if(ret < 0)
-			return -1;
-		else if(!ret) {
-			/*We got "Flag:"*/
-			/*Get the current position, so that if we dont find what we need
-			 *we can go back and start our search again
-			 */
-			curr_position = ftell(input_fp);
-
-			/*Step 2: Lets go and check if we can find "Control:" in the next line*/
-			ret = check_for_string_in_next_line(input_read_buf, input_fp, output_fp, "Control:");
-			if(ret < 0)
-				return -1;
-			else if(!ret) {
-				/*We got "Control:"*/
-				curr_position = ftell(input_fp);
-				/*Step 2: Lets go and check if we can find "PC:" in the curr line or next*/
-				ret = check_for_string_in_next_line(input_read_buf, input_fp, output_fp, "PC:");
-				if(ret < 0)
-					return -1;
-				else if(!ret) {
-					/*We got PC:*/
-				} else {
-					curr_position = ftell(input_fp);
-					/*Check for "PC:" again. Usually there is a blank space in Oops dump*/
-					ret = check_for_string_in_next_line(input_read_buf, input_fp, output_fp, "PC:");
-					if(ret < 0)
-						return -1;
-					else if(!ret) {
-						start_oops_parsing(input_fp, output_fp, input_read_buf,curr_position);
-					} else {
-						if(fseek(input_fp, curr_position, SEEK_SET)) {
-							GEN_ERR("Error setting the input file position\n");
-						}
-							/*We didnt get PC, continue, as it means that
-                                                         *the "Flags:" and "Contro:" we had got didnt
-                                                         *belong to the Oops dump
-							 */
-                                                         continue;
-					}
-				}
-		
+/*Returns the next line without the trailing newline, NULL at the
+ *end of input. The line stays valid till the next call.
+ */
+char* read_line(struct line_reader *lr)
+{
+	char *line, *nl;
+	ssize_t ret;
+
+	while(1) {
+		nl = memchr(lr->buf + lr->start, '\n', lr->end - lr->start);
+		if(nl || (lr->eof && lr->start < lr->end)) {
+			line = lr->buf + lr->start;
+			lr->line_offset = lr->base + lr->start;
+			if(nl) {
+				*nl = '\0';
+				lr->start = nl - lr->buf + 1;
 			} else {
-				/*We found flag, but not control, which means the flag was
-				 *not a part of oops dump*/
-				if(fseek(input_fp, curr_position, SEEK_SET)) {
-					GEN_ERR("Error setting the input file position\n");
-				}
+				/*last line without a newline, there is always room for the NUL*/
+				lr->buf[lr->end] = '\0';
+				lr->start = lr->end;
+			}
+			if(nl && nl > line && nl[-1] == '\r')
+				nl[-1] = '\0';
+			return line;
+		}
+
+		if(lr->eof)
+			return NULL;
+
+		/*move the partial line to the front and make room*/
+		if(lr->start) {
+			memmove(lr->buf, lr->buf + lr->start, lr->end - lr->start);
+			lr->end -= lr->start;
+			lr->base += lr->start;
+			lr->start = 0;
+		}
+
+		if(lr->end + 1 >= lr->size) {
+			char *tmp;
+			size_t size = lr->size ? lr->size * 2 : LINE_READER_BUF_SIZE;
+
+			tmp = realloc(lr->buf, size);
+			if(!tmp) {
+				printf("Out of memory reading the input file\n");
+				return NULL;
+			}
+			lr->buf = tmp;
+			lr->size = size;
+		}
+
+		ret = read(lr->fd, lr->buf + lr->end, lr->size - lr->end - 1);
+		if(ret < 0) {
+			if(errno == EINTR)
+				continue;
+			/*a followed pipe with nothing to read yet*/
+			if(lr->follow && errno == EAGAIN) {
+				if(wait_for_input(lr))
+					lr->eof = 1;
 				continue;
-				
-			}	
+			}
+			printf("Error reading from the input file\n");
+			lr->eof = 1;
+		} else if(!ret) {
+			/*a followed file has not grown yet, a pipe is closed*/
+			if(lr->follow && lr->notify_fd >= 0) {
+				if(wait_for_input(lr))
+					lr->eof = 1;
+			} else
+				lr->eof = 1;
 		} else {
-			/*We didnt find flag, continue*/
-			continue;
+			lr->end += ret;
+			lr->idle = 0;
+		}
+	}
+}
+
+/*Sleeps till the followed input has more data. After FOLLOW_IDLE_MS
+ *without any, follow_idle() is called once and the wait has no
+ *timeout any more. Returns -1 if the input can not be waited for.
+ */
+int wait_for_input(struct line_reader *lr)
+{
+	struct pollfd pfd;
+	struct stat st;
+	char events[4096];
+	int ret;
+
+	pfd.fd = lr->notify_fd >= 0 ? lr->notify_fd : lr->fd;
+	pfd.events = POLLIN;
+	ret = poll(&pfd, 1, lr->idle ? -1 : FOLLOW_IDLE_MS);
+	if(ret < 0)
+		return errno == EINTR ? 0 : -1;
+
+	if(!ret) {
+		follow_idle();
+		lr->idle = 1;
+		return 0;
+	}
+
+	if(lr->notify_fd >= 0) {
+		if(read(lr->notify_fd, events, sizeof(events)) < 0 && errno != EAGAIN)
+			return -1;
+		/*truncated, e.g. by log rotation: print what was being
+		 *parsed and start over as on a new log*/
+		if(!fstat(lr->fd, &st) && st.st_size < lr->base + (off_t)lr->end) {
+			finish_input();
+			crash_search_reset();
+			lseek(lr->fd, 0, SEEK_SET);
+			lr->start = lr->end = 0;
+			lr->base = 0;
 		}
-	}	
-			
+	}
+
+	return 0;
+}
+
+int crash_search_start(struct line_reader *lr)
+{
+	char *line;
+
+	/*Read each line of the input file till eof*/
+	while((line = read_line(lr))) {
+		cur_line_offset = lr->line_offset;
+		if(crash_search_line(line) < 0)
+			return -1;
+	}
+
+	finish_input();
 	return 0;
 }
 
+/*Prints what was being parsed when the input ended*/
+void finish_input(void)
+{
+	/*the log ended inside an Oops*/
+	if(state == STATE_OOPS || state == STATE_REGS64 || state == STATE_CALL_TRACE)
+		flush_oops();
+
+	if(state == STATE_LAYOUT && !quiet && !output_format)
+		print_layout(0);
+	state = STATE_SCAN;
+
+	if(batch_mode)
+		finish_oops_sig();
+}
+
+/*Skips the "<6>" level and "[   12.345678]" time stamp prefixes of printk*/
+char* skip_printk_prefix(char *s)
+{
+	char *p;
+
+	if(*s == '<') {
+		for(p = s + 1; isdigit((unsigned char)*p); p++)
+			;
+		if(*p == '>')
+			s = p + 1;
+	}
+
+	if(*s == '[') {
+		for(p = s + 1; *p == ' ' || *p == '.' || isdigit((unsigned char)*p); p++)
+			;
+		if(*p == ']')
+			s = p + 1;
+	}
+
+	return s;
+}
+
+/*The "[   12.345678]" time stamp of a line in seconds, -1 if it has none*/
+double printk_time(const char *s)
+{
+	char *end;
+	double t;
+
+	if(*s == '<') {
+		s = strchr(s, '>');
+		if(!s)
+			return -1;
+		s++;
+	}
+	if(*s != '[')
+		return -1;
+
+	t = strtod(s + 1, &end);
+	if(end == s + 1 || *end != ']')
+		return -1;
+
+	return t;
+}
+
+__thread char *token_buf;
+__thread size_t token_buf_size;
+
+/*Splits a copy of s on white space, s itself is left intact so that
+ *a line can still be searched after it has been tokenized. Returns
+ *the number of tokens, only the first MAX_TOKENS are stored.
+ */
+int tokenize(const char *s, char **tok)
+{
+	size_t len = strlen(s) + 1;
+	char *p, *tmp;
+	int count = 0;
+
+	if(len > token_buf_size) {
+		tmp = realloc(token_buf, len);
+		if(!tmp)
+			return 0;
+		token_buf = tmp;
+		token_buf_size = len;
+	}
+	p = memcpy(token_buf, s, len);
+
+	while(1) {
+		while(*p == ' ' || *p == '\t')
+			p++;
+		if(!*p)
+			break;
+		if(count < MAX_TOKENS)
+			tok[count] = p;
+		count++;
+		while(*p && *p != ' ' && *p != '\t')
+			p++;
+		if(*p)
+			*p++ = '\0';
+	}
+
+	return count;
+}
+
 struct virt_mem {
 	char name[10];
 	unsigned long start;
 	unsigned long end;
 };
 
-struct virt_mem *virt_mem_layout;
+__thread struct virt_mem *virt_mem_layout;
+__thread int virt_mem_layout_size = 0;
 
-int parse_virtual_memory_layout(char* input_read_buf, FILE *input_fp, FILE *output_fp)
+/*Returns 0 if the line was a layout entry, 1 if the layout ended*/
+int parse_virtual_memory_layout(char **tok, int count)
 {
-	int curr_position = ftell(input_fp);
-	int count = 0;
-	char* s;
-	int loop_till = 0;
+	struct virt_mem *tmp;
 	int valid = 0;
-	int loop_count = 0;
+	int i;
 
-	do {
-		count = 0;
-		valid = 0;
-		if(!(fgets(input_read_buf, MAX_INPUT_READ_BUF_SIZE, input_fp))) {
-			INPUT_FP_ERR(6)
-		} else {
-	        	if((s = strtok(input_read_buf, " "))) {
-				count++;
-               			while((s = strtok(NULL, " "))) {
-                       			count++;
-					if(!strncmp("kB",s,2) || !strncmp("MB",s,2) || !strncmp("GB",s,2)) {
-						valid = 1;
-					}
-               			}
-       		 	}
-		}
-		if(!valid)
-			break;
+	for(i = 1; i < count && i < MAX_TOKENS; i++) {
+		if(!strncmp("kB",tok[i],2) || !strncmp("KB",tok[i],2) ||
+			!strncmp("MB",tok[i],2) || !strncmp("GB",tok[i],2))
+			valid = 1;
+	}
+
+	/*the second line of an arm64 entry, "0xffffffbdc0000000 - ... (48 MB actual)"*/
+	if(valid && count >= 5 && !strncmp(tok[0], "0x", 2))
+		return 0;
+
+	/*e.g. ".text : 0xc0008000 - 0xc077d5c8   (7638 kB)"*/
+	if(!valid || count < 5) {
+		if(!quiet && !output_format)
+			print_layout(1);
+		return 1;
+	}
+
+	if(number_of_sections == virt_mem_layout_size) {
+		virt_mem_layout_size = virt_mem_layout_size ? virt_mem_layout_size * 2 : 16;
+		tmp = realloc(virt_mem_layout, virt_mem_layout_size * sizeof(struct virt_mem));
+		if(!tmp) {
+			printf("Out of memory parsing the virtual memory layout\n");
+			return -1;
+		}
+		virt_mem_layout = tmp;
+	}
+
+	snprintf(virt_mem_layout[number_of_sections].name, sizeof(virt_mem_layout[0].name), "%s", tok[0]);
+	virt_mem_layout[number_of_sections].start = strtoul(tok[2], NULL, 0);
+	virt_mem_layout[number_of_sections].end = strtoul(tok[4], NULL, 0);
+
+	number_of_sections++;
+	virtual_mem_layout_found = 1;
+	region_index_valid = 0;
+	return 0;
+}
+
+/*The layout is printed in one go once it has been parsed, so that
+ *it is not mixed up with the reports of other followed inputs.
+ */
+void print_layout(int complete)
+{
+	int i;
 
-		loop_till++;
-	} while(count >= 9);
-	
-	number_of_sections = loop_till;
-	virt_mem_layout = (struct virt_mem*)malloc(loop_till*sizeof(struct virt_mem));
-        
-	if(fseek(input_fp, curr_position, SEEK_SET)) {
-        	GEN_ERR("Error setting the input file position\n");
-        }
-	
+	pthread_mutex_lock(&output_lock);
+	if(output_label)
+		printf("**********%s***************\n", output_label);
 	printf("**********Kernel Virtual Memory layout***************\n");
 	printf("section,start,end\n");
+	for(i = 0; i < number_of_sections; i++)
+		printf("%s,%lx,%lx\n",virt_mem_layout[i].name, virt_mem_layout[i].start, virt_mem_layout[i].end);
+	if(complete)
+		printf("**********************************************************\n");
 	fflush(stdout);
-	for(loop_count = 0; loop_count < loop_till; loop_count++) {
-		count = 0;
-
-                if(!(fgets(input_read_buf, MAX_INPUT_READ_BUF_SIZE, input_fp))) {
-                        INPUT_FP_ERR(6)
-                } else {
-                        if((s = strtok(input_read_buf, " "))) {
-                                count++;
-                                while((s = strtok(NULL, " "))) {
-                                        count++;
-					if(count == 3)
-						strcpy(virt_mem_layout[loop_count].name,s);
-					else if(count == 5)
-						virt_mem_layout[loop_count].start = strtoul(s, NULL, 0);
-					else if(count == 7)
-						virt_mem_layout[loop_count].end = strtoul(s, NULL, 0);
-                                }
-                        }
-                }
-		printf("%s,%x,%x\n",virt_mem_layout[loop_count].name,virt_mem_layout[loop_count].start,virt_mem_layout[loop_count].end);
-		fflush(stdout);
-		
-	}
-	printf("**********************************************************\n");
-	fflush(stdout);
-	virtual_mem_layout_found = 1;
+	pthread_mutex_unlock(&output_lock);
 }
 
-int check_for_string_in_next_line(char* input_read_buf, FILE *input_fp, FILE *output_fp, const char* search)
+/*The sections of the layout overlap (.text is inside lowmem), so
+ *the address space is cut at every section boundary into segments,
+ *each one with the list of sections covering it. Classifying a
+ *word is then a binary search over the segments.
+ */
+struct region_seg {
+	unsigned long start;
+	unsigned long end;	/*inclusive, as in the layout*/
+	int first;		/*in region_seg_sections*/
+	int count;
+};
+
+__thread struct region_seg *region_segs;
+__thread int nr_region_segs;
+__thread int *region_seg_sections;
+
+int cmp_ulong(const void *a, const void *b)
 {
-	
-	if(!(fgets(input_read_buf, MAX_INPUT_READ_BUF_SIZE, input_fp))) {
-                        INPUT_FP_ERR(1)
-        } else {
-                if(strstr(input_read_buf, search)) {
-			return 0;
-		} else
-			return 1;
-	}
+	unsigned long x = *(const unsigned long*)a, y = *(const unsigned long*)b;
+
+	return x < y ? -1 : x > y;
 }
 
-int parse_header(char* input_read_buf, FILE *input_fp, FILE *output_fp, int curr_position)
+int build_region_index(void)
 {
-	char *s, *org;
-	char sprint_buf[150];
-	int count = 0;
-	
-	/*This is a crude way to check whether this is a header
-	 *Here we just check the number of sequences seperated
-	 *by delimiters. Change it some time with a good way.
-	 */
-	if((s = strtok(input_read_buf, " "))) {
-		count++;
-		while((s = strtok(NULL, " "))) {
-			count++;
-		}
-	}
+	unsigned long *bounds;
+	int nr_bounds = 0, nr_sections = 0;
+	int i, j, k;
 
-	/*Skip a newline in the Oops dump*/
-	if((count == 1) || (count == 3)) {
-		return 1;
-	}
-	else if(count != 4) {
-		/*This is not a header*/
+	free(region_segs);
+	free(region_seg_sections);
+	region_segs = NULL;
+	region_seg_sections = NULL;
+	nr_region_segs = 0;
+
+	bounds = malloc(2 * (number_of_sections + 1) * sizeof(unsigned long));
+	/*a segment has at most every section, and there are fewer
+	 *segments than boundaries*/
+	region_segs = malloc(2 * (number_of_sections + 1) * sizeof(struct region_seg));
+	region_seg_sections = malloc(2 * (number_of_sections + 1) * (number_of_sections + 1) * sizeof(int));
+	if(!bounds || !region_segs || !region_seg_sections) {
+		printf("Out of memory indexing the virtual memory layout\n");
+		free(bounds);
 		return -1;
 	}
 
-	count = 0;
-	/*strtok would have changed the pointer, read again*/
-	if(fseek(input_fp, curr_position, SEEK_SET)) {
-		GEN_ERR("Error setting the input file position\n");
+	for(i = 0; i < number_of_sections; i++) {
+		bounds[nr_bounds++] = virt_mem_layout[i].start;
+		/*ending at the top of the address space needs no boundary*/
+		if(virt_mem_layout[i].end + 1)
+			bounds[nr_bounds++] = virt_mem_layout[i].end + 1;
 	}
+	qsort(bounds, nr_bounds, sizeof(unsigned long), cmp_ulong);
 
-	if(!(fgets(input_read_buf, MAX_INPUT_READ_BUF_SIZE, input_fp))) {
-		INPUT_FP_ERR(4)
-	}
+	for(i = 0; i < nr_bounds; i++) {
+		if(i && bounds[i] == bounds[i - 1])
+			continue;
+		for(j = i + 1; j < nr_bounds && bounds[j] == bounds[i]; j++)
+			;
 
-        if((s = strtok(input_read_buf, " "))) {
-                count++;
-                while((s = strtok(NULL, " "))) {
-                        count++;
-                        if(count == 3) {
-                                printf("******************************%s***********************************\n",s);
-				fflush(stdout);
+		region_segs[nr_region_segs].start = bounds[i];
+		region_segs[nr_region_segs].end = j < nr_bounds ? bounds[j] - 1 : ~0UL;
+		region_segs[nr_region_segs].first = nr_sections;
+		region_segs[nr_region_segs].count = 0;
+
+		/*sections are kept in the order of the layout*/
+		for(k = 0; k < number_of_sections; k++) {
+			if(virt_mem_layout[k].start <= bounds[i] && bounds[i] <= virt_mem_layout[k].end) {
+				region_seg_sections[nr_sections++] = k;
+				region_segs[nr_region_segs].count++;
 			}
-                        else if(count == 4) {
-                                s[10] = '\0';
-                                printf("%s\n",s);
-				fflush(stdout);
-                                sprintf(sprint_buf,"addr2line -e %s %s\0",vmlinux_path, s);
-                                system(sprint_buf);
-                        }
+		}
+
+		if(region_segs[nr_region_segs].count)
+			nr_region_segs++;
+	}
 
-                }
-        }
-	
+	free(bounds);
+	region_index_valid = 1;
+	return 0;
 }
 
-int parse_trace(FILE *input_fp, FILE *output_fp, char* input_read_buf)
+/*Sections containing val, in the order of the layout. Returns their count*/
+int classify_address(unsigned long val, int **sections)
 {
-	char *s;
-	char sprint_buf[150];
-	int count;
+	int lo, hi, mid;
+
+	if(!region_index_valid && build_region_index())
+		return 0;
+
+	lo = 0;
+	hi = nr_region_segs - 1;
+
+	while(lo <= hi) {
+		mid = lo + (hi - lo) / 2;
+		if(val < region_segs[mid].start)
+			hi = mid - 1;
+		else if(val > region_segs[mid].end)
+			lo = mid + 1;
+		else {
+			*sections = &region_seg_sections[region_segs[mid].first];
+			return region_segs[mid].count;
+		}
+	}
+
+	return 0;
+}
+
+int is_text_section(int i)
+{
+	return !strncmp(virt_mem_layout[i].name,".text",5);
+}
+
+int is_hex_word(const char *s, int len)
+{
+	int i;
+
+	for(i = 0; i < len; i++) {
+		if(!isxdigit((unsigned char)s[i]))
+			return 0;
+	}
+
+	return !s[len];
+}
+
+enum oops_entry_type {
+	OOPS_HEADER,	/*"PC: 0xc0123456:", or "pc : func+0x1c/0x40" on arm64*/
+	OOPS_WORD,	/*one word of a dump line*/
+	OOPS_REG,	/*one register of an arm64 register line*/
+	OOPS_FRAME,	/*one line of an arm64 call trace*/
+};
+
+struct oops_entry {
+	enum oops_entry_type type;
+	char name[16];	/*section name of a header, register name*/
+	char text[20];	/*the value as it appears in the log*/
+	char *desc;	/*the whole text of a frame or arm64 header*/
 	unsigned long offset;
-	int loop_count = 0;
-	int curr_position = 0;
-	int loop_till = 0;
 	unsigned long val;
-	int i;
+	int valid;	/*val could be parsed*/
+};
 
-	curr_position = ftell(input_fp);
-	
-	/*Crude method. Find a neat way some time*/
-	do{
-		loop_till++;
-		count = 0;
-		if(!(fgets(input_read_buf, MAX_INPUT_READ_BUF_SIZE, input_fp))) {
-			INPUT_FP_ERR(5)
-		} else {
-			if((s = strtok(input_read_buf, " "))) {
-				count++;
-				while((s = strtok(NULL, " "))) {
-					count++;
-				}
-			}
+/*The entries of the Oops being parsed. They are symbolized
+ *together once the Oops ends, so that every address goes
+ *to the symbolizer in one batch.
+ */
+__thread struct oops_entry *oops_entries;
+__thread int nr_oops_entries, oops_entries_size;
+
+struct oops_entry* new_oops_entry(enum oops_entry_type type)
+{
+	struct oops_entry *tmp;
+
+	if(nr_oops_entries == oops_entries_size) {
+		oops_entries_size = oops_entries_size ? oops_entries_size * 2 : 256;
+		tmp = realloc(oops_entries, oops_entries_size * sizeof(struct oops_entry));
+		if(!tmp) {
+			printf("Out of memory parsing the Oops\n");
+			return NULL;
 		}
-	} while(count == 11);
-	
-        if(fseek(input_fp, curr_position, SEEK_SET)) {
-                GEN_ERR("Error setting the input file position\n");
-        }
-
-        for(loop_count = 0; loop_count < (loop_till - 1); loop_count++) {
-                count = 0;
-                if(!(fgets(input_read_buf, MAX_INPUT_READ_BUF_SIZE, input_fp))) {
-                        INPUT_FP_ERR(2)
-                } else {
-                        if((s = strtok(input_read_buf, " "))) {
-                                count++;
-                                while((s = strtok(NULL, " "))) {
-                                        count++;
-                                        if(count == 3) {
-                                                s[4] = 0;
-                                                sprintf(sprint_buf,"0x%s",s);
-                                                offset = strtoul(sprint_buf, NULL, 0);
-                                        }
-                                        if((count > 3) && (count < 12)) {
-                                                s[8] = '\0';
-                                                printf("offset->%x,val->0x%s\n",offset + ((count - 4)*4),s);
-						fflush(stdout);
-						if(virtual_mem_layout_found) {
-							sprintf(sprint_buf,"0x%s",s);
-							val = strtoul(sprint_buf, NULL, 0);
-							for(i=0; i < number_of_sections; i++) {
-								if((val >= virt_mem_layout[i].start) && (val <= virt_mem_layout[i].end)) {
-									if(!strncmp(virt_mem_layout[i].name,".text",5)) {
-										sprintf(sprint_buf,"addr2line -e %s %s\0",vmlinux_path, s);
-										system(sprint_buf);
-									} else {
-										printf("Either a value or pointer from %s\n", virt_mem_layout[i].name);
-										fflush(stdout);
-									}
-								}
-							}
-						} else {
-							sprintf(sprint_buf,"addr2line -e %s %s\0",vmlinux_path, s);
-							system(sprint_buf);
-						}
-                                        }
-                                }
-                        }
-                }
-        }
+		oops_entries = tmp;
+	}
 
-	return 0;
+	memset(&oops_entries[nr_oops_entries], 0, sizeof(struct oops_entry));
+	oops_entries[nr_oops_entries].type = type;
+	return &oops_entries[nr_oops_entries++];
 }
 
-int start_oops_parsing(FILE *input_fp, FILE* output_fp, char* input_read_buf, int curr_position)
+void clear_oops(void)
 {
-	char* org = input_read_buf;
-	int ret = 0;
+	int i;
 
-	while(ret >= 0) {
-		/*Parses headers like PC:, LR:, R1: etc*/
-		ret = parse_header(input_read_buf, input_fp, output_fp, curr_position);
-		if(ret == 1) {
-			curr_position = ftell(input_fp);
-			if(!(fgets(input_read_buf, MAX_INPUT_READ_BUF_SIZE, input_fp))) {
-				INPUT_FP_ERR(3);
-			}
-			continue;
-		} else if(ret < 0)
-			break;
+	for(i = 0; i < nr_oops_entries; i++)
+		free(oops_entries[i].desc);
+	nr_oops_entries = 0;
+}
 
-		/*Parse the addresses in the trace*/
-		if(parse_trace(input_fp, output_fp, input_read_buf))
-			return -1;
+/*Only words in .text are symbolized when the layout is known*/
+int needs_symbol(struct oops_entry *e)
+{
+	int *sections;
+	int i, count;
+
+	if(!e->valid)
+		return 0;
+
+	if(e->type == OOPS_HEADER || e->type == OOPS_FRAME || !virtual_mem_layout_found)
+		return 1;
+
+	count = classify_address(e->val, &sections);
+	for(i = 0; i < count; i++) {
+		if(is_text_section(sections[i]))
+			return 1;
 	}
 
 	return 0;
 }
+
+/*"func+0x1c kernel/fork.c:123"*/
+void print_symbol(unsigned long val)
+{
+	struct sym_entry *sym = symbolizer_lookup(val);
+
+	if(sym && strcmp(sym->func, "??"))
+		printf("%s+0x%lx %s\n", sym->func, sym->offset, sym->file_line);
+	else
+		printf("%s\n", sym ? sym->file_line : "??:0");
+}
+
+/*"Either a value or pointer from .data (jiffies+0x0)"*/
+void print_data_pointer(unsigned long val, const char *section)
+{
+	unsigned long offset;
+	const char *name = symbolizer_data(val, &offset);
+
+	if(name)
+		printf("Either a value or pointer from %s (%s+0x%lx)\n", section, name, offset);
+	else
+		printf("Either a value or pointer from %s\n", section);
+}
+
+/*A dump word or register, with what it may point to*/
+void print_word(struct oops_entry *e)
+{
+	int *sections;
+	int j, count;
+
+	if(!e->valid)
+		return;
+
+	if(virtual_mem_layout_found) {
+		count = classify_address(e->val, &sections);
+		for(j = 0; j < count; j++) {
+			if(is_text_section(sections[j]))
+				print_symbol(e->val);
+			else
+				print_data_pointer(e->val, virt_mem_layout[sections[j]].name);
+		}
+	} else {
+		print_symbol(e->val);
+	}
+}
+
+void sig_set_registers(unsigned long pc, unsigned long lr);
+void index_add_oops(void);
+
+/*Symbolizes and prints the Oops collected so far*/
+void flush_oops(void)
+{
+	struct oops_entry *e;
+	int i;
+	unsigned long pc = 0, lr = 0;
+
+	nr_flushed++;
+	if(indexing)
+		index_add_oops();
+
+	/*only the registers matter for the signature*/
+	if(batch_mode) {
+		for(i = 0; i < nr_oops_entries; i++) {
+			if(oops_entries[i].type != OOPS_HEADER || !oops_entries[i].valid)
+				continue;
+			if(!strcasecmp(oops_entries[i].name, "PC:") && !pc)
+				pc = oops_entries[i].val;
+			else if(!strcasecmp(oops_entries[i].name, "LR:") && !lr)
+				lr = oops_entries[i].val;
+		}
+		if(pc)
+			sig_set_registers(pc, lr);
+		clear_oops();
+		return;
+	}
+
+	if(quiet) {
+		clear_oops();
+		return;
+	}
+
+	for(i = 0; i < nr_oops_entries; i++) {
+		if(needs_symbol(&oops_entries[i]))
+			symbolizer_queue(oops_entries[i].val);
+	}
+	symbolizer_resolve();
+
+	if(output_format) {
+		pthread_mutex_lock(&output_lock);
+		write_oops_record();
+		/*a followed log is read by someone waiting for it*/
+		if(follow_mode)
+			fflush(output_fp);
+		pthread_mutex_unlock(&output_lock);
+		clear_oops();
+		return;
+	}
+
+	pthread_mutex_lock(&output_lock);
+	if(output_label)
+		printf("**********%s***************\n", output_label);
+
+	for(i = 0; i < nr_oops_entries; i++) {
+		e = &oops_entries[i];
+
+		switch(e->type) {
+		case OOPS_HEADER:
+			printf("******************************%s***********************************\n",e->name);
+			printf("%s\n",e->desc ? e->desc : e->text);
+			if(e->valid)
+				print_symbol(e->val);
+			else
+				printf("??:0\n");
+			break;
+
+		case OOPS_WORD:
+			printf("offset->%lx,val->0x%s\n",e->offset,e->text);
+			print_word(e);
+			break;
+
+		case OOPS_REG:
+			printf("reg->%s,val->0x%s\n",e->name,e->text);
+			print_word(e);
+			break;
+
+		case OOPS_FRAME:
+			if(!i || e[-1].type != OOPS_FRAME)
+				printf("******************************Call trace:***********************************\n");
+			printf("%s\n",e->desc);
+			if(e->valid)
+				print_symbol(e->val);
+			else
+				printf("??:0\n");
+			break;
+		}
+	}
+
+	fflush(stdout);
+	pthread_mutex_unlock(&output_lock);
+	clear_oops();
+}
+
+/*Headers look like "PC: 0xc0123456:". Returns 1 if the line was one*/
+int parse_header(char **tok, int count)
+{
+	struct oops_entry *e;
+	size_t len;
+
+	if(count != 2)
+		return 0;
+
+	len = strlen(tok[0]);
+	if(len < 2 || tok[0][len - 1] != ':' || strncmp(tok[1], "0x", 2))
+		return 0;
+
+	len = strlen(tok[1]);
+	if(tok[1][len - 1] != ':')
+		return 0;
+	tok[1][len - 1] = '\0';
+
+	if(!(e = new_oops_entry(OOPS_HEADER)))
+		return -1;
+	snprintf(e->name, sizeof(e->name), "%s", tok[0]);
+	snprintf(e->text, sizeof(e->text), "%s", tok[1]);
+	e->val = strtoul(tok[1], NULL, 16);
+	e->valid = 1;
+
+	return 1;
+}
+
+/*Dump lines look like "3456  e1a00000 ... (8 words)", the words
+ *are 8 hex digits on 32-bit and 16 on 64-bit. Returns 1 if the
+ *line was one.
+ */
+int parse_trace(char **tok, int count)
+{
+	struct oops_entry *e;
+	unsigned long offset;
+	size_t width;
+	int j;
+
+	if(count < 2 || count > 9 || !is_hex_word(tok[0], 4))
+		return 0;
+
+	width = strlen(tok[1]);
+	if(width != 8 && width != 16)
+		return 0;
+	for(j = 2; j < count; j++) {
+		if(strlen(tok[j]) != width)
+			return 0;
+	}
+
+	offset = strtoul(tok[0], NULL, 16);
+
+	for(j = 1; j < count; j++) {
+		if(!(e = new_oops_entry(OOPS_WORD)))
+			return -1;
+		e->offset = offset + ((j - 1)*width/2);
+		snprintf(e->text, sizeof(e->text), "%s", tok[j]);
+
+		/*"********" for words that could not be read*/
+		if(is_hex_word(tok[j], width)) {
+			e->val = strtoul(tok[j], NULL, 16);
+			e->valid = 1;
+		}
+	}
+
+	return 1;
+}
+
+/*Address of "func+0x1c/0x40" from the symbol table, 0 if unknown.
+ *Functions of modules, "func+0x1c/0x40 [module]", are not in vmlinux.
+ */
+unsigned long frame_address(const char *s)
+{
+	char name[256];
+	size_t len = strcspn(s, "+ ");
+	unsigned long addr;
+
+	if(s[len] != '+' || len >= sizeof(name) || strstr(s, " ["))
+		return 0;
+	memcpy(name, s, len);
+	name[len] = '\0';
+
+	addr = symbolizer_address(name);
+	if(!addr)
+		return 0;
+
+	return addr + strtoul(s + len + 1, NULL, 16);
+}
+
+/*Value of "[<ffffff8008123456>]", or of "func+0x1c/0x40" when the
+ *log has no address. Returns 0 if neither can be worked out.
+ */
+unsigned long parse_code_address(const char *s)
+{
+	if(!strncmp(s, "[<", 2))
+		return strtoul(s + 2, NULL, 16);
+
+	return frame_address(s);
+}
+
+/*"pc : do_thing+0x1c/0x40", or all in one line on older kernels:
+ *"pc : [<ffffff8008123456>] lr : [<ffffff8008123400>] pstate: 60000145".
+ *Returns 1 if the line had pc or lr.
+ */
+int parse_pc_lr(const char *line)
+{
+	static const char *regs[] = { "pc : ", "lr : " };
+	struct oops_entry *e;
+	const char *p, *end;
+	int i, found = 0;
+
+	for(i = 0; i < 2; i++) {
+		p = strstr(line, regs[i]);
+		if(!p)
+			continue;
+		p += 5;
+
+		if(!(e = new_oops_entry(OOPS_HEADER)))
+			return -1;
+		snprintf(e->name, sizeof(e->name), "%.2s:", regs[i]);
+
+		/*the value ends where the next register starts*/
+		end = p + strlen(p);
+		if(!strncmp(p, "[<", 2) && strstr(p, ">]"))
+			end = strstr(p, ">]") + 2;
+		e->desc = strndup(p, end - p);
+		e->val = parse_code_address(p);
+		e->valid = e->val != 0;
+		found = 1;
+	}
+
+	return found;
+}
+
+/*"x29: ffff80001234bd00 x28: 0000000000000000" and "x2 : ...", "sp : ...".
+ *Returns 1 if the line was a register line.
+ */
+int parse_registers(char **tok, int count)
+{
+	struct oops_entry *e;
+	char name[16], *val;
+	size_t len;
+	int i = 0, n = 0;
+
+	/*check the line first, nothing is added for other lines*/
+	while(n < 2) {
+		for(i = 0; i < count && i < MAX_TOKENS; ) {
+			len = strlen(tok[i]);
+			if(len > 1 && tok[i][len - 1] == ':' && len - 1 < sizeof(name) && i + 1 < count) {
+				snprintf(name, sizeof(name), "%.*s", (int)len - 1, tok[i]);
+				val = tok[i + 1];
+				i += 2;
+			} else if(i + 2 < count && !strcmp(tok[i + 1], ":") && len < sizeof(name)) {
+				snprintf(name, sizeof(name), "%s", tok[i]);
+				val = tok[i + 2];
+				i += 3;
+			} else
+				return 0;
+
+			if((name[0] != 'x' || !isdigit((unsigned char)name[1])) && strcmp(name, "sp"))
+				return 0;
+			if(!is_hex_word(val, 16))
+				return 0;
+
+			if(n) {
+				if(!(e = new_oops_entry(OOPS_REG)))
+					return -1;
+				snprintf(e->name, sizeof(e->name), "%s", name);
+				snprintf(e->text, sizeof(e->text), "%s", val);
+				e->val = strtoul(val, NULL, 16);
+				e->valid = 1;
+			}
+		}
+		if(i != count || count > MAX_TOKENS)
+			return 0;
+		n++;
+	}
+
+	return 1;
+}
+
+/*"  do_thing+0x1c/0x40 [module]" or "[<ffffff8008123456>] do_thing+0x1c/0x40".
+ *Returns 1 if the line was a frame.
+ */
+int parse_frame(char *line)
+{
+	struct oops_entry *e;
+	size_t len;
+
+	while(*line == ' ' || *line == '\t')
+		line++;
+
+	len = strcspn(line, " ");
+	if(strncmp(line, "[<", 2) && !memmem(line, len, "+0x", 3))
+		return 0;
+
+	if(!(e = new_oops_entry(OOPS_FRAME)))
+		return -1;
+	e->desc = strdup(line);
+	e->val = parse_code_address(line);
+	e->valid = e->val != 0;
+
+	return 1;
+}
+
+/*Lines after which an arm64 Oops has nothing more to parse*/
+int is_oops_end(const char *line)
+{
+	return !strncmp(line, "Code:", 5) || strstr(line, "---[ end trace") ||
+		strstr(line, "Internal error:") || strstr(line, "Kernel panic");
+}
+
+/*Feeds one line of the log to the state machine. No line is ever
+ *read twice, a line that ends a state is handed to STATE_SCAN.
+ */
+int crash_search_line(char *line)
+{
+	char *tok[MAX_TOKENS];
+	char *raw = line;
+	int count;
+	int ret;
+
+	line = skip_printk_prefix(line);
+
+	if(batch_mode)
+		scan_oops_sig(line);
+
+	switch(state) {
+	case STATE_LAYOUT:
+		count = tokenize(line, tok);
+		ret = parse_virtual_memory_layout(tok, count);
+		if(ret <= 0)
+			return ret;
+		state = STATE_SCAN;
+		break;
+
+	case STATE_FLAGS:
+		if(strstr(line, "Control:")) {
+			state = STATE_OOPS;
+			in_section = 0;
+			return 0;
+		}
+		/*We found flag, but not control, which means the flag was
+		 *not a part of oops dump*/
+		state = STATE_SCAN;
+		break;
+
+	case STATE_OOPS:
+		count = tokenize(line, tok);
+		/*Skip a newline in the Oops dump*/
+		if(!count)
+			return 0;
+		ret = parse_header(tok, count);
+		if(ret) {
+			in_section = 1;
+			return ret < 0 ? ret : 0;
+		}
+		if(in_section && (ret = parse_trace(tok, count)))
+			return ret < 0 ? ret : 0;
+		/*end of the register dump*/
+		flush_oops();
+		state = STATE_SCAN;
+		break;
+
+	case STATE_REGS64:
+		if(strstr(line, "Call trace:")) {
+			state = STATE_CALL_TRACE;
+			return 0;
+		}
+		if(is_oops_end(line)) {
+			flush_oops();
+			state = STATE_SCAN;
+			break;
+		}
+		if((ret = parse_pc_lr(line)))
+			return ret < 0 ? ret : 0;
+		count = tokenize(line, tok);
+		if(!count)
+			return 0;
+		if((ret = parse_registers(tok, count)))
+			return ret < 0 ? ret : 0;
+		if((ret = parse_header(tok, count))) {
+			in_section = 1;
+			return ret < 0 ? ret : 0;
+		}
+		if(in_section && (ret = parse_trace(tok, count)))
+			return ret < 0 ? ret : 0;
+		/*anything else, like the stack dump of old kernels, is skipped*/
+		in_section = 0;
+		return 0;
+
+	case STATE_CALL_TRACE:
+		if((ret = parse_frame(line)))
+			return ret < 0 ? ret : 0;
+		/*end of the call trace*/
+		flush_oops();
+		state = STATE_SCAN;
+		break;
+
+	case STATE_SCAN:
+		break;
+	}
+
+	/*Find the Virtual memory layout*/
+	if(strstr(line, "Virtual kernel memory layout:")) {
+		number_of_sections = 0;
+		virtual_mem_layout_found = 0;
+		region_index_valid = 0;
+		layout_offset = cur_line_offset;
+		if(indexing)
+			index_add_layout();
+		state = STATE_LAYOUT;
+	} else if(strstr(line, "Flags:")) {
+		oops_start_offset = cur_line_offset;
+		oops_start_time = printk_time(raw);
+		oops_is_arm64 = 0;
+		state = STATE_FLAGS;
+	} else if(strstr(line, "pstate:")) {
+		oops_start_offset = cur_line_offset;
+		oops_start_time = printk_time(raw);
+		oops_is_arm64 = 1;
+		clear_oops();
+		in_section = 0;
+		state = STATE_REGS64;
+		ret = parse_pc_lr(line);
+		if(ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+
+/*************************** batch mode ***************************/
+
+#define SIG_FRAMES 4
+#define MAX_EXAMPLES 3
+#define BUCKET_HASH_SIZE 4096
+
+#define SIG_NAME_LEN 64
+
+/*What the signature of the Oops being parsed is made of, the
+ *function names of the PC, LR and the top frames.
+ */
+struct oops_sig {
+	int active;
+	int in_call_trace;
+	int dumped;	/*the register dump has been parsed*/
+	char pc[SIG_NAME_LEN];
+	char lr[SIG_NAME_LEN];
+	char frames[SIG_FRAMES][SIG_NAME_LEN];
+	int nr_frames;
+};
+
+__thread struct oops_sig cur_sig;
+__thread int cur_file;		/*index in batch_files*/
+__thread time_t cur_mtime;
+
+struct bucket {
+	char *sig;
+	unsigned long count;
+	time_t first;
+	time_t last;
+	int examples[MAX_EXAMPLES];	/*the lowest file indexes, so the output is stable*/
+	int nr_examples;
+	struct bucket *next;
+};
+
+struct bucket *bucket_hash[BUCKET_HASH_SIZE];
+int nr_buckets;
+unsigned long nr_oopses;
+
+char **batch_files;
+int nr_batch_files, batch_files_size;
+int next_batch_file;
+pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int add_batch_file(const char *path)
+{
+	char **tmp;
+
+	if(nr_batch_files == batch_files_size) {
+		batch_files_size = batch_files_size ? batch_files_size * 2 : 256;
+		tmp = realloc(batch_files, batch_files_size * sizeof(char*));
+		if(!tmp) {
+			printf("Out of memory listing the crash logs\n");
+			return -1;
+		}
+		batch_files = tmp;
+	}
+
+	batch_files[nr_batch_files] = strdup(path);
+	if(!batch_files[nr_batch_files]) {
+		printf("Out of memory listing the crash logs\n");
+		return -1;
+	}
+	nr_batch_files++;
+	return 0;
+}
+
+/*Adds a file, or every file under a directory*/
+int add_batch_path(const char *path)
+{
+	struct dirent *de;
+	struct stat st;
+	char *child;
+	DIR *dir;
+	int ret = 0;
+
+	if(lstat(path, &st)) {
+		printf("Error reading %s\n", path);
+		return -1;
+	}
+
+	if(!S_ISDIR(st.st_mode))
+		return add_batch_file(path);
+
+	dir = opendir(path);
+	if(!dir) {
+		printf("Error opening the directory %s\n", path);
+		return -1;
+	}
+
+	while(!ret && (de = readdir(dir))) {
+		if(de->d_name[0] == '.')
+			continue;
+		child = malloc(strlen(path) + strlen(de->d_name) + 2);
+		if(!child) {
+			printf("Out of memory listing the crash logs\n");
+			ret = -1;
+			break;
+		}
+		sprintf(child, "%s/%s", path, de->d_name);
+		ret = add_batch_path(child);
+		free(child);
+	}
+
+	closedir(dir);
+	return ret;
+}
+
+/*Adds the files named in list, one per line*/
+int add_batch_list(const char *list)
+{
+	struct line_reader lr;
+	char *line;
+	int ret = 0;
+
+	memset(&lr, 0, sizeof(lr));
+	lr.fd = open(list, O_RDONLY);
+	if(lr.fd < 0) {
+		printf("Error opening the list file %s\n", list);
+		return -1;
+	}
+
+	while(!ret && (line = read_line(&lr))) {
+		if(*line)
+			ret = add_batch_file(line);
+	}
+
+	free(lr.buf);
+	close(lr.fd);
+	return ret;
+}
+
+/*"do_fork.constprop.3+0x1c/0x40" and "do_fork" are the same
+ *function on another build.
+ */
+void sig_name(char *dst, const char *name)
+{
+	snprintf(dst, SIG_NAME_LEN, "%.*s", (int)strcspn(name, ".+ "), name);
+}
+
+void sig_name_of(char *dst, unsigned long addr)
+{
+	struct sym_entry *sym = addr ? symbolizer_lookup(addr) : NULL;
+
+	sig_name(dst, sym ? sym->func : "??");
+}
+
+/*"[<c0123456>]" is looked up, an arm64 "func+0x1c/0x40" is used as it is*/
+void sig_name_text(char *dst, const char *s)
+{
+	if(!strncmp(s, "[<", 2))
+		sig_name_of(dst, strtoul(s + 2, NULL, 16));
+	else
+		sig_name(dst, s);
+}
+
+/*From the PC: and LR: dumps, there is one dump per Oops*/
+void sig_set_registers(unsigned long pc, unsigned long lr)
+{
+	if(cur_sig.dumped)
+		finish_oops_sig();
+
+	cur_sig.active = 1;
+	cur_sig.dumped = 1;
+	if(!cur_sig.pc[0])
+		sig_name_of(cur_sig.pc, pc);
+	if(!cur_sig.lr[0])
+		sig_name_of(cur_sig.lr, lr);
+}
+
+void add_to_bucket(const char *sig)
+{
+	struct bucket *b;
+	unsigned long hash = 5381;
+	const char *p;
+	int i;
+
+	for(p = sig; *p; p++)
+		hash = hash * 33 + (unsigned char)*p;
+	hash %= BUCKET_HASH_SIZE;
+
+	pthread_mutex_lock(&batch_lock);
+	nr_oopses++;
+
+	for(b = bucket_hash[hash]; b; b = b->next) {
+		if(!strcmp(b->sig, sig))
+			break;
+	}
+
+	if(!b) {
+		b = calloc(1, sizeof(struct bucket));
+		if(!b || !(b->sig = strdup(sig))) {
+			printf("Out of memory bucketing the Oopses\n");
+			free(b);
+			pthread_mutex_unlock(&batch_lock);
+			return;
+		}
+		b->first = b->last = cur_mtime;
+		b->next = bucket_hash[hash];
+		bucket_hash[hash] = b;
+		nr_buckets++;
+	}
+
+	b->count++;
+	if(cur_mtime < b->first)
+		b->first = cur_mtime;
+	if(cur_mtime > b->last)
+		b->last = cur_mtime;
+
+	/*keep the examples sorted, a file with several hits is listed once*/
+	for(i = 0; i < b->nr_examples && b->examples[i] < cur_file; i++)
+		;
+	if(i < MAX_EXAMPLES && (i == b->nr_examples || b->examples[i] != cur_file)) {
+		if(b->nr_examples < MAX_EXAMPLES)
+			b->nr_examples++;
+		memmove(&b->examples[i + 1], &b->examples[i], (b->nr_examples - i - 1) * sizeof(int));
+		b->examples[i] = cur_file;
+	}
+
+	pthread_mutex_unlock(&batch_lock);
+}
+
+/*Buckets the Oops parsed so far, if there is one*/
+void finish_oops_sig(void)
+{
+	char sig[1024];
+	int i;
+
+	if(!cur_sig.active)
+		return;
+
+	snprintf(sig, sizeof(sig), "%s|%s", cur_sig.pc[0] ? cur_sig.pc : "??",
+		cur_sig.lr[0] ? cur_sig.lr : "??");
+	for(i = 0; i < cur_sig.nr_frames; i++)
+		snprintf(sig + strlen(sig), sizeof(sig) - strlen(sig), "|%s", cur_sig.frames[i]);
+
+	add_to_bucket(sig);
+	memset(&cur_sig, 0, sizeof(cur_sig));
+}
+
+/*Picks the registers and backtrace of an Oops out of the log:
+ *"pc : [<c0123456>]    lr : [<c0123400>]    psr: 60000013"
+ *"[<c0123456>] (func+0x1c/0x40) from [<c0123400>] (...)"
+ *and on arm64, "pc : func+0x1c/0x40", "lr : ..." and the lines
+ *after "Call trace:".
+ */
+void scan_oops_sig(char *line)
+{
+	char *p, *frame;
+
+	if((p = strstr(line, "pc : "))) {
+		finish_oops_sig();
+		cur_sig.active = 1;
+		sig_name_text(cur_sig.pc, p + 5);
+		if((p = strstr(p, "lr : ")))
+			sig_name_text(cur_sig.lr, p + 5);
+	} else if(cur_sig.active && (p = strstr(line, "lr : "))) {
+		sig_name_text(cur_sig.lr, p + 5);
+	} else if(is_oops_end(line)) {
+		finish_oops_sig();
+	} else if(cur_sig.active && strstr(line, "Call trace:")) {
+		cur_sig.in_call_trace = 1;
+	} else if(cur_sig.active && cur_sig.nr_frames < SIG_FRAMES) {
+		for(frame = line; *frame == ' ' || *frame == '\t'; frame++)
+			;
+		if(!strncmp(frame, "[<", 2) && strstr(frame, ">]"))
+			sig_name_text(cur_sig.frames[cur_sig.nr_frames++], frame);
+		else if(cur_sig.in_call_trace && memmem(frame, strcspn(frame, " "), "+0x", 3))
+			sig_name_text(cur_sig.frames[cur_sig.nr_frames++], frame);
+	}
+}
+
+/*Back to the state of a fresh run, for the next file of a worker*/
+void crash_search_reset(void)
+{
+	state = STATE_SCAN;
+	in_section = 0;
+	number_of_sections = 0;
+	virtual_mem_layout_found = 0;
+	region_index_valid = 0;
+	clear_oops();
+	layout_offset = -1;
+	memset(&cur_sig, 0, sizeof(cur_sig));
+}
+
+void batch_search_file(int i)
+{
+	struct line_reader lr;
+	struct stat st;
+
+	memset(&lr, 0, sizeof(lr));
+	lr.fd = open(batch_files[i], O_RDONLY);
+	if(lr.fd < 0) {
+		printf("Error opening the input file %s\n", batch_files[i]);
+		return;
+	}
+
+	cur_file = i;
+	cur_mtime = fstat(lr.fd, &st) ? 0 : st.st_mtime;
+	if(open_decompressor(&lr, batch_files[i])) {
+		close(lr.fd);
+		return;
+	}
+	crash_search_reset();
+	crash_search_start(&lr);
+
+	close_decompressor(&lr);
+	free(lr.buf);
+	close(lr.fd);
+}
+
+void* batch_worker(void *arg)
+{
+	int i;
+
+	while(1) {
+		pthread_mutex_lock(&batch_lock);
+		i = next_batch_file++;
+		pthread_mutex_unlock(&batch_lock);
+		if(i >= nr_batch_files)
+			break;
+		batch_search_file(i);
+	}
+
+	free(token_buf);
+	free(virt_mem_layout);
+	free(region_segs);
+	free(region_seg_sections);
+	free(oops_entries);
+	return NULL;
+}
+
+int cmp_path(const void *a, const void *b)
+{
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+int cmp_bucket(const void *a, const void *b)
+{
+	const struct bucket *x = *(struct bucket* const*)a, *y = *(struct bucket* const*)b;
+
+	if(x->count != y->count)
+		return x->count < y->count ? 1 : -1;
+	return strcmp(x->sig, y->sig);
+}
+
+void print_time(time_t t)
+{
+	struct tm tm;
+	char buf[32];
+
+	localtime_r(&t, &tm);
+	strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+	printf("%s", buf);
+}
+
+/*Searches every file of the corpus and prints the bucket table,
+ *the biggest bucket first.
+ */
+int batch_search(int nr_threads)
+{
+	struct bucket **sorted, *b;
+	pthread_t *threads;
+	int i, j, n = 0;
+
+	qsort(batch_files, nr_batch_files, sizeof(char*), cmp_path);
+
+	if(nr_threads <= 0)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if(nr_threads <= 0)
+		nr_threads = 1;
+	if(nr_threads > nr_batch_files)
+		nr_threads = nr_batch_files ? nr_batch_files : 1;
+
+	threads = malloc(nr_threads * sizeof(pthread_t));
+	if(!threads) {
+		printf("Out of memory starting the threads\n");
+		return -1;
+	}
+
+	for(i = 0; i < nr_threads; i++) {
+		if(pthread_create(&threads[i], NULL, batch_worker, NULL)) {
+			printf("Error starting the thread %d\n", i);
+			break;
+		}
+	}
+	/*no thread could be started, search the files here*/
+	if(!i)
+		batch_worker(NULL);
+	for(j = 0; j < i; j++)
+		pthread_join(threads[j], NULL);
+	free(threads);
+
+	sorted = malloc((nr_buckets + 1) * sizeof(struct bucket*));
+	if(!sorted) {
+		printf("Out of memory sorting the buckets\n");
+		return -1;
+	}
+	for(i = 0; i < BUCKET_HASH_SIZE; i++) {
+		for(b = bucket_hash[i]; b; b = b->next)
+			sorted[n++] = b;
+	}
+	qsort(sorted, n, sizeof(struct bucket*), cmp_bucket);
+
+	if(output_format) {
+		if(output_format == FORMAT_CSV)
+			fprintf(output_fp, "count,first,last,signature,examples\n");
+		for(i = 0; i < n; i++)
+			write_bucket_record(sorted[i]);
+		goto out;
+	}
+
+	printf("**********Oops buckets, %d files, %lu Oopses, %d buckets***************\n",
+		nr_batch_files, nr_oopses, n);
+	printf("count,first,last,signature,examples\n");
+	for(i = 0; i < n; i++) {
+		b = sorted[i];
+		printf("%lu,", b->count);
+		print_time(b->first);
+		printf(",");
+		print_time(b->last);
+		printf(",%s,", b->sig);
+		for(j = 0; j < b->nr_examples; j++)
+			printf("%s%s", j ? " " : "", batch_files[b->examples[j]]);
+		printf("\n");
+	}
+	printf("******************************END**************************************\n");
+	fflush(stdout);
+
+out:
+	for(i = 0; i < n; i++) {
+		free(sorted[i]->sig);
+		free(sorted[i]);
+	}
+	free(sorted);
+	for(i = 0; i < nr_batch_files; i++)
+		free(batch_files[i]);
+	free(batch_files);
+
+	return 0;
+}
+
+
+/*************************** index ***************************/
+
+#define INDEX_VERSION 1
+
+/*Text file with one line per Oops ("O") or layout block ("L"):
+ *	crash_search index 1 <size of the log> <mtime of the log>
+ *	L <offset>
+ *	O <offset> <time> <offset of its layout> <pc> <function>
+ *It is rebuilt when the log changes.
+ */
+struct index_entry {
+	char type;
+	off_t offset;
+	double time;
+	off_t layout;
+	unsigned long pc;
+	char *symbol;
+};
+
+struct index_entry *index_entries;
+int nr_index_entries, index_entries_size;
+
+struct index_entry* new_index_entry(char type)
+{
+	struct index_entry *tmp;
+
+	if(nr_index_entries == index_entries_size) {
+		index_entries_size = index_entries_size ? index_entries_size * 2 : 256;
+		tmp = realloc(index_entries, index_entries_size * sizeof(struct index_entry));
+		if(!tmp) {
+			printf("Out of memory indexing the input file\n");
+			indexing = 0;
+			return NULL;
+		}
+		index_entries = tmp;
+	}
+
+	memset(&index_entries[nr_index_entries], 0, sizeof(struct index_entry));
+	index_entries[nr_index_entries].type = type;
+	index_entries[nr_index_entries].layout = -1;
+	return &index_entries[nr_index_entries++];
+}
+
+void index_add_layout(void)
+{
+	struct index_entry *e = new_index_entry('L');
+
+	if(e)
+		e->offset = layout_offset;
+}
+
+void index_add_oops(void)
+{
+	struct index_entry *e;
+	struct sym_entry *sym;
+	int i;
+
+	if(!(e = new_index_entry('O')))
+		return;
+	e->offset = oops_start_offset;
+	e->time = oops_start_time;
+	e->layout = layout_offset;
+
+	for(i = 0; i < nr_oops_entries; i++) {
+		if(oops_entries[i].type == OOPS_HEADER && !strcasecmp(oops_entries[i].name, "PC:")) {
+			e->pc = oops_entries[i].val;
+			break;
+		}
+	}
+
+	sym = e->pc ? symbolizer_lookup(e->pc) : NULL;
+	e->symbol = strdup(sym ? sym->func : "??");
+}
+
+void index_path(char *path, size_t size)
+{
+	snprintf(path, size, "%s.idx", input_file);
+}
+
+/*Loads the index of the input file. Returns -1 if there is
+ *none, or it is of another version of the file.
+ */
+int load_index(int fd)
+{
+	struct index_entry *e;
+	struct stat st;
+	char path[4096], buf[4096], symbol[1024];
+	long long size, mtime, offset, layout;
+	double t;
+	unsigned long pc;
+	int version;
+	FILE *fp;
+
+	index_path(path, sizeof(path));
+	if(fstat(fd, &st) || !S_ISREG(st.st_mode) || !(fp = fopen(path, "r")))
+		return -1;
+
+	if(!fgets(buf, sizeof(buf), fp) ||
+		sscanf(buf, "crash_search index %d %lld %lld", &version, &size, &mtime) != 3 ||
+		version != INDEX_VERSION || size != (long long)st.st_size || mtime != (long long)st.st_mtime) {
+		fclose(fp);
+		return -1;
+	}
+
+	while(fgets(buf, sizeof(buf), fp)) {
+		if(buf[0] == 'L' && sscanf(buf, "L %lld", &offset) == 1) {
+			if(!(e = new_index_entry('L')))
+				break;
+			e->offset = offset;
+		} else if(buf[0] == 'O' &&
+			sscanf(buf, "O %lld %lf %lld %lx %1023s", &offset, &t, &layout, &pc, symbol) == 5) {
+			if(!(e = new_index_entry('O')))
+				break;
+			e->offset = offset;
+			e->time = t;
+			e->layout = layout;
+			e->pc = pc;
+			e->symbol = strdup(symbol);
+		}
+	}
+
+	fclose(fp);
+	return 0;
+}
+
+/*Writes the index next to the input file, if the directory allows it*/
+int save_index(int fd)
+{
+	struct index_entry *e;
+	struct stat st;
+	char path[4096], tmp_path[4200];
+	FILE *fp;
+	int i;
+
+	index_path(path, sizeof(path));
+	snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, (int)getpid());
+	if(fstat(fd, &st) || !S_ISREG(st.st_mode) || !(fp = fopen(tmp_path, "w")))
+		return -1;
+
+	fprintf(fp, "crash_search index %d %lld %lld\n", INDEX_VERSION,
+		(long long)st.st_size, (long long)st.st_mtime);
+	for(i = 0; i < nr_index_entries; i++) {
+		e = &index_entries[i];
+		if(e->type == 'L')
+			fprintf(fp, "L %lld\n", (long long)e->offset);
+		else
+			fprintf(fp, "O %lld %f %lld %lx %s\n", (long long)e->offset, e->time,
+				(long long)e->layout, e->pc, e->symbol);
+	}
+
+	if(fclose(fp)) {
+		unlink(tmp_path);
+		return -1;
+	}
+	rename(tmp_path, path);
+	return 0;
+}
+
+void line_reader_seek(struct line_reader *lr, off_t offset)
+{
+	lseek(lr->fd, offset, SEEK_SET);
+	lr->start = lr->end = 0;
+	lr->eof = 0;
+	lr->base = offset;
+}
+
+/*Parses the lines from offset till the state machine has flushed
+ *an Oops, or for a layout block, till the layout ends.
+ */
+int search_from(struct line_reader *lr, off_t offset, int layout)
+{
+	unsigned long flushed = nr_flushed;
+	char *line;
+
+	line_reader_seek(lr, offset);
+	while((line = read_line(lr))) {
+		cur_line_offset = lr->line_offset;
+		if(crash_search_line(line) < 0)
+			return -1;
+		if(layout ? state != STATE_LAYOUT : nr_flushed != flushed)
+			return 0;
+	}
+
+	finish_input();
+	return 0;
+}
+
+/*Prints the Oopses that match, each with the layout before it.
+ *A number of 0, a negative from or to or a NULL symbol match
+ *anything, so without -t the Oopses without a time stamp match too.
+ */
+int search_indexed(struct line_reader *lr, long number, double from, double to, const char *symbol)
+{
+	struct index_entry *e;
+	off_t layout_done = -1;
+	long n = 0;
+	int i;
+
+	for(i = 0; i < nr_index_entries; i++) {
+		e = &index_entries[i];
+		if(e->type != 'O')
+			continue;
+		n++;
+
+		if((number && n != number) || (from >= 0 && e->time < from) || (to >= 0 && e->time > to) ||
+			(symbol && strcmp(symbol, e->symbol)))
+			continue;
+
+		if(e->layout != layout_done) {
+			crash_search_reset();
+			if(e->layout >= 0 && search_from(lr, e->layout, 1) < 0)
+				return -1;
+			layout_done = e->layout;
+		}
+
+		if(!output_format)
+			printf("**********Oops %ld at byte %lld***************\n", n, (long long)e->offset);
+		/*so that the record has the number of the Oops in the log*/
+		nr_flushed = n - 1;
+		state = STATE_SCAN;
+		if(search_from(lr, e->offset, 0) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+
+/*************************** follow mode ***************************/
+
+char **follow_files;
+int nr_follow_files, follow_files_size;
+
+int add_follow_file(const char *path)
+{
+	char **tmp;
+
+	if(nr_follow_files == follow_files_size) {
+		follow_files_size = follow_files_size ? follow_files_size * 2 : 16;
+		tmp = realloc(follow_files, follow_files_size * sizeof(char*));
+		if(!tmp) {
+			printf("Out of memory listing the inputs\n");
+			return -1;
+		}
+		follow_files = tmp;
+	}
+
+	follow_files[nr_follow_files++] = (char*)path;
+	return 0;
+}
+
+/*The followed input has been quiet for FOLLOW_IDLE_MS*/
+void follow_idle(void)
+{
+	/*the device may never print the line that ends the Oops*/
+	if(state == STATE_OOPS || state == STATE_REGS64 || state == STATE_CALL_TRACE) {
+		flush_oops();
+		state = STATE_SCAN;
+	}
+}
+
+void* follow_worker(void *arg)
+{
+	const char *path = arg;
+	struct line_reader lr;
+	struct stat st;
+	long ret = 0;
+
+	memset(&lr, 0, sizeof(lr));
+	lr.follow = 1;
+	lr.notify_fd = -1;
+	if(nr_follow_files > 1)
+		output_label = path;
+
+	if(!strcmp(path, "-"))
+		lr.fd = STDIN_FILENO;
+	else
+		lr.fd = open(path, O_RDONLY);
+	if(lr.fd < 0 || fstat(lr.fd, &st)) {
+		printf("Error opening the input file %s\n", path);
+		return (void*)-1L;
+	}
+
+	/*a file is waited for with inotify, anything else with poll*/
+	if(S_ISREG(st.st_mode)) {
+		lr.notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if(lr.notify_fd < 0 || inotify_add_watch(lr.notify_fd,
+			lr.fd == STDIN_FILENO ? "/proc/self/fd/0" : path, IN_MODIFY) < 0) {
+			printf("Error watching the input file %s\n", path);
+			ret = -1;
+			goto out;
+		}
+	} else
+		fcntl(lr.fd, F_SETFL, fcntl(lr.fd, F_GETFL) | O_NONBLOCK);
+
+	input_name = path;
+	if(crash_search_start(&lr) < 0)
+		ret = -1;
+
+out:
+	if(lr.notify_fd >= 0)
+		close(lr.notify_fd);
+	if(lr.fd != STDIN_FILENO)
+		close(lr.fd);
+	free(lr.buf);
+	free(token_buf);
+	free(virt_mem_layout);
+	free(region_segs);
+	free(region_seg_sections);
+	free(oops_entries);
+	return (void*)ret;
+}
+
+/*Follows every input on a thread of its own, till all of them end.
+ *Only pipes end, files are followed till the tool is stopped.
+ */
+int follow_search(void)
+{
+	pthread_t *threads;
+	void *thread_ret;
+	int i, n, ret = 0;
+
+	threads = malloc(nr_follow_files * sizeof(pthread_t));
+	if(!threads) {
+		printf("Out of memory starting the threads\n");
+		return -1;
+	}
+
+	for(n = 0; n < nr_follow_files; n++) {
+		if(pthread_create(&threads[n], NULL, follow_worker, follow_files[n])) {
+			printf("Error following %s\n", follow_files[n]);
+			ret = -1;
+			break;
+		}
+	}
+
+	for(i = 0; i < n; i++) {
+		pthread_join(threads[i], &thread_ret);
+		if(thread_ret)
+			ret = -1;
+	}
+
+	free(threads);
+	free(follow_files);
+	return ret;
+}
+
+
+/*************************** compressed input ***************************/
+
+#define DECOMPRESS_BUF_SIZE (256 << 10)
+
+enum compression {
+	COMPRESSION_NONE,
+	COMPRESSION_GZIP,
+	COMPRESSION_ZSTD,
+};
+
+struct decompressor {
+	enum compression type;
+	const char *path;
+	int in_fd;	/*the compressed input*/
+	int out_fd;	/*write end of the pipe*/
+	unsigned char magic[4];	/*already read from in_fd*/
+	int nr_magic;
+	pthread_t thread;
+};
+
+/*Writes everything, returns -1 once the reader has gone*/
+int write_all(int fd, const unsigned char *buf, size_t len)
+{
+	ssize_t ret;
+
+	while(len) {
+		ret = write(fd, buf, len);
+		if(ret < 0) {
+			if(errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+/*Reads the next block of the compressed input, the magic first*/
+ssize_t read_compressed(struct decompressor *d, unsigned char *buf, size_t size)
+{
+	ssize_t ret;
+
+	if(d->nr_magic) {
+		memcpy(buf, d->magic, d->nr_magic);
+		ret = d->nr_magic;
+		d->nr_magic = 0;
+		return ret;
+	}
+
+	do {
+		ret = read(d->in_fd, buf, size);
+	} while(ret < 0 && errno == EINTR);
+
+	return ret;
+}
+
+/*Returns 0 at the end of the input, -1 on an error*/
+int gunzip(struct decompressor *d, unsigned char *in, unsigned char *out)
+{
+	z_stream zs;
+	ssize_t len;
+	int ret = Z_OK;
+
+	memset(&zs, 0, sizeof(zs));
+	/*32 detects the gzip header*/
+	if(inflateInit2(&zs, 15 + 32) != Z_OK)
+		return -1;
+
+	while(1) {
+		if(!zs.avail_in) {
+			len = read_compressed(d, in, DECOMPRESS_BUF_SIZE);
+			if(len <= 0)
+				break;
+			zs.next_in = in;
+			zs.avail_in = len;
+		}
+
+		zs.next_out = out;
+		zs.avail_out = DECOMPRESS_BUF_SIZE;
+		ret = inflate(&zs, Z_NO_FLUSH);
+		if(ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+			break;
+		if(write_all(d->out_fd, out, DECOMPRESS_BUF_SIZE - zs.avail_out))
+			break;
+
+		/*"cat a.gz b.gz" is a valid gzip file*/
+		if(ret == Z_STREAM_END)
+			inflateReset(&zs);
+	}
+
+	inflateEnd(&zs);
+	return ret == Z_STREAM_END ? 0 : -1;
+}
+
+#ifdef HAVE_ZSTD
+int unzstd(struct decompressor *d, unsigned char *in, unsigned char *out)
+{
+	ZSTD_DStream *zs;
+	ZSTD_inBuffer zin;
+	ZSTD_outBuffer zout;
+	ssize_t len;
+	size_t ret = 0;
+
+	zs = ZSTD_createDStream();
+	if(!zs)
+		return -1;
+	ZSTD_initDStream(zs);
+
+	while((len = read_compressed(d, in, DECOMPRESS_BUF_SIZE)) > 0) {
+		zin.src = in;
+		zin.size = len;
+		zin.pos = 0;
+		while(zin.pos < zin.size) {
+			zout.dst = out;
+			zout.size = DECOMPRESS_BUF_SIZE;
+			zout.pos = 0;
+			ret = ZSTD_decompressStream(zs, &zout, &zin);
+			if(ZSTD_isError(ret) || write_all(d->out_fd, out, zout.pos)) {
+				ZSTD_freeDStream(zs);
+				return -1;
+			}
+		}
+	}
+
+	ZSTD_freeDStream(zs);
+	/*non zero if the last frame was cut short*/
+	return len < 0 || ret ? -1 : 0;
+}
+#endif
+
+void* decompress_worker(void *arg)
+{
+	struct decompressor *d = arg;
+	unsigned char *in, *out;
+	int ret = -1;
+
+	in = malloc(DECOMPRESS_BUF_SIZE);
+	out = malloc(DECOMPRESS_BUF_SIZE);
+	if(in && out) {
+		if(d->type == COMPRESSION_GZIP)
+			ret = gunzip(d, in, out);
+#ifdef HAVE_ZSTD
+		else
+			ret = unzstd(d, in, out);
+#endif
+	}
+	if(ret)
+		printf("Error decompressing the input file %s\n", d->path);
+
+	/*the reader sees the end of the input*/
+	close(d->out_fd);
+	free(in);
+	free(out);
+	return NULL;
+}
+
+/*Looks at the first bytes of the input. A compressed input is
+ *decompressed on a thread into a pipe, which becomes lr->fd. The
+ *bytes of any other input are just handed to the line reader.
+ */
+int open_decompressor(struct line_reader *lr, const char *path)
+{
+	struct decompressor *d;
+	unsigned char magic[4];
+	ssize_t ret;
+	int len = 0, fds[2];
+	enum compression type = COMPRESSION_NONE;
+
+	while(len < 4) {
+		ret = read(lr->fd, magic + len, 4 - len);
+		if(ret < 0 && errno == EINTR)
+			continue;
+		if(ret <= 0)
+			break;
+		len += ret;
+	}
+
+	if(len >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+		type = COMPRESSION_GZIP;
+	else if(len == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+		type = COMPRESSION_ZSTD;
+
+	if(type == COMPRESSION_NONE) {
+		lr->buf = malloc(LINE_READER_BUF_SIZE);
+		if(!lr->buf) {
+			printf("Out of memory reading the input file\n");
+			return -1;
+		}
+		lr->size = LINE_READER_BUF_SIZE;
+		memcpy(lr->buf, magic, len);
+		lr->end = len;
+		return 0;
+	}
+
+#ifndef HAVE_ZSTD
+	if(type == COMPRESSION_ZSTD) {
+		printf("%s is zstd compressed, build with -DHAVE_ZSTD -lzstd to read it\n", path);
+		return -1;
+	}
+#endif
+
+	d = calloc(1, sizeof(struct decompressor));
+	if(!d || pipe(fds)) {
+		printf("Error setting up the decompression of %s\n", path);
+		free(d);
+		return -1;
+	}
+	d->type = type;
+	d->path = path;
+	d->in_fd = lr->fd;
+	d->out_fd = fds[1];
+	memcpy(d->magic, magic, len);
+	d->nr_magic = len;
+
+	if(pthread_create(&d->thread, NULL, decompress_worker, d)) {
+		printf("Error setting up the decompression of %s\n", path);
+		close(fds[0]);
+		close(fds[1]);
+		free(d);
+		return -1;
+	}
+
+	lr->fd = fds[0];
+	lr->dec = d;
+	return 0;
+}
+
+/*Stops the decompressor, lr->fd is the compressed input again*/
+void close_decompressor(struct line_reader *lr)
+{
+	struct decompressor *d = lr->dec;
+
+	if(!d)
+		return;
+
+	/*a decompressor still writing fails with EPIPE and ends*/
+	close(lr->fd);
+	pthread_join(d->thread, NULL);
+	lr->fd = d->in_fd;
+	lr->dec = NULL;
+	free(d);
+}
+
+
+/*************************** structured output ***************************/
+
+/*What is known about one entry of an Oops, empty strings if nothing*/
+struct entry_info {
+	char value[24];
+	char symbol[300];
+	const char *source;
+	char regions[128];
+	char data[300];
+};
+
+void describe_entry(struct oops_entry *e, struct entry_info *info)
+{
+	struct sym_entry *sym;
+	const char *name;
+	unsigned long offset;
+	int *sections;
+	int i, count, len = 0;
+
+	memset(info, 0, sizeof(*info));
+	info->source = "";
+
+	if(e->type == OOPS_WORD || e->type == OOPS_REG)
+		snprintf(info->value, sizeof(info->value), "0x%s", e->text);
+	else if(e->valid)
+		snprintf(info->value, sizeof(info->value), "0x%lx", e->val);
+	if(!e->valid)
+		return;
+
+	if(needs_symbol(e) && (sym = symbolizer_lookup(e->val)) && strcmp(sym->func, "??")) {
+		snprintf(info->symbol, sizeof(info->symbol), "%s+0x%lx", sym->func, sym->offset);
+		info->source = sym->file_line;
+	}
+
+	if((e->type != OOPS_WORD && e->type != OOPS_REG) || !virtual_mem_layout_found)
+		return;
+
+	count = classify_address(e->val, &sections);
+	for(i = 0; i < count; i++) {
+		len += snprintf(info->regions + len, sizeof(info->regions) - len, "%s%s",
+			i ? " " : "", virt_mem_layout[sections[i]].name);
+		if(len >= (int)sizeof(info->regions))
+			len = sizeof(info->regions) - 1;
+		if(!is_text_section(sections[i]) && !info->data[0] &&
+			(name = symbolizer_data(e->val, &offset)))
+			snprintf(info->data, sizeof(info->data), "%s+0x%lx", name, offset);
+	}
+}
+
+void json_string(const char *s)
+{
+	fputc('"', output_fp);
+	for(; *s; s++) {
+		if(*s == '"' || *s == '\\')
+			fprintf(output_fp, "\\%c", *s);
+		else if((unsigned char)*s < 0x20)
+			fprintf(output_fp, "\\u%04x", *s);
+		else
+			fputc(*s, output_fp);
+	}
+	fputc('"', output_fp);
+}
+
+/*,"key":"value", left out when the value is empty*/
+void json_field(const char *key, const char *value)
+{
+	if(!value || !*value)
+		return;
+	fprintf(output_fp, ",\"%s\":", key);
+	json_string(value);
+}
+
+void json_entry(struct oops_entry *e, struct entry_info *info)
+{
+	fprintf(output_fp, "{");
+	switch(e->type) {
+	case OOPS_WORD:
+		fprintf(output_fp, "\"offset\":\"0x%lx\"", e->offset);
+		break;
+	case OOPS_REG:
+		fprintf(output_fp, "\"name\":");
+		json_string(e->name);
+		break;
+	default:
+		fprintf(output_fp, "\"text\":");
+		json_string(e->desc ? e->desc : e->text);
+		break;
+	}
+	json_field("value", info->value);
+	json_field("symbol", info->symbol);
+	json_field("source", info->source);
+	json_field("regions", info->regions);
+	json_field("data", info->data);
+	fprintf(output_fp, "}");
+}
+
+/*{"file":..., "oops":2, "time":12.5, "offset":4096, "arch":"arm64",
+ * "registers":[...], "sections":[{"name":"PC:", ..., "words":[...]}],
+ * "call_trace":[...]}
+ */
+void write_json_oops(void)
+{
+	struct entry_info info;
+	struct oops_entry *e;
+	int i, n, in_words = 0;
+
+	fprintf(output_fp, "{\"file\":");
+	json_string(input_name ? input_name : "-");
+	fprintf(output_fp, ",\"oops\":%lu", nr_flushed);
+	if(oops_start_time >= 0)
+		fprintf(output_fp, ",\"time\":%f", oops_start_time);
+	fprintf(output_fp, ",\"offset\":%lld,\"arch\":\"%s\"", (long long)oops_start_offset,
+		oops_is_arm64 ? "arm64" : "arm");
+
+	/*the registers are the arm64 pc and lr lines and x0-x30*/
+	fprintf(output_fp, ",\"registers\":[");
+	for(i = 0, n = 0; i < nr_oops_entries; i++) {
+		e = &oops_entries[i];
+		if(e->type == OOPS_REG || (e->type == OOPS_HEADER && e->desc)) {
+			describe_entry(e, &info);
+			if(n++)
+				fprintf(output_fp, ",");
+			if(e->type == OOPS_HEADER) {
+				fprintf(output_fp, "{\"name\":\"%.2s\",\"text\":", e->name);
+				json_string(e->desc);
+				json_field("value", info.value);
+				json_field("symbol", info.symbol);
+				json_field("source", info.source);
+				fprintf(output_fp, "}");
+			} else
+				json_entry(e, &info);
+		}
+	}
+
+	fprintf(output_fp, "],\"sections\":[");
+	for(i = 0, n = 0; i < nr_oops_entries; i++) {
+		e = &oops_entries[i];
+		if(e->type == OOPS_HEADER && !e->desc) {
+			describe_entry(e, &info);
+			if(in_words)
+				fprintf(output_fp, "]}");
+			if(n++)
+				fprintf(output_fp, ",");
+			fprintf(output_fp, "{\"name\":");
+			json_string(e->name);
+			json_field("value", info.value);
+			json_field("symbol", info.symbol);
+			json_field("source", info.source);
+			fprintf(output_fp, ",\"words\":[");
+			in_words = 1;
+		} else if(e->type == OOPS_WORD && in_words) {
+			describe_entry(e, &info);
+			if(e[-1].type == OOPS_WORD)
+				fprintf(output_fp, ",");
+			json_entry(e, &info);
+		}
+	}
+	if(in_words)
+		fprintf(output_fp, "]}");
+
+	fprintf(output_fp, "],\"call_trace\":[");
+	for(i = 0, n = 0; i < nr_oops_entries; i++) {
+		e = &oops_entries[i];
+		if(e->type == OOPS_FRAME) {
+			describe_entry(e, &info);
+			if(n++)
+				fprintf(output_fp, ",");
+			json_entry(e, &info);
+		}
+	}
+	fprintf(output_fp, "]}\n");
+}
+
+/*Writes s quoted if it has to be, after a comma unless it is the first field*/
+void csv_field(const char *s, int first)
+{
+	if(!first)
+		fputc(',', output_fp);
+	if(!strpbrk(s, ",\"\n")) {
+		fputs(s, output_fp);
+		return;
+	}
+
+	fputc('"', output_fp);
+	for(; *s; s++) {
+		if(*s == '"')
+			fputc('"', output_fp);
+		fputc(*s, output_fp);
+	}
+	fputc('"', output_fp);
+}
+
+/*file,oops,time,kind,name,offset,value,symbol,source,regions,data
+ *with one row per register, dump section, word and frame
+ */
+void write_csv_oops(void)
+{
+	static const char *kinds[] = { "section", "word", "register", "frame" };
+	struct entry_info info;
+	struct oops_entry *e;
+	const char *section = "", *kind, *name;
+	char offset[24], time[32], oops[24], reg[3];
+	int i;
+
+	for(i = 0; i < nr_oops_entries; i++) {
+		e = &oops_entries[i];
+		describe_entry(e, &info);
+
+		kind = kinds[e->type];
+		name = e->name;
+		offset[0] = '\0';
+		if(e->type == OOPS_HEADER && e->desc) {
+			/*"pc:" is the pc register*/
+			kind = "register";
+			snprintf(reg, sizeof(reg), "%.2s", e->name);
+			name = reg;
+		} else if(e->type == OOPS_HEADER)
+			section = e->name;
+		else if(e->type == OOPS_WORD) {
+			name = section;
+			snprintf(offset, sizeof(offset), "0x%lx", e->offset);
+		} else if(e->type == OOPS_FRAME)
+			name = e->desc;
+
+		snprintf(oops, sizeof(oops), "%lu", nr_flushed);
+		time[0] = '\0';
+		if(oops_start_time >= 0)
+			snprintf(time, sizeof(time), "%f", oops_start_time);
+
+		csv_field(input_name ? input_name : "-", 1);
+		csv_field(oops, 0);
+		csv_field(time, 0);
+		csv_field(kind, 0);
+		csv_field(name, 0);
+		csv_field(offset, 0);
+		csv_field(info.value, 0);
+		csv_field(info.symbol, 0);
+		csv_field(info.source, 0);
+		csv_field(info.regions, 0);
+		csv_field(info.data, 0);
+		fputc('\n', output_fp);
+	}
+}
+
+void write_oops_record(void)
+{
+	if(output_format == FORMAT_JSON)
+		write_json_oops();
+	else
+		write_csv_oops();
+}
+
+void write_bucket_record(struct bucket *b)
+{
+	char first[32], last[32], examples[4096];
+	struct tm tm;
+	int i, len = 0;
+
+	localtime_r(&b->first, &tm);
+	strftime(first, sizeof(first), "%Y-%m-%d %H:%M:%S", &tm);
+	localtime_r(&b->last, &tm);
+	strftime(last, sizeof(last), "%Y-%m-%d %H:%M:%S", &tm);
+
+	if(output_format == FORMAT_CSV) {
+		examples[0] = '\0';
+		for(i = 0; i < b->nr_examples && len < (int)sizeof(examples); i++)
+			len += snprintf(examples + len, sizeof(examples) - len, "%s%s",
+				i ? " " : "", batch_files[b->examples[i]]);
+		fprintf(output_fp, "%lu,%s,%s", b->count, first, last);
+		csv_field(b->sig, 0);
+		csv_field(examples, 0);
+		fputc('\n', output_fp);
+		return;
+	}
+
+	fprintf(output_fp, "{\"count\":%lu,\"first\":\"%s\",\"last\":\"%s\",\"signature\":", b->count, first, last);
+	json_string(b->sig);
+	fprintf(output_fp, ",\"examples\":[");
+	for(i = 0; i < b->nr_examples; i++) {
+		if(i)
+			fprintf(output_fp, ",");
+		json_string(batch_files[b->examples[i]]);
+	}
+	fprintf(output_fp, "]}\n");
+}
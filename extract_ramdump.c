@@ -1,17 +1,28 @@
 /*
  * Ramdump extractor.
  * Generates debug information if binary RAM image
- * and System.map is given as input.
+ * and System.map is given as input. The image is mapped
+ * once and the extractors run in parallel on a pool of
+ * threads; the shell, daemon, diff, batch, cache and bench
+ * modes are listed by -h and described in README.md.
+ *	gcc -o extract_ramdump extract_ramdump.c -lws2_32
  * Author: Vinayak Menon <vinayakm.list@gmail.com>
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <getopt.h>
+#include <io.h>
+#include <winsock2.h>
+#include <afunix.h>
 #include <windows.h>
 
 
 #define VERSION "1.1"
 
+#define BATCH_BUDGET (256ULL << 20)	/*of a ramdump mapped at once with -B*/
+
 /*****FOR MEMINFO********/
 
 enum zone_stat_item {
@@ -122,7 +133,9 @@ enum lru_list {
 
 struct mm_rss_stat {
         unsigned long count[NR_MM_COUNTERS];
-} mm_rss;
+};
+
+__thread struct mm_rss_stat mm_rss;
 
 unsigned char* task_state[] = {
          "TASK_RUNNING",
@@ -135,13 +148,62 @@ unsigned char* task_state[] = {
          "TASK_WAKING"
 };
 
-FILE* ramdump_fp;
-FILE* systemmap_fp;
-FILE* output_fp;
-FILE* output_stack_fp;
+/*System.map, read once into memory with a hash on the names*/
+struct smap_sym {
+	unsigned int address;
+	char* name;
+	int mapping;	/*an ARM mapping symbol ($a, $d, $t) is on the line*/
+};
+
+/*A System.map, shared by the dumps of one kernel build*/
+struct smap {
+	const char* path;
+	struct smap_sym* syms;
+	unsigned int nr_syms;
+	unsigned int* hash;
+	unsigned int hash_size;
+	char* text;
+	int loaded;	/*1 once read, -1 if it could not be*/
+	CRITICAL_SECTION lock;
+	unsigned int* by_addr;	/*indices of syms in address order*/
+	unsigned int nr_by_addr;
+};
+
+/*A ramdump. The image is mapped read only once and shared by all
+ *the extractors. If it is larger than budget, only a window of it
+ *is mapped at a time, and if it cannot be mapped it is read through
+ *fp. Both of these take one reader at a time.
+ */
+struct ramdump {
+	const char* path;
+	struct smap* smap;
+	unsigned char* image;
+	unsigned long long size;
+	HANDLE file, mapping;
+	FILE* fp;
+	CRITICAL_SECTION lock;
+	unsigned long long budget;
+	unsigned char* view;
+	unsigned long long view_start, view_size;
+};
+
+/*The dump of -r and -m, and the one the readers of this thread use.
+ *Only -D and -B read others.
+ */
+struct smap main_smap;
+struct ramdump main_dump = {NULL, &main_smap};
+__thread struct ramdump* cur_dump = &main_dump;
+
+/*Every extractor runs on a thread of the pool and writes its own files*/
+__thread FILE* output_fp;
+__thread FILE* output_stack_fp;
+
+/*Set when the files of a run go to a directory of their own*/
+__thread const char* output_dir;
+
+/*The directory of the -C cache for this dump and System.map*/
+char cache_entry[MAX_PATH];
 
-unsigned char* ramdump_file_path;
-unsigned char* systemmap_file_path;
 unsigned char* output_file_path = "./task.txt";
 unsigned char* output_irq_file_path = "./irq_desc.txt";
 unsigned char* output_meminfo_file_path = "./meminfo.txt";
@@ -149,9 +211,11 @@ unsigned char* output_smap_pgtbl_file_path = "./page_table_system_map.txt";
 unsigned char* output_virt_layout_file_path = "./kernel_virtual_memory_layout.txt";
 unsigned char* output_cache_chain_file_path = "./slabinfo_and_cache_chain.txt";
 unsigned char* output_search_result_file_path = "./search_val.txt";
+unsigned char* output_kernel_log_file_path = "./kernel_log.txt";
 
 int Display_thread(unsigned int address);
 int Extract_meminfo(void);
+int Write_meminfo(void);
 int Extract_virt_mem_layout(void);
 int Extract_smap_pgtbl(void);
 unsigned int do_pg_tbl_wlkthr_logical(unsigned int address);
@@ -164,6 +228,73 @@ int Extract_pagetypeinfo(void);
 int Extract_buddyinfo(void);
 int Extract_zoneinfo(void);
 int Extract_node_uma(void);
+int Extract_irq_desc(void);
+int Extract_kernel_log(FILE* log_fp);
+int Extract_tasks(void);
+int Extract_kernel_log_file(void);
+int run_extractors(int nr_threads);
+int shell(FILE* fp, int depth);
+int run_daemon(const char* path, int nr_threads);
+int run_client(const char* path);
+int run_diff(const char* path, const char* smap_path);
+int run_batch(const char* dir, int nr_threads, unsigned long long budget);
+int open_cache(const char* dir, int nr_threads);
+int run_bench(const char* path);
+void snap_vm_stat(const void* vm_buf);
+void snap_cache(const char* name, unsigned long active_objs, unsigned long num_objs, unsigned int size);
+void snap_task(int pid, const char* comm, unsigned long rss);
+void snap_buddy(int order, unsigned int nr_free);
+void snap_pagetype(int type, int order, unsigned int count);
+
+/*What an extractor did, counted by the readers of its thread*/
+struct stats {
+	unsigned long long reads;
+	unsigned long long bytes;
+	unsigned long long walks;	/*page table walks*/
+	unsigned long long lookups;	/*System.map lookups*/
+	unsigned long long remaps;	/*moves of the window of a dump over budget*/
+	LARGE_INTEGER start, end;
+	DWORD thread;
+};
+
+__thread struct stats* cur_stats;
+
+/*The extractors of a full run, run in parallel by a pool of threads.
+ *key is the name --only and --skip know them by. version goes in the
+ *key of the -C cache: bump it when the offsets or the output of an
+ *extractor change, and only that one is extracted again.
+ */
+struct extractor {
+	const char* key;
+	const char* name;
+	int (*extract)(void);
+	int version;
+	int skip;
+	int ret;
+	int cached;
+	struct stats stats;
+};
+
+struct extractor extractors[] = {
+	{"tasks", "tasks", Extract_tasks, 1},
+	{"pgtbl", "smap pgtbl", Extract_smap_pgtbl, 1},
+	{"slab", "cache chain", Decode_cache_chain_and_slab_info, 1},
+	{"irq", "irq desc", Extract_irq_desc, 1},
+	{"meminfo", "meminfo", Extract_meminfo, 1},
+	{"layout", "virt kern mem layout", Extract_virt_mem_layout, 1},
+	{"node", "uma node", Extract_node_uma, 1},
+	{"zones", "zone info", Extract_zoneinfo, 1},
+	{"buddy", "buddy info", Extract_buddyinfo, 1},
+	{"pagetype", "pagetype info", Extract_pagetypeinfo, 1},
+	{"klog", "kernel log", Extract_kernel_log_file, 1},
+};
+
+#define NR_EXTRACTORS (sizeof(extractors) / sizeof(extractors[0]))
+
+int run_cached(struct extractor* e);
+
+volatile LONG next_extractor;
+LARGE_INTEGER run_start, run_end;
 
 void show_help(void)
 {
@@ -171,184 +302,408 @@ void show_help(void)
         printf("Usage: extract_ramdump -r [path to ramdump file] -m [path to system map file] -o [path to output file]\n");
         printf("The output files will generated in the path given to -o\n");
         printf("To create System.map from vmlinux, do \"nm -n vmlinux | grep -v '\\( [aNUw] \\)\\|\\(__crc_\\)\\|\\( \\$[adt]\\)'\"\n");
-        printf("options: r,m,v,a,s,o,h\n");
+        printf("options: r,m,v,a,s,k,o,j,i,d,c,D,M,B,b,C,h\n");
         printf("r : path to the ramdump file\n");
         printf("m : path to the system map file\n");
         printf("o : path to the output folder\n");
         printf("v : Along with r and m options, use -v, to validate sections (text,bss,data)\n");
         printf("a : Along with options r and m, a [virt addr], displays the physical address with all attributes\n");
         printf("s : searches for the word provided as argument, in the ramdump, and outputs the location in search_val.txt\n");
+        printf("k : writes the kernel log buffer to stdout, to be piped to \"crash_search -i -\"\n");
+        printf("j : number of threads running the extractors, the number of CPUs by default\n");
+        printf("i : interactive shell over the loaded dump, commands from stdin, try help\n");
+        printf("d : serve the shell commands on this Unix domain socket, with j threads\n");
+        printf("c : send the commands on stdin to the daemon on this socket\n");
+        printf("D : a later ramdump, compared with the one of r in diff.txt, with the files of each under before and after\n");
+        printf("M : the system map file of the D ramdump, the one of m by default\n");
+        printf("B : every ramdump of this folder, with the .map of the same name or System.map, j at once, summed up in batch_summary.txt\n");
+        printf("b : the most of a ramdump mapped at once, in MB, %llu by default with B\n", BATCH_BUDGET >> 20);
+        printf("C : cache folder, the output of an extractor is reused when the dump, system map and extractor are unchanged\n");
+        printf("--only [list] : run only these extractors, e.g. --only meminfo,zones\n");
+        printf("--skip [list] : run all the extractors but these\n");
+        printf("    tasks, irq, meminfo, layout, pgtbl, slab, node, zones, buddy, pagetype, klog\n");
+        printf("--stats : time, reads, page table walks and symbol lookups of every extractor\n");
+        printf("--trace [file] : the same as a Chrome trace, for chrome://tracing\n");
+        printf("--bench [file] : ns/op and GB/s of reads, symbol lookups, page table walks, list walks\n");
+        printf("    and search, and the time of each extractor alone, as JSON to compare builds\n");
         printf("h : help\n");
         fflush(stdout);
 }
 
-int read_char_from_ramdump(FILE *ramdump_fp, unsigned int phy_offset, char *read_char)
+int map_ramdump(struct ramdump* dump)
 {
-		unsigned int curr_position = 0;
+		LARGE_INTEGER size;
 
-//Add some kind of error checking here.
-		curr_position = (phy_offset - RAM_START);
-		if(fseek(ramdump_fp, curr_position, 0)) {
-				printf("%s: error setting the ramdump file position\n",__func__);
+		dump->file = CreateFile(dump->path, GENERIC_READ, FILE_SHARE_READ, NULL,
+					OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if(dump->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(dump->file, &size)) {
+				fprintf(stderr, "Error opening the ramdump file %s\n", dump->path);
 				return -1;
 		}
-
-		if(!(fread(read_char, 1, 1, ramdump_fp))) {
-				printf("%s: error reading from ramdump file\n",__func__);
+		dump->size = size.QuadPart;
+
+		dump->mapping = CreateFileMapping(dump->file, NULL, PAGE_READONLY, 0, 0, NULL);
+		InitializeCriticalSection(&dump->lock);
+		if(dump->mapping && dump->budget && dump->size > dump->budget)
+				return 0;
+		if(dump->mapping)
+				dump->image = MapViewOfFile(dump->mapping, FILE_MAP_READ, 0, 0, 0);
+		if(dump->image)
+				return 0;
+
+		//no room for the whole image, read it with a lock
+		if(dump->mapping) {
+				CloseHandle(dump->mapping);
+				dump->mapping = NULL;
+		}
+		dump->fp = fopen(dump->path, "rb");
+		if(!dump->fp) {
+				fprintf(stderr, "Error opening the ramdump file %s\n", dump->path);
 				return -1;
 		}
 
 		return 0;
 }
 
-int read_uchar_from_ramdump(FILE *ramdump_fp, unsigned int phy_offset, unsigned char *read_uchar)
+void unmap_ramdump(struct ramdump* dump)
 {
-		unsigned int curr_position = 0;
-
-//Add some kind of error checking here.
-		curr_position = (phy_offset - RAM_START);
-		if(fseek(ramdump_fp, curr_position, 0)) {
-				printf("%s: error setting the ramdump file position\n",__func__);
-				return -1;
-		}
+		if(dump->image)
+				UnmapViewOfFile(dump->image);
+		if(dump->view)
+				UnmapViewOfFile(dump->view);
+		if(dump->mapping)
+				CloseHandle(dump->mapping);
+		if(dump->file != INVALID_HANDLE_VALUE)
+				CloseHandle(dump->file);
+		if(dump->fp)
+				fclose(dump->fp);
+		DeleteCriticalSection(&dump->lock);
+}
 
-		if(!(fread(read_uchar, 1, 1, ramdump_fp))) {
-				printf("%s: error reading from ramdump file\n",__func__);
+/*Moves the window of a dump larger than its budget over a read*/
+int map_window(struct ramdump* dump, unsigned int position, unsigned int bytes)
+{
+		SYSTEM_INFO info;
+		unsigned long long start, size;
+
+		if(dump->view)
+				UnmapViewOfFile(dump->view);
+		if(cur_stats)
+				cur_stats->remaps++;
+
+		GetSystemInfo(&info);
+		start = position - position % info.dwAllocationGranularity;
+		size = dump->budget;
+		if(size < position - start + bytes)
+				size = position - start + bytes;
+		if(size > dump->size - start)
+				size = dump->size - start;
+
+		dump->view = MapViewOfFile(dump->mapping, FILE_MAP_READ, (DWORD)(start >> 32), (DWORD)start, (SIZE_T)size);
+		if(!dump->view) {
+				dump->view_size = 0;
+				fprintf(stderr, "%s: error mapping the ramdump file\n",__func__);
 				return -1;
 		}
+		dump->view_start = start;
+		dump->view_size = size;
 
 		return 0;
 }
 
-int read_short_from_ramdump(FILE *ramdump_fp, unsigned int phy_offset, short *read_short)
+int read_ramdump(unsigned int phy_offset, unsigned int bytes, void *buf)
 {
+		struct ramdump* dump = cur_dump;
 		unsigned int curr_position = 0;
+		int ret = 0;
+
+		if(cur_stats) {
+				cur_stats->reads++;
+				cur_stats->bytes += bytes;
+		}
 
-//Add some kind of error checking here.
 		curr_position = (phy_offset - RAM_START);
-		if(fseek(ramdump_fp, curr_position, 0)) {
-				printf("%s: error setting the ramdump file position\n",__func__);
+		if((unsigned long long)curr_position + bytes > dump->size) {
+				fprintf(stderr, "%s: error reading from ramdump file\n",__func__);
 				return -1;
 		}
 
-		if(!(fread(read_short, 2, 1, ramdump_fp))) {
-				printf("%s: error reading from ramdump file\n",__func__);
-				return -1;
+		if(dump->image) {
+				memcpy(buf, dump->image + curr_position, bytes);
+				return 0;
 		}
 
-		return 0;
+		EnterCriticalSection(&dump->lock);
+		if(dump->mapping) {
+				if(curr_position < dump->view_start ||
+						(unsigned long long)curr_position + bytes > dump->view_start + dump->view_size)
+						ret = map_window(dump, curr_position, bytes);
+				if(!ret)
+						memcpy(buf, dump->view + (curr_position - dump->view_start), bytes);
+		} else if(fseek(dump->fp, curr_position, 0)) {
+				fprintf(stderr, "%s: error setting the ramdump file position\n",__func__);
+				ret = -1;
+		} else if(!(fread(buf, bytes, 1, dump->fp))) {
+				fprintf(stderr, "%s: error reading from ramdump file\n",__func__);
+				ret = -1;
+		}
+		LeaveCriticalSection(&dump->lock);
+
+		return ret;
 }
 
-int read_ushort_from_ramdump(FILE *ramdump_fp, unsigned int phy_offset, unsigned short *read_ushort)
+int read_char_from_ramdump(unsigned int phy_offset, char *read_char)
 {
-		unsigned int curr_position = 0;
+		return read_ramdump(phy_offset, 1, read_char);
+}
 
-//Add some kind of error checking here.
-		curr_position = (phy_offset - RAM_START);
-		if(fseek(ramdump_fp, curr_position, 0)) {
-				printf("%s: error setting the ramdump file position\n",__func__);
-				return -1;
-		}
+int read_uchar_from_ramdump(unsigned int phy_offset, unsigned char *read_uchar)
+{
+		return read_ramdump(phy_offset, 1, read_uchar);
+}
 
-		if(!(fread(read_ushort, 2, 1, ramdump_fp))) {
-				printf("%s: error reading from ramdump file\n",__func__);
-				return -1;
-		}
+int read_short_from_ramdump(unsigned int phy_offset, short *read_short)
+{
+		return read_ramdump(phy_offset, 2, read_short);
+}
 
-		return 0;
+int read_ushort_from_ramdump(unsigned int phy_offset, unsigned short *read_ushort)
+{
+		return read_ramdump(phy_offset, 2, read_ushort);
 }
 
-int read_int_from_ramdump(FILE *ramdump_fp, unsigned int phy_offset, int *read_int)
+int read_int_from_ramdump(unsigned int phy_offset, int *read_int)
 {
-		unsigned int curr_position = 0;
+		return read_ramdump(phy_offset, 4, read_int);
+}
 
-//Add some kind of error checking here.
-		curr_position = (phy_offset - RAM_START);
-		if(fseek(ramdump_fp, curr_position, 0)) {
-				printf("%s: error setting the ramdump file position\n",__func__);
-				return -1;
+int read_uint_from_ramdump(unsigned int phy_offset, unsigned int *read_uint)
+{
+		return read_ramdump(phy_offset, 4, read_uint);
+}
+
+int read_buf_from_ramdump(unsigned int phy_offset, unsigned int bytes, char* buf)
+{
+		return read_ramdump(phy_offset, bytes, buf);
+}
+
+unsigned int smap_name_hash(const char* name, int size)
+{
+		unsigned int hash = 5381;
+		int i;
+
+		for(i = 0; i < size; i++)
+				hash = hash * 33 + (unsigned char)name[i];
+
+		return hash;
+}
+
+/*The whole of a System.map, NULL if it cannot be read*/
+char* read_smap(const char* path, long* size)
+{
+		FILE* fp;
+		char* text;
+
+		fp = fopen(path, "rb");
+		if(!fp) {
+				fprintf(stderr, "Error opening the system map file %s\n", path);
+				return NULL;
 		}
 
-		if(!(fread(read_int, 4, 1, ramdump_fp))) {
-				printf("%s: error reading from ramdump file\n",__func__);
-				return -1;
+		if(fseek(fp, 0, SEEK_END) || (*size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET)) {
+				fprintf(stderr, "Error reading from system map file\n");
+				fclose(fp);
+				return NULL;
 		}
 
-		return 0;
+		text = malloc(*size + 1);
+		if(!text || (*size && !fread(text, *size, 1, fp))) {
+				fprintf(stderr, "Error reading from system map file\n");
+				free(text);
+				fclose(fp);
+				return NULL;
+		}
+		text[*size] = 0;
+		fclose(fp);
+
+		return text;
 }
 
-int read_uint_from_ramdump(FILE *ramdump_fp, unsigned int phy_offset, unsigned int *read_uint)
+/*Reads a System.map into its syms, unless its text was already read.
+ *Each line is "address type name", the name is the last word of the
+ *line.
+ */
+int load_smap(struct smap* smap)
 {
-		unsigned int curr_position = 0;
+		long size;
+		char *line, *next, *word, *name;
+		unsigned int i, j, hash;
 
-//Add some kind of error checking here.
-		curr_position = (phy_offset - RAM_START);
-		if(fseek(ramdump_fp, curr_position, 0)) {
-				printf("%s: error setting the ramdump file position\n",__func__);
+		if(smap->text)
+				size = strlen(smap->text);
+		else if(!(smap->text = read_smap(smap->path, &size)))
+				return -1;
+
+		smap->syms = malloc((size / 4 + 1) * sizeof(struct smap_sym));
+		if(!smap->syms) {
+				fprintf(stderr, "Out of memory reading the system map file\n");
 				return -1;
 		}
 
-		if(!(fread(read_uint, 4, 1, ramdump_fp))) {
-				printf("%s: error reading from ramdump file\n",__func__);
+		for(line = smap->text; *line; line = next) {
+				next = strchr(line, '\n');
+				if(next)
+						*next++ = 0;
+				else
+						next = line + strlen(line);
+
+				smap->syms[smap->nr_syms].address = strtoul(line, &word, 16);
+				smap->syms[smap->nr_syms].mapping = 0;
+				name = NULL;
+				while(*word) {
+						while(*word == ' ' || *word == '\t' || *word == '\r')
+								*word++ = 0;
+						if(!*word)
+								break;
+						name = word;
+						if(*word == '$')
+								smap->syms[smap->nr_syms].mapping = 1;
+						while(*word && *word != ' ' && *word != '\t' && *word != '\r')
+								word++;
+				}
+				if(!name)
+						continue;
+				smap->syms[smap->nr_syms++].name = name;
+		}
+
+		smap->hash_size = 1024;
+		while(smap->hash_size < smap->nr_syms * 2)
+				smap->hash_size *= 2;
+		smap->hash = calloc(smap->hash_size, sizeof(unsigned int));
+		if(!smap->hash) {
+				fprintf(stderr, "Out of memory reading the system map file\n");
 				return -1;
 		}
 
+		//the first of several symbols with one name wins, as with a search from the top
+		for(i = 0; i < smap->nr_syms; i++) {
+				hash = smap_name_hash(smap->syms[i].name, strlen(smap->syms[i].name));
+				for(j = hash & (smap->hash_size - 1); smap->hash[j]; j = (j + 1) & (smap->hash_size - 1)) {
+						if(!strcmp(smap->syms[smap->hash[j] - 1].name, smap->syms[i].name))
+								break;
+				}
+				if(!smap->hash[j])
+						smap->hash[j] = i + 1;
+		}
+
 		return 0;
 }
 
-int read_buf_from_ramdump(FILE *ramdump_fp, unsigned int phy_offset, unsigned int bytes, char* buf)
+void free_smap(struct smap* smap)
 {
-		unsigned int curr_position = 0;
+		DeleteCriticalSection(&smap->lock);
+		free(smap->hash);
+		free(smap->syms);
+		free(smap->text);
+		free(smap->by_addr);
+}
 
-//Add some kind of error checking here.
-		curr_position = (phy_offset - RAM_START);
-		if(fseek(ramdump_fp, curr_position, 0)) {
-				printf("%s: error setting the ramdump file position\n",__func__);
-				return -1;
-		}
+/*System.map is read the first time a symbol is needed*/
+int smap_ready(void)
+{
+		struct smap* smap = cur_dump->smap;
 
-		if(!(fread(buf, bytes, 1, ramdump_fp))) {
-				printf("%s: error reading from ramdump file\n",__func__);
-				return -1;
+		EnterCriticalSection(&smap->lock);
+		if(!smap->loaded)
+				smap->loaded = load_smap(smap) ? -1 : 1;
+		LeaveCriticalSection(&smap->lock);
+
+		return smap->loaded > 0 ? 0 : -1;
+}
+
+unsigned int get_addr_from_smap(char* symbol_to_find, int size)
+{
+		struct smap* smap = cur_dump->smap;
+		unsigned int i, j;
+
+		if(cur_stats)
+				cur_stats->lookups++;
+		if(smap_ready())
+				return 0;
+
+		for(j = smap_name_hash(symbol_to_find, size) & (smap->hash_size - 1); (i = smap->hash[j]); j = (j + 1) & (smap->hash_size - 1)) {
+				if(!strncmp(smap->syms[i - 1].name, symbol_to_find, size) && !smap->syms[i - 1].name[size])
+						return smap->syms[i - 1].address;
 		}
 
 		return 0;
 }
 
-unsigned int get_addr_from_smap(char* symbol_to_find, int size)
+/*Where an output file goes, under output_dir when it is set.
+ *NULL if it does not fit in size.
+ */
+char* output_path(char* buf, size_t size, const char* path)
 {
-		unsigned char smap_buf[150];
-		unsigned int address;
-		char* symbol;
+		int n;
+
+		if(!output_dir)
+				n = snprintf(buf, size, "%s", path);
+		else {
+				if(!strncmp(path, "./", 2))
+						path += 2;
+				n = snprintf(buf, size, "%s\\%s", output_dir, path);
+		}
+		if(n < 0 || (size_t)n >= size) {
+				printf("Output path too long: %s\\%s\n", output_dir ? output_dir : ".", path);
+				return NULL;
+		}
 
-#define SYSMAP_LINE_SIZE 149
+		return buf;
+}
 
-		//reset system map fp
-		if(fseek(systemmap_fp, 0, 0)) {
-				printf("Error setting the system map file position\n");
-				return -1;
+FILE* open_output(const char* path, const char* mode)
+{
+		char buf[MAX_PATH];
+
+		if(!output_path(buf, sizeof(buf), path))
+				return NULL;
+		return fopen(buf, mode);
+}
+
+struct extractor* find_extractor(const char* key, unsigned int len)
+{
+		unsigned int i;
+
+		for(i = 0; i < NR_EXTRACTORS; i++) {
+				if(strlen(extractors[i].key) == len && !strncmp(extractors[i].key, key, len))
+						return &extractors[i];
 		}
 
-        while(!feof(systemmap_fp) && !ferror(systemmap_fp)) {
-               if(!(fgets(smap_buf, SYSMAP_LINE_SIZE, systemmap_fp))) {
-                    printf("Error reading from system map file\n");
-                    return 0;
-               }
-               address = strtoul(strtok(smap_buf," "), NULL, 16);
-               while(symbol =  strtok(NULL," ")) {
-                    if(!strncmp(symbol,symbol_to_find,size)) {
-						  if (symbol[size] != '\n')
-						  	continue;
-                          return address;
-					}
-               }
-        }
+		return NULL;
+}
 
-		//reset system map fp
-		if(fseek(systemmap_fp, 0, 0)) {
-				printf("Error setting the system map file position\n");
-				return -1;
+/*Marks the extractors named in a comma separated list*/
+int select_extractors(const char* list, int skip)
+{
+		struct extractor* e;
+		const char* end;
+		unsigned int len;
+
+		for(; *list; list = *end ? end + 1 : end) {
+				end = strchr(list, ',');
+				if(!end)
+						end = list + strlen(list);
+				len = end - list;
+
+				e = find_extractor(list, len);
+				if(!e) {
+						printf("Unknown extractor %.*s\n", len, list);
+						return -1;
+				}
+				e->skip = skip;
 		}
+
+		return 0;
 }
 
 int main(int argc, char *argv[])
@@ -359,32 +714,61 @@ int main(int argc, char *argv[])
         int validate_flag = 0;
         int virt_flag = 0;
         int c;
-        unsigned int input_read_buf=0;
-        unsigned int mm_start=0;
-        unsigned int curr_position = 0;
-        unsigned int init_proc_address;
-        unsigned int proc;
-        unsigned char comm_buf[TASK_COMM_LEN];
-        int signed_read_buf=0;
-        unsigned char kstack_name_buf[100];
-        char* kstack_buf;
-        int pid, tid;
-        int count = 0;
-        unsigned int kstack_start = 0;
-        unsigned int address;
+        int nr_threads = 0;
         unsigned int virtual_address;
         unsigned int search_flag = 0;
         unsigned int search_val = 0;
+        unsigned int kernel_log_flag = 0;
+        unsigned int shell_flag = 0;
+        char* daemon_path = NULL;
+        char* diff_path = NULL;
+        char* diff_smap_path = NULL;
+        char* batch_path = NULL;
+        char* cache_path = NULL;
+        char* trace_path = NULL;
+        char* bench_path = NULL;
+        int stats_flag = 0;
+        unsigned long long budget = 0;
         unsigned char* working_directory = ".";
-
-        while((c = getopt(argc, argv, ":r:m:a:s:o:vh")) != -1) {
+        unsigned int i;
+        struct option long_options[] = {
+                {"only", required_argument, NULL, 'O'},
+                {"skip", required_argument, NULL, 'S'},
+                {"stats", no_argument, NULL, 'P'},
+                {"trace", required_argument, NULL, 'T'},
+                {"bench", required_argument, NULL, 'X'},
+                {NULL, 0, NULL, 0}
+        };
+
+        InitializeCriticalSection(&main_smap.lock);
+
+        while((c = getopt_long(argc, argv, ":r:m:a:s:o:j:d:c:D:M:B:b:C:vkih", long_options, NULL)) != -1) {
                 switch(c) {
+                        case 'O':
+                                for(i = 0; i < NR_EXTRACTORS; i++)
+                                        extractors[i].skip = 1;
+                                if(select_extractors(optarg, 0))
+                                        exit(2);
+                                break;
+                        case 'S':
+                                if(select_extractors(optarg, 1))
+                                        exit(2);
+                                break;
+                        case 'P':
+                                stats_flag = 1;
+                                break;
+                        case 'T':
+                                trace_path = optarg;
+                                break;
+                        case 'X':
+                                bench_path = optarg;
+                                break;
                         case 'r':
-                                ramdump_file_path = optarg;
+                                main_dump.path = optarg;
                                 rm_flag = 1;
                                 break;
                         case 'm':
-                                systemmap_file_path = optarg;
+                                main_smap.path = optarg;
                                 sm_flag = 1;
                                 break;
                         case 'o':
@@ -393,6 +777,35 @@ int main(int argc, char *argv[])
                         case 'v':
                         		validate_flag = 1;
                         		break;
+                        case 'k':
+                        		kernel_log_flag = 1;
+                        		break;
+                        case 'j':
+                        		nr_threads = atoi(optarg);
+                        		break;
+                        case 'i':
+                        		shell_flag = 1;
+                        		break;
+                        case 'd':
+                        		daemon_path = optarg;
+                        		break;
+                        case 'c':
+                        		return run_client(optarg) ? -1 : 0;
+                        case 'D':
+                        		diff_path = optarg;
+                        		break;
+                        case 'M':
+                        		diff_smap_path = optarg;
+                        		break;
+                        case 'B':
+                        		batch_path = optarg;
+                        		break;
+                        case 'b':
+                        		budget = strtoull(optarg, NULL, 10) << 20;
+                        		break;
+                        case 'C':
+                        		cache_path = optarg;
+                        		break;
                         case 'a':
                                 virtual_address = strtoul(optarg, NULL, 16);
                                 virt_flag = 1;
@@ -413,6 +826,11 @@ int main(int argc, char *argv[])
                 }
         }
 
+        if(batch_path) {
+                SetCurrentDirectory(working_directory);
+                return run_batch(batch_path, nr_threads, budget ? budget : BATCH_BUDGET) ? -1 : 0;
+        }
+
         if(!rm_flag) {
                 printf("ramdump file path missing\n");
                 show_help();
@@ -427,17 +845,21 @@ int main(int argc, char *argv[])
 
         SetCurrentDirectory(working_directory);
 
-        ramdump_fp = fopen(ramdump_file_path, "rb");
-        if(!ramdump_fp) {
-                printf("Error opening the ramdump file %s\n", ramdump_file_path);
+        main_dump.budget = budget;
+        if(map_ramdump(&main_dump))
                 return -1;
-        }
 
-        systemmap_fp = fopen(systemmap_file_path, "r");
-        if(!systemmap_fp) {
-                printf("Error opening the system map file %s\n", systemmap_file_path);
-                return -1;
-        }
+		if (shell_flag) {
+			output_fp = stdout;
+			shell(stdin, 0);
+			return 0;
+		}
+
+		if (daemon_path)
+			return run_daemon(daemon_path, nr_threads) ? -1 : 0;
+
+		if (diff_path)
+			return run_diff(diff_path, diff_smap_path) ? -1 : 0;
 
 
 		if (validate_flag) {
@@ -446,6 +868,7 @@ int main(int argc, char *argv[])
 		}
 
 		if (virt_flag) {
+			output_fp = stdout;
 			do_virt_to_phy(virtual_address);
 			return 0;
 		}
@@ -454,14 +877,69 @@ int main(int argc, char *argv[])
 			show_locations(search_val);
 			return 0;
 		}
-        output_fp = fopen(output_file_path, "w");
+
+		if (kernel_log_flag) {
+			if (Extract_kernel_log(stdout))
+				return -1;
+			fflush(stdout);
+			return 0;
+		}
+
+		if (bench_path)
+			return run_bench(bench_path) ? -1 : 0;
+
+        if(cache_path && open_cache(cache_path, nr_threads))
+                printf("Not using the cache %s\n", cache_path);
+
+        if(run_extractors(nr_threads))
+                return -1;
+
+        if(stats_flag)
+                print_stats();
+        if(trace_path)
+                write_trace(trace_path);
+
+        unmap_ramdump(&main_dump);
+
+        free_smap(&main_smap);
+
+        return 0;
+}
+
+/*The walk of the task list from init_task, writes task.txt and
+ *the kernel stack and cpu context of every thread.
+ */
+int Extract_tasks(void)
+{
+        unsigned int input_read_buf=0;
+        unsigned int mm_start=0;
+        unsigned int init_proc_address;
+        unsigned int proc;
+        unsigned char comm_buf[TASK_COMM_LEN];
+        int signed_read_buf=0;
+        unsigned char kstack_name_buf[MAX_PATH];
+        char dir_buf[MAX_PATH];
+        char* kstack_buf;
+        int pid, tid;
+        int count = 0;
+        unsigned int kstack_start = 0;
+
+        output_fp = open_output(output_file_path, "w");
         if(!output_fp) {
                 printf("Error opening the output file %s\n", output_file_path);
                 return -1;
         }
 
-        CreateDirectory ("kstacks_per_task", NULL);
-        CreateDirectory ("cpu_context_per_task", NULL);
+        if(!output_path(dir_buf, sizeof(dir_buf), "kstacks_per_task")) {
+                fclose(output_fp);
+                return -1;
+        }
+        CreateDirectory (dir_buf, NULL);
+        if(!output_path(dir_buf, sizeof(dir_buf), "cpu_context_per_task")) {
+                fclose(output_fp);
+                return -1;
+        }
+        CreateDirectory (dir_buf, NULL);
 
         init_proc_address = (unsigned int)get_addr_from_smap("init_task", 9);
         proc = init_proc_address;
@@ -473,7 +951,7 @@ int main(int argc, char *argv[])
                             "preempt_count");
         do {
             //COMM
-            if(!read_buf_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_COMM), TASK_COMM_LEN, comm_buf))
+            if(!read_buf_from_ramdump(__pa(proc + OFFSETOF_COMM), TASK_COMM_LEN, comm_buf))
             	fprintf(output_fp,"\n\n%20s",comm_buf);
             else {
 				printf("ERROR:%d",__LINE__);
@@ -484,7 +962,7 @@ int main(int argc, char *argv[])
             fprintf(output_fp,"%20x",proc);
 
             //PID
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_PID), &input_read_buf)) {
+            if(!read_uint_from_ramdump(__pa(proc + OFFSETOF_PID), &input_read_buf)) {
             	fprintf(output_fp,"%8d",input_read_buf);
             	pid = input_read_buf;
             } else {
@@ -493,7 +971,7 @@ int main(int argc, char *argv[])
 			}
 
             //TID
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_TID), &input_read_buf)) {
+            if(!read_uint_from_ramdump(__pa(proc + OFFSETOF_TID), &input_read_buf)) {
             	fprintf(output_fp,"%8d",input_read_buf);
             	tid = input_read_buf;
             } else {
@@ -504,7 +982,7 @@ int main(int argc, char *argv[])
 #define OFFSETOF_STATE      0x0
 
             //STATE
-            if(read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_STATE), &input_read_buf)) {
+            if(read_uint_from_ramdump(__pa(proc + OFFSETOF_STATE), &input_read_buf)) {
             	printf("ERROR:%d",__LINE__);
             	return -1;
 			}
@@ -544,7 +1022,7 @@ int main(int argc, char *argv[])
 #define OFFSETOF_FLAGS      0xc
 
             //FLAGS
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_FLAGS), &input_read_buf))
+            if(!read_uint_from_ramdump(__pa(proc + OFFSETOF_FLAGS), &input_read_buf))
             	fprintf(output_fp,"%15x",input_read_buf);
             else {
 				printf("ERROR:%d",__LINE__);
@@ -554,7 +1032,7 @@ int main(int argc, char *argv[])
 #undef OFFSETOF_FLAGS
 
             //PRIO
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_PRIO), &input_read_buf))
+            if(!read_uint_from_ramdump(__pa(proc + OFFSETOF_PRIO), &input_read_buf))
             	fprintf(output_fp,"%8d",input_read_buf);
             else {
 				printf("ERROR:%d",__LINE__);
@@ -562,7 +1040,7 @@ int main(int argc, char *argv[])
 			}
 
             //STATICPRIO
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_STATICPRIO), &input_read_buf))
+            if(!read_uint_from_ramdump(__pa(proc + OFFSETOF_STATICPRIO), &input_read_buf))
             	fprintf(output_fp,"%15d",input_read_buf);
             else {
 				printf("ERROR:%d",__LINE__);
@@ -570,7 +1048,7 @@ int main(int argc, char *argv[])
 			}
 
             //NORMALPRIO
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_NORMALPRIO), &input_read_buf))
+            if(!read_uint_from_ramdump(__pa(proc + OFFSETOF_NORMALPRIO), &input_read_buf))
             	fprintf(output_fp,"%15d",input_read_buf);
             else {
 				printf("ERROR:%d",__LINE__);
@@ -578,7 +1056,7 @@ int main(int argc, char *argv[])
 			}
 
             //MM
-            if(read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_MM), &input_read_buf)) {
+            if(read_uint_from_ramdump(__pa(proc + OFFSETOF_MM), &input_read_buf)) {
             	printf("ERROR:%d",__LINE__);
             	return -1;
 			}
@@ -586,7 +1064,7 @@ int main(int argc, char *argv[])
             if(input_read_buf) {
                    	mm_start = input_read_buf;
                    	//RSS
-            		if(!read_buf_from_ramdump(ramdump_fp, __pa(mm_start + OFFSETOF_RSSSTAT), sizeof(struct mm_rss_stat), (char*)&mm_rss))
+            		if(!read_buf_from_ramdump(__pa(mm_start + OFFSETOF_RSSSTAT), sizeof(struct mm_rss_stat), (char*)&mm_rss))
             			fprintf(output_fp,"%20ld %20ld %20ld %20ld", mm_rss.count[0], mm_rss.count[1], mm_rss.count[2], mm_rss.count[3]);
             		else {
 						printf("ERROR:%d",__LINE__);
@@ -595,9 +1073,11 @@ int main(int argc, char *argv[])
             } else {
                    fprintf(output_fp,"%20s %20s %20s %20s","N/A","N/A","N/A","N/A");
             }
+            //file + anon pages, as get_mm_rss()
+            snap_task(pid, comm_buf, input_read_buf ? mm_rss.count[0] + mm_rss.count[1] : 0);
 
             //min_flt
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_MINFLT), &input_read_buf))
+            if(!read_uint_from_ramdump(__pa(proc + OFFSETOF_MINFLT), &input_read_buf))
             	fprintf(output_fp,"%15d",input_read_buf);
             else {
 				printf("ERROR:%d",__LINE__);
@@ -605,7 +1085,7 @@ int main(int argc, char *argv[])
 			}
 
             //maj_flt
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_MAJFLT), &input_read_buf))
+            if(!read_uint_from_ramdump(__pa(proc + OFFSETOF_MAJFLT), &input_read_buf))
             	fprintf(output_fp,"%15d",input_read_buf);
             else {
 				printf("ERROR:%d",__LINE__);
@@ -613,13 +1093,13 @@ int main(int argc, char *argv[])
 			}
 
             //signal
-            if(read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_SIGNAL), &input_read_buf)) {
+            if(read_uint_from_ramdump(__pa(proc + OFFSETOF_SIGNAL), &input_read_buf)) {
             	printf("ERROR:%d",__LINE__);
             	return -1;
 			}
 
             //oom_adj
-            if(!read_int_from_ramdump(ramdump_fp, __pa(input_read_buf + OFFSETOF_OOMADJ), &signed_read_buf))
+            if(!read_int_from_ramdump(__pa(input_read_buf + OFFSETOF_OOMADJ), &signed_read_buf))
             	fprintf(output_fp,"%15d",signed_read_buf);
             else {
 				printf("ERROR:%d",__LINE__);
@@ -627,7 +1107,7 @@ int main(int argc, char *argv[])
 			}
 
             //stack start
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_KSTACK), &input_read_buf))
+            if(!read_uint_from_ramdump(__pa(proc + OFFSETOF_KSTACK), &input_read_buf))
             	fprintf(output_fp,"%15x",input_read_buf);
             else {
 				printf("ERROR:%d",__LINE__);
@@ -648,7 +1128,7 @@ int main(int argc, char *argv[])
 			}
 
 			sprintf(kstack_name_buf,"kstacks_per_task\\kstack_%d_%d_%s.bin",pid,tid,comm_buf);
-        	output_stack_fp = fopen(kstack_name_buf, "wb");
+        	output_stack_fp = open_output(kstack_name_buf, "wb");
         	if(!output_stack_fp) {
                 printf("Error opening the output file for kstack file %s\n", kstack_name_buf);
                 return -1;
@@ -656,7 +1136,7 @@ int main(int argc, char *argv[])
 
 			kstack_buf = (char*)malloc(KSTACK_SIZE);
 
-        	if(read_buf_from_ramdump(ramdump_fp, __pa(input_read_buf), KSTACK_SIZE, kstack_buf)) {
+        	if(read_buf_from_ramdump(__pa(input_read_buf), KSTACK_SIZE, kstack_buf)) {
             	printf("ERROR:%d",__LINE__);
             	return -1;
 			}
@@ -674,7 +1154,7 @@ int main(int argc, char *argv[])
 #define OFFSETOF_CPUCONTEXT 0x1c
 
 			sprintf(kstack_name_buf,"cpu_context_per_task\\cpu_context_%d_%d_%s.txt",pid,tid,comm_buf);
-        	output_stack_fp = fopen(kstack_name_buf, "w");
+        	output_stack_fp = open_output(kstack_name_buf, "w");
         	if(!output_stack_fp) {
                 printf("Error opening the output file for cpu context file %s\n", kstack_name_buf);
                 return -1;
@@ -683,7 +1163,7 @@ int main(int argc, char *argv[])
 //printf("0x%x,0x%x,0x%x\n",kstack_start,OFFSETOF_CPUCONTEXT,address);
         	for(count = 0; count < 10; count++) {
 
-			            if(!read_uint_from_ramdump(ramdump_fp, __pa(kstack_start + OFFSETOF_CPUCONTEXT + (4 * count)), &input_read_buf)) {
+			            if(!read_uint_from_ramdump(__pa(kstack_start + OFFSETOF_CPUCONTEXT + (4 * count)), &input_read_buf)) {
 			            	if (count < 6)
 			            		fprintf(output_stack_fp,"r%d\t\t0x%x\n",count+4, input_read_buf);
 			            	else if (count == 6)
@@ -692,7 +1172,7 @@ int main(int argc, char *argv[])
 			            		fprintf(output_stack_fp,"%s\t\t0x%x\n","fp", input_read_buf);
 			            	else if (count == 8) {
 			            		fprintf(output_stack_fp,"%s\t\t0x%x\n","sp", input_read_buf);
-								if(read_uint_from_ramdump(ramdump_fp, __pa(input_read_buf), &input_read_buf)) {
+								if(read_uint_from_ramdump(__pa(input_read_buf), &input_read_buf)) {
 									printf("ERROR:%d",__LINE__);
 									//return -1;
 								}
@@ -712,7 +1192,7 @@ int main(int argc, char *argv[])
 #undef OFFSETOF_CPUCONTEXT
 
             //preempt_count
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(kstack_start + OFFSETOF_PREEMPTCOUNT), &input_read_buf))
+            if(!read_uint_from_ramdump(__pa(kstack_start + OFFSETOF_PREEMPTCOUNT), &input_read_buf))
             	fprintf(output_fp,"%15x",input_read_buf);
             else {
 				printf("ERROR:%d",__LINE__);
@@ -720,7 +1200,7 @@ int main(int argc, char *argv[])
 			}
 
             //thread_group
-            if(read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_THREADGROUP), &input_read_buf)) {
+            if(read_uint_from_ramdump(__pa(proc + OFFSETOF_THREADGROUP), &input_read_buf)) {
             	printf("ERROR:%d",__LINE__);
             	return -1;
 			}
@@ -734,7 +1214,7 @@ int main(int argc, char *argv[])
             }
 
             //task->next
-            if(read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_TASKS), &input_read_buf)) {
+            if(read_uint_from_ramdump(__pa(proc + OFFSETOF_TASKS), &input_read_buf)) {
             	printf("ERROR:%d",__LINE__);
             	return -1;
 			}
@@ -748,38 +1228,161 @@ int main(int argc, char *argv[])
         //close the task file
         fclose(output_fp);
 
-        if (Extract_irq_desc())
-        	printf("Failed to extract irq desc..but continuing\n");
+        return 0;
+}
+
+int Extract_kernel_log_file(void)
+{
+        int ret;
+
+        output_fp = open_output(output_kernel_log_file_path, "w");
+        if(!output_fp) {
+                printf("Error opening the output file %s\n", output_kernel_log_file_path);
+                return -1;
+        }
+
+        ret = Extract_kernel_log(output_fp);
+        fclose(output_fp);
+
+        return ret;
+}
+
+DWORD WINAPI extractor_thread(LPVOID arg)
+{
+        LONG i;
+
+        while((i = InterlockedIncrement(&next_extractor) - 1) < (LONG)NR_EXTRACTORS) {
+                if(extractors[i].skip)
+                        continue;
+                cur_stats = &extractors[i].stats;
+                cur_stats->thread = GetCurrentThreadId();
+                QueryPerformanceCounter(&cur_stats->start);
+                extractors[i].ret = cache_entry[0] ? run_cached(&extractors[i]) : extractors[i].extract();
+                QueryPerformanceCounter(&cur_stats->end);
+                cur_stats = NULL;
+        }
 
-        if (Extract_meminfo())
-        	printf("Failed to extract meminfo..but continuing\n");
+        return 0;
+}
 
-        if (Extract_virt_mem_layout())
-        	printf("Failed to virt kern mem layout..but continuing\n");
+double elapsed_ms(LARGE_INTEGER from, LARGE_INTEGER to)
+{
+        LARGE_INTEGER frequency;
 
-       	if (Extract_smap_pgtbl())
-       		printf("Failed to extract smap pgtbl..but continuing\n");
+        QueryPerformanceFrequency(&frequency);
+        return (double)(to.QuadPart - from.QuadPart) * 1000 / frequency.QuadPart;
+}
 
-       	if (Decode_cache_chain_and_slab_info())
-       		printf("Failed to extract cache chain..but continuing\n");
+/*--stats: the table of what every extractor of the run did*/
+void print_stats(void)
+{
+        struct stats* st;
+        struct stats total;
+        int i;
+
+        memset(&total, 0, sizeof(total));
+        printf("%-22s%10s%12s%14s%12s%12s%8s%7s\n", "extractor", "ms", "reads", "bytes",
+                        "pt_walks", "sym_lookups", "remaps", "cache");
+        for(i = 0; i < (int)NR_EXTRACTORS; i++) {
+                if(extractors[i].skip)
+                        continue;
+                st = &extractors[i].stats;
+                printf("%-22s%10.2f%12llu%14llu%12llu%12llu%8llu%7s\n", extractors[i].name,
+                                elapsed_ms(st->start, st->end), st->reads, st->bytes, st->walks,
+                                st->lookups, st->remaps, !cache_entry[0] ? "-" : extractors[i].cached ? "hit" : "miss");
+                total.reads += st->reads;
+                total.bytes += st->bytes;
+                total.walks += st->walks;
+                total.lookups += st->lookups;
+                total.remaps += st->remaps;
+        }
+        printf("%-22s%10.2f%12llu%14llu%12llu%12llu%8llu\n", "total (wall)", elapsed_ms(run_start, run_end),
+                        total.reads, total.bytes, total.walks, total.lookups, total.remaps);
+}
 
-       	if (Extract_node_uma())
-       		printf("Failed to extract uma node..but continuing\n");
+/*--trace: the same as Chrome trace events, one per extractor on the
+ *thread that ran it, for chrome://tracing or Perfetto
+ */
+int write_trace(const char* path)
+{
+        struct stats* st;
+        FILE* fp;
+        int i, first = 1;
 
-       	if (Extract_zoneinfo())
-       		printf("Failed to extract zone info..but continuing\n");
+        fp = open_output(path, "w");
+        if(!fp) {
+                printf("Error opening the trace file %s\n", path);
+                return -1;
+        }
 
-       	if (Extract_buddyinfo())
-       		printf("Failed to extract buddy info..but continuing\n");
+        fprintf(fp, "{\"traceEvents\":[\n");
+        for(i = 0; i < (int)NR_EXTRACTORS; i++) {
+                if(extractors[i].skip)
+                        continue;
+                st = &extractors[i].stats;
+                fprintf(fp, "%s{\"name\":\"%s\",\"cat\":\"extractor\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,"
+                                "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"reads\":%llu,\"bytes\":%llu,"
+                                "\"pt_walks\":%llu,\"sym_lookups\":%llu,\"remaps\":%llu,\"cached\":%d,\"ret\":%d}}",
+                                first ? "" : ",\n", extractors[i].key, (unsigned long)st->thread,
+                                elapsed_ms(run_start, st->start) * 1000, elapsed_ms(st->start, st->end) * 1000,
+                                st->reads, st->bytes, st->walks, st->lookups, st->remaps,
+                                extractors[i].cached, extractors[i].ret);
+                first = 0;
+        }
+        fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+        fclose(fp);
 
-       	if (Extract_pagetypeinfo())
-       		printf("Failed to extract pagetype info..but continuing\n");
+        return 0;
+}
 
-        fclose(ramdump_fp);
+/*Runs the extractors on a pool of threads. They only read the
+ *shared image and symbol table, so the run takes about as long
+ *as the slowest of them.
+ */
+int run_extractors(int nr_threads)
+{
+        HANDLE threads[MAXIMUM_WAIT_OBJECTS];
+        SYSTEM_INFO info;
+        int i, n = 0, selected = 0, reused = 0;
 
-        fclose(systemmap_fp);
+        for(i = 0; i < (int)NR_EXTRACTORS; i++)
+                selected += !extractors[i].skip;
 
-        fclose(output_fp);
+        if(nr_threads <= 0) {
+                GetSystemInfo(&info);
+                nr_threads = info.dwNumberOfProcessors;
+        }
+        if(nr_threads > selected)
+                nr_threads = selected;
+        if(nr_threads < 1)
+                nr_threads = 1;
+
+        QueryPerformanceCounter(&run_start);
+        for(i = 0; i < nr_threads; i++) {
+                threads[n] = CreateThread(NULL, 0, extractor_thread, NULL, 0, NULL);
+                if(!threads[n]) {
+                        printf("Error starting the thread %d\n", i);
+                        break;
+                }
+                n++;
+        }
+
+        //no thread could be started, run them here
+        if(!n)
+                extractor_thread(NULL);
+
+        WaitForMultipleObjects(n, threads, TRUE, INFINITE);
+        QueryPerformanceCounter(&run_end);
+        for(i = 0; i < n; i++)
+                CloseHandle(threads[i]);
+
+        for(i = 0; i < (int)NR_EXTRACTORS; i++) {
+                if(extractors[i].ret)
+                        printf("Failed to extract %s..but continuing\n", extractors[i].name);
+                reused += extractors[i].cached;
+        }
+        if(cache_entry[0])
+                printf("%d of %d extractors reused from the cache\n", reused, selected);
 
         return 0;
 }
@@ -795,13 +1398,7 @@ int Extract_node_uma(void)
 	char name_buf[ZONE_NAME_SIZE + 1];
 	int i;
 
-	//reset system map fp
-	if(fseek(systemmap_fp, 0, 0)) {
-			printf("Error setting the system map file position\n");
-			return -1;
-	}
-
-	output_fp = fopen(output_node_uma_file_path, "w");
+	output_fp = open_output(output_node_uma_file_path, "w");
 	if(!output_fp) {
 			printf("Error opening the output file for %s\n", output_node_uma_file_path);
 			return -1;
@@ -822,49 +1419,49 @@ int Extract_node_uma(void)
 #define OFFSETOF_CLASSZONEIDX 0x73c
 
 	//nr_zones
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_NRZONES), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_NRZONES), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
 
 	fprintf(output_fp,"nr_zones: %d\n", input_read_buf);
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_NODESTARTPFN), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_NODESTARTPFN), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
 
 	fprintf(output_fp,"node_start_pfn: %d, node_start_address:0x%x\n", input_read_buf, input_read_buf << PAGE_SHIFT);
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_NODEPRESENTPAGES), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_NODEPRESENTPAGES), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
 
 	fprintf(output_fp,"node_present_pages: %d\n", input_read_buf);
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_NODESPANNEDPAGES), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_NODESPANNEDPAGES), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
 
 	fprintf(output_fp,"node_spanned_pages: %d\n", input_read_buf);
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_NODEID), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_NODEID), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
 
 	fprintf(output_fp,"node_id: %d\n", input_read_buf);
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_KSWAPDMAXORDER), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_KSWAPDMAXORDER), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
 
 	fprintf(output_fp,"kswapd_max_order: %d\n", input_read_buf);
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_CLASSZONEIDX), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_CLASSZONEIDX), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
@@ -888,13 +1485,7 @@ int Extract_zoneinfo(void)
 	char name_buf[ZONE_NAME_SIZE + 1];
 	int i;
 
-	//reset system map fp
-	if(fseek(systemmap_fp, 0, 0)) {
-			printf("Error setting the system map file position\n");
-			return -1;
-	}
-
-	output_fp = fopen(output_buddy_info_file_path, "w");
+	output_fp = open_output(output_buddy_info_file_path, "w");
 	if(!output_fp) {
 			printf("Error opening the output file for %s\n", output_buddy_info_file_path);
 			return -1;
@@ -911,7 +1502,7 @@ int Extract_zoneinfo(void)
 #define OFFSETOF_NODEID 0x728
 
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_NODEID), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_NODEID), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
@@ -931,69 +1522,69 @@ int Extract_zoneinfo(void)
 	fprintf(output_fp,"ZONE INFO\n");
 	fprintf(output_fp,"---------\n");
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_NAME), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_NAME), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
 
 	//read the zone name
-	if(read_buf_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(input_read_buf), ZONE_NAME_SIZE, name_buf)) {
+	if(read_buf_from_ramdump(do_pg_tbl_wlkthr_non_logical(input_read_buf), ZONE_NAME_SIZE, name_buf)) {
 		printf("ERROR:%d",__LINE__);
 		return -1;
 	}
 
 	fprintf(output_fp,"ZONE: %s\n\n", name_buf);
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_WMARK_MIN), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_WMARK_MIN), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
 
 	fprintf(output_fp,"WMARK_MIN= %d\n\n", input_read_buf);
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_WMARK_LOW), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_WMARK_LOW), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
 
 	fprintf(output_fp,"WMARK_LOW= %d\n\n", input_read_buf);
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_WMARK_HIGH), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_WMARK_HIGH), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
 
 	fprintf(output_fp,"WMARK_HIGH= %d\n\n", input_read_buf);
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_PERCPU_DRIFT_MARK), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_PERCPU_DRIFT_MARK), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
 
 	fprintf(output_fp,"percpu_drift_mark= %d\n\n", input_read_buf);
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_LOWMEM_RESERVE_1), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_LOWMEM_RESERVE_1), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
 
 	fprintf(output_fp,"lowmem_reserve[0]= %d\n\n", input_read_buf);
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_LOWMEM_RESERVE_2), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_LOWMEM_RESERVE_2), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
 
 	fprintf(output_fp,"lowmem_reserve[1]= %d\n\n", input_read_buf);
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_ALL_UNRECLAIMABLE), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_ALL_UNRECLAIMABLE), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
 
 	fprintf(output_fp,"all_unreclaimable= %d\n\n", input_read_buf);
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_MIN_CMA_PAGES), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_MIN_CMA_PAGES), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
@@ -1006,7 +1597,7 @@ int Extract_zoneinfo(void)
 #define OFFSETOF_COMPACT_DEFER_SHIFT 0x294
 
 	for (i = 0; i < 11; i++) {
-		if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_NRCMAFREE + (4*i)), &input_read_buf)) {
+		if(read_uint_from_ramdump(__pa(address + OFFSETOF_NRCMAFREE + (4*i)), &input_read_buf)) {
 			printf("ERROR:%d\n",__LINE__);
 			return -1;
 		}
@@ -1014,14 +1605,14 @@ int Extract_zoneinfo(void)
 		fprintf(output_fp,"nr_cma_free[order=%d]= %d\n\n", i, input_read_buf);
 	}
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_COMPACT_CONSIDERED), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_COMPACT_CONSIDERED), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
 
 	fprintf(output_fp,"compact_considered= %d\n\n", input_read_buf);
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_COMPACT_DEFER_SHIFT), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_COMPACT_DEFER_SHIFT), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
@@ -1030,7 +1621,7 @@ int Extract_zoneinfo(void)
 
 #define OFFSETOF_PAGES_SCANNED 0x2cc
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_PAGES_SCANNED), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_PAGES_SCANNED), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
@@ -1039,7 +1630,7 @@ int Extract_zoneinfo(void)
 
 #define OFFSETOF_FLAGS 0x2d0
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_FLAGS), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_FLAGS), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
@@ -1062,7 +1653,7 @@ int Extract_zoneinfo(void)
 
 #define OFFSETOF_INACTIVE_RATIO 0x354
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_INACTIVE_RATIO), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_INACTIVE_RATIO), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
@@ -1074,28 +1665,28 @@ int Extract_zoneinfo(void)
 #define OFFSETOF_SPANNED_PAGES 0x36c
 #define OFFSETOF_PRESENT_PAGES 0x370
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_PARENTNODE), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_PARENTNODE), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
 
 	fprintf(output_fp,"parent node= 0x%x\n\n", input_read_buf);
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_ZONE_START_PFN), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_ZONE_START_PFN), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
 
 	fprintf(output_fp,"zone_start_pfn= %d, 0x%x\n\n", input_read_buf, (input_read_buf << PAGE_SHIFT));
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_SPANNED_PAGES), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_SPANNED_PAGES), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
 
 	fprintf(output_fp,"spanned_pages= %d\n\n", input_read_buf);
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_PRESENT_PAGES), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_PRESENT_PAGES), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
@@ -1121,13 +1712,7 @@ int Extract_buddyinfo(void)
 	char name_buf[ZONE_NAME_SIZE + 1];
 	int i;
 
-	//reset system map fp
-	if(fseek(systemmap_fp, 0, 0)) {
-			printf("Error setting the system map file position\n");
-			return -1;
-	}
-
-	output_fp = fopen(output_buddy_info_file_path, "w");
+	output_fp = open_output(output_buddy_info_file_path, "w");
 	if(!output_fp) {
 			printf("Error opening the output file for %s\n", output_buddy_info_file_path);
 			return -1;
@@ -1144,20 +1729,20 @@ int Extract_buddyinfo(void)
 #define OFFSETOF_NODEID 0x728
 
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_NODEID), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_NODEID), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
 
 	fprintf(output_fp,"Node: %d\n", input_read_buf);
 
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_NAME), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address + OFFSETOF_NAME), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
 
 	//read the zone name
-	if(read_buf_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(input_read_buf), ZONE_NAME_SIZE, name_buf)) {
+	if(read_buf_from_ramdump(do_pg_tbl_wlkthr_non_logical(input_read_buf), ZONE_NAME_SIZE, name_buf)) {
 		printf("ERROR:%d",__LINE__);
 		return -1;
 	}
@@ -1174,12 +1759,13 @@ int Extract_buddyinfo(void)
 	for (i = 0; i < MAX_ORDER; ++i) {
 //zone->free_area[order].nr_free
 
-		if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_NRFREE + (i * OFFSETOF_NEXT_NRFEE)), &input_read_buf)) {
+		if(read_uint_from_ramdump(__pa(address + OFFSETOF_NRFREE + (i * OFFSETOF_NEXT_NRFEE)), &input_read_buf)) {
 			printf("ERROR:%d\n",__LINE__);
 			return -1;
 		}
 
 		fprintf(output_fp,"%8d%8d\n", i, input_read_buf);
+		snap_buddy(i, input_read_buf);
 	}
 
 	fprintf(output_fp,"----------------------\n");
@@ -1218,13 +1804,7 @@ int Extract_pagetypeinfo(void)
 #define ARCH_PFN_OFFSET 0
 #define __pfn_to_page(pfn,mem_map)      (mem_map + ((pfn) - ARCH_PFN_OFFSET))
 
-	//reset system map fp
-	if(fseek(systemmap_fp, 0, 0)) {
-			printf("Error setting the system map file position\n");
-			return -1;
-	}
-
-	output_fp = fopen(output_pagetype_info_file_path, "w");
+	output_fp = open_output(output_pagetype_info_file_path, "w");
 	if(!output_fp) {
 			printf("Error opening the output file for %s\n", output_pagetype_info_file_path);
 			return -1;
@@ -1251,21 +1831,21 @@ int Extract_pagetypeinfo(void)
 
 	for (i=0; i < MIGRATE_TYPES ; ++i) {
 
-		if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_NODEID), &input_read_buf)) {
+		if(read_uint_from_ramdump(__pa(address + OFFSETOF_NODEID), &input_read_buf)) {
 			printf("ERROR:%d\n",__LINE__);
 			return -1;
 		}
 
 		fprintf(output_fp,"Node %4d, ", input_read_buf);
 
-		if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_NAME), &input_read_buf)) {
+		if(read_uint_from_ramdump(__pa(address + OFFSETOF_NAME), &input_read_buf)) {
 			printf("ERROR:%d\n",__LINE__);
 			return -1;
 		}
 
 #undef OFFSETOF_NAME
 		//read the zone name
-		if(read_buf_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(input_read_buf), ZONE_NAME_SIZE, name_buf)) {
+		if(read_buf_from_ramdump(do_pg_tbl_wlkthr_non_logical(input_read_buf), ZONE_NAME_SIZE, name_buf)) {
 			printf("ERROR:%d",__LINE__);
 			return -1;
 		}
@@ -1282,7 +1862,7 @@ int Extract_pagetypeinfo(void)
 
 			freecount = 0;
 
-			if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_FREELIST + (j * OFFSETOF_NEXT_FREELIST) + (i * OFFSETOF_NEXT_NEXT)), &input_read_buf)) {
+			if(read_uint_from_ramdump(__pa(address + OFFSETOF_FREELIST + (j * OFFSETOF_NEXT_FREELIST) + (i * OFFSETOF_NEXT_NEXT)), &input_read_buf)) {
 				printf("ERROR:%d\n",__LINE__);
 				return -1;
 			}
@@ -1295,7 +1875,7 @@ int Extract_pagetypeinfo(void)
 				continue;
 			}
 
-			if(read_uint_from_ramdump(ramdump_fp, __pa(input_read_buf), &input_read_buf)) {
+			if(read_uint_from_ramdump(__pa(input_read_buf), &input_read_buf)) {
 				printf("ERROR:%d\n",__LINE__);
 				return -1;
 			}
@@ -1303,7 +1883,7 @@ int Extract_pagetypeinfo(void)
 			while(head != input_read_buf) {
 
 //zone->free_area->free_list[MIGRATE_TPE]
-				if(read_uint_from_ramdump(ramdump_fp, __pa(input_read_buf), &input_read_buf)) {
+				if(read_uint_from_ramdump(__pa(input_read_buf), &input_read_buf)) {
 					printf("ERROR:%d\n",__LINE__);
 					return -1;
 				}
@@ -1312,6 +1892,7 @@ int Extract_pagetypeinfo(void)
 			}
 
 			fprintf(output_fp,"%5lu ", freecount);
+			snap_pagetype(i, j, freecount);
 		}
 
 		fprintf(output_fp,"\n");
@@ -1332,16 +1913,16 @@ void show_locations(unsigned int address)
 	int i = 0;
 	unsigned int input_read_buf=0;
 
-	output_fp = fopen(output_search_result_file_path, "w");
+	output_fp = open_output(output_search_result_file_path, "w");
 	if(!output_fp) {
 			printf("Error opening the output file for %s\n", output_search_result_file_path);
 			return;
 	}
 
-	while(!feof(ramdump_fp) && !ferror(ramdump_fp)) {
-            if(read_uint_from_ramdump(ramdump_fp, RAM_START + i, &input_read_buf)) {
+	while((unsigned long long)i + 4 <= cur_dump->size) {
+            if(read_uint_from_ramdump(RAM_START + i, &input_read_buf)) {
             	//printf("ERROR:%d",__LINE__);
-            	return;
+            	break;
 			}
 			if (input_read_buf == address) {
 			//	if (((RAM_START + i) % 64) == 52) {
@@ -1370,13 +1951,7 @@ int Decode_cache_chain_and_slab_info(void)
 #define KMEMCACHE_NAME_SIZE	20
 	char name_buf[KMEMCACHE_NAME_SIZE + 1];
 
-	//reset system map fp
-	if(fseek(systemmap_fp, 0, 0)) {
-			printf("Error setting the system map file position\n");
-			return -1;
-	}
-
-	output_fp = fopen(output_cache_chain_file_path, "w");
+	output_fp = open_output(output_cache_chain_file_path, "w");
 	if(!output_fp) {
 			printf("Error opening the output file for %s\n", output_cache_chain_file_path);
 			return -1;
@@ -1393,7 +1968,7 @@ int Decode_cache_chain_and_slab_info(void)
 	fprintf(output_fp,"---------------------------------\n");
 
 	//address first next of cache chain
-	if(read_uint_from_ramdump(ramdump_fp, __pa(address), &input_read_buf)) {
+	if(read_uint_from_ramdump(__pa(address), &input_read_buf)) {
 		printf("ERROR:%d\n",__LINE__);
 		return -1;
 	}
@@ -1405,6 +1980,8 @@ int Decode_cache_chain_and_slab_info(void)
 
 	do {
 
+		active_objs = active_slabs = num_slabs = free_objects = shared_avail = 0;
+
 		fprintf(output_fp,"next: 0x%x\n", address);
 
 		//get the container i.e. struct kmem_cache from next.
@@ -1418,13 +1995,13 @@ int Decode_cache_chain_and_slab_info(void)
 #define OFFSETOF_KEMEMCACHE_NAME 0x40
 
 	//read the name address.
-		if(read_uint_from_ramdump(ramdump_fp, __pa(address + OFFSETOF_KEMEMCACHE_NAME), &input_read_buf)) {
+		if(read_uint_from_ramdump(__pa(address + OFFSETOF_KEMEMCACHE_NAME), &input_read_buf)) {
 			printf("ERROR:%d\n",__LINE__);
 			return -1;
 		}
 
 		//read the name
-		if(read_buf_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(input_read_buf), KMEMCACHE_NAME_SIZE, name_buf)) {
+		if(read_buf_from_ramdump(do_pg_tbl_wlkthr_non_logical(input_read_buf), KMEMCACHE_NAME_SIZE, name_buf)) {
 			printf("ERROR:%d",__LINE__);
 			//return -1;
 		}
@@ -1436,7 +2013,7 @@ int Decode_cache_chain_and_slab_info(void)
 #define OFFSETOF_NODELIST 0x4c
 
 //l3
-		if(read_uint_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(address + OFFSETOF_NODELIST), &input_read_buf)) {
+		if(read_uint_from_ramdump(do_pg_tbl_wlkthr_non_logical(address + OFFSETOF_NODELIST), &input_read_buf)) {
 			printf("ERROR:%d",__LINE__);
 			//return -1;
 		}
@@ -1450,7 +2027,7 @@ int Decode_cache_chain_and_slab_info(void)
 
 //slabs_full
 
-		if(read_uint_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(temp + OFFSETOF_SLABSFULL), &input_read_buf)) {
+		if(read_uint_from_ramdump(do_pg_tbl_wlkthr_non_logical(temp + OFFSETOF_SLABSFULL), &input_read_buf)) {
 			printf("ERROR:%d",__LINE__);
 			//return -1;
 		}
@@ -1462,7 +2039,7 @@ int Decode_cache_chain_and_slab_info(void)
 		//parse through the slab full list
 		while (temp != input_read_buf) {
 
-			if(read_uint_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(address + OFFSETOF_NUM), &input_read_buf2)) {
+			if(read_uint_from_ramdump(do_pg_tbl_wlkthr_non_logical(address + OFFSETOF_NUM), &input_read_buf2)) {
 				printf("ERROR:%d",__LINE__);
 				//return -1;
 			}
@@ -1470,7 +2047,7 @@ int Decode_cache_chain_and_slab_info(void)
 			active_objs += input_read_buf2;
 			active_slabs++;
 
-			if(read_uint_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(input_read_buf), &input_read_buf)) {
+			if(read_uint_from_ramdump(do_pg_tbl_wlkthr_non_logical(input_read_buf), &input_read_buf)) {
 				printf("ERROR:%d",__LINE__);
 				//return -1;
 			}
@@ -1479,7 +2056,7 @@ int Decode_cache_chain_and_slab_info(void)
 
 //slabs_partial
 
-		if(read_uint_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(address + OFFSETOF_NODELIST), &input_read_buf)) {
+		if(read_uint_from_ramdump(do_pg_tbl_wlkthr_non_logical(address + OFFSETOF_NODELIST), &input_read_buf)) {
 			printf("ERROR:%d",__LINE__);
 			//return -1;
 		}
@@ -1492,7 +2069,7 @@ int Decode_cache_chain_and_slab_info(void)
 #define OFFSETOF_SLABSPARTIAL 0x0
 
 //next
-		if(read_uint_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(temp + OFFSETOF_SLABSPARTIAL), &input_read_buf)) {
+		if(read_uint_from_ramdump(do_pg_tbl_wlkthr_non_logical(temp + OFFSETOF_SLABSPARTIAL), &input_read_buf)) {
 			printf("ERROR:%d",__LINE__);
 			//return -1;
 		}
@@ -1505,7 +2082,7 @@ int Decode_cache_chain_and_slab_info(void)
 //slab->inuse
 #define OFFSETOF_INUSE 0x10
 
-			if(read_uint_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(input_read_buf + OFFSETOF_INUSE), &input_read_buf2)) {
+			if(read_uint_from_ramdump(do_pg_tbl_wlkthr_non_logical(input_read_buf + OFFSETOF_INUSE), &input_read_buf2)) {
 				printf("ERROR:%d",__LINE__);
 				//return -1;
 			}
@@ -1513,7 +2090,7 @@ int Decode_cache_chain_and_slab_info(void)
 			//active_objs += input_read_buf2;
 			active_slabs++;
 
-			if(read_uint_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(input_read_buf), &input_read_buf)) {
+			if(read_uint_from_ramdump(do_pg_tbl_wlkthr_non_logical(input_read_buf), &input_read_buf)) {
 				printf("ERROR:%d",__LINE__);
 				//return -1;
 			}
@@ -1522,7 +2099,7 @@ int Decode_cache_chain_and_slab_info(void)
 
 //slabs_free
 
-		if(read_uint_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(address + OFFSETOF_NODELIST), &input_read_buf)) {
+		if(read_uint_from_ramdump(do_pg_tbl_wlkthr_non_logical(address + OFFSETOF_NODELIST), &input_read_buf)) {
 			printf("ERROR:%d",__LINE__);
 			//return -1;
 		}
@@ -1534,7 +2111,7 @@ int Decode_cache_chain_and_slab_info(void)
 
 #define OFFSETOF_SLABSFREE 0x10
 
-		if(read_uint_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(temp + OFFSETOF_SLABSFREE), &input_read_buf)) {
+		if(read_uint_from_ramdump(do_pg_tbl_wlkthr_non_logical(temp + OFFSETOF_SLABSFREE), &input_read_buf)) {
 			printf("ERROR:%d",__LINE__);
 			//return -1;
 		}
@@ -1546,7 +2123,7 @@ int Decode_cache_chain_and_slab_info(void)
 
 			num_slabs++;
 
-			if(read_uint_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(input_read_buf), &input_read_buf)) {
+			if(read_uint_from_ramdump(do_pg_tbl_wlkthr_non_logical(input_read_buf), &input_read_buf)) {
 				printf("ERROR:%d",__LINE__);
 				//return -1;
 			}
@@ -1555,7 +2132,7 @@ int Decode_cache_chain_and_slab_info(void)
 
 #define OFFSETOF_FREEOBJECTS 0x18
 
-		if(read_uint_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(address + OFFSETOF_NODELIST), &input_read_buf)) {
+		if(read_uint_from_ramdump(do_pg_tbl_wlkthr_non_logical(address + OFFSETOF_NODELIST), &input_read_buf)) {
 			printf("ERROR:%d",__LINE__);
 			//return -1;
 		}
@@ -1565,7 +2142,7 @@ int Decode_cache_chain_and_slab_info(void)
 
 		temp = input_read_buf;
 
-		if(read_uint_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(temp + OFFSETOF_FREEOBJECTS), &input_read_buf)) {
+		if(read_uint_from_ramdump(do_pg_tbl_wlkthr_non_logical(temp + OFFSETOF_FREEOBJECTS), &input_read_buf)) {
 			printf("ERROR:%d",__LINE__);
 			//return -1;
 		}
@@ -1574,7 +2151,7 @@ int Decode_cache_chain_and_slab_info(void)
 
 #define OFFSETOF_SHARED 0x24
 
-		if(read_uint_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(temp + OFFSETOF_SHARED), &input_read_buf)) {
+		if(read_uint_from_ramdump(do_pg_tbl_wlkthr_non_logical(temp + OFFSETOF_SHARED), &input_read_buf)) {
 			printf("ERROR:%d",__LINE__);
 			//return -1;
 		}
@@ -1585,7 +2162,7 @@ int Decode_cache_chain_and_slab_info(void)
 #define OFFSETOF_SHAREDAVAIL 0x0
 //cachep->nodelist->shared->avail
 
-				if(read_uint_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(input_read_buf + OFFSETOF_SHAREDAVAIL), &input_read_buf)) {
+				if(read_uint_from_ramdump(do_pg_tbl_wlkthr_non_logical(input_read_buf + OFFSETOF_SHAREDAVAIL), &input_read_buf)) {
 					printf("ERROR:%d",__LINE__);
 					//return -1;
 				}
@@ -1596,7 +2173,7 @@ int Decode_cache_chain_and_slab_info(void)
 		num_slabs += active_slabs;
 
 		//cachep->num
-		if(read_uint_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(address + OFFSETOF_NUM), &input_read_buf2)) {
+		if(read_uint_from_ramdump(do_pg_tbl_wlkthr_non_logical(address + OFFSETOF_NUM), &input_read_buf2)) {
 			printf("ERROR:%d",__LINE__);
 			//return -1;
 		}
@@ -1611,32 +2188,33 @@ int Decode_cache_chain_and_slab_info(void)
 
 #define OFFSETOF_BUFFERSIZE 0x10
 
-		if(read_uint_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(address + OFFSETOF_BUFFERSIZE), &input_read_buf2)) {
+		if(read_uint_from_ramdump(do_pg_tbl_wlkthr_non_logical(address + OFFSETOF_BUFFERSIZE), &input_read_buf2)) {
 			printf("ERROR:%d",__LINE__);
 			//return -1;
 		}
 
 		fprintf(output_fp,"cache->buffer_size: %d\n",input_read_buf2);
+		snap_cache(name_buf, active_objs, num_objs, input_read_buf2);
 
 #define OFFSETOF_LIMIT 0x08
 #define OFFSETOF_BATCHCOUNT 0x04
 #define OFFSETOF_SHARED 0x0c
 
-		if(read_uint_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(address + OFFSETOF_LIMIT), &input_read_buf2)) {
+		if(read_uint_from_ramdump(do_pg_tbl_wlkthr_non_logical(address + OFFSETOF_LIMIT), &input_read_buf2)) {
 			printf("ERROR:%d",__LINE__);
 			//return -1;
 		}
 
 		fprintf(output_fp,"cache->limit: %d\n",input_read_buf2);
 
-		if(read_uint_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(address + OFFSETOF_BATCHCOUNT), &input_read_buf2)) {
+		if(read_uint_from_ramdump(do_pg_tbl_wlkthr_non_logical(address + OFFSETOF_BATCHCOUNT), &input_read_buf2)) {
 			printf("ERROR:%d",__LINE__);
 			//return -1;
 		}
 
 		fprintf(output_fp,"cache->batchcount: %d\n",input_read_buf2);
 
-		if(read_uint_from_ramdump(ramdump_fp, do_pg_tbl_wlkthr_non_logical(address + OFFSETOF_SHARED), &input_read_buf2)) {
+		if(read_uint_from_ramdump(do_pg_tbl_wlkthr_non_logical(address + OFFSETOF_SHARED), &input_read_buf2)) {
 			printf("ERROR:%d",__LINE__);
 			//return -1;
 		}
@@ -1653,7 +2231,7 @@ next:
 		address = address + OFFSETOF_KMEMCACHE_NEXT;
 
 		//read the name address.
-		if(read_uint_from_ramdump(ramdump_fp, __pa(address), &input_read_buf)) {
+		if(read_uint_from_ramdump(__pa(address), &input_read_buf)) {
 			printf("ERROR:%d\n",__LINE__);
 			return -1;
 		}
@@ -1664,19 +2242,15 @@ next:
 
 	} while(address != list_head);
 
+	fclose(output_fp);
+
 	return 0;
 
 }
 
 int Extract_virt_mem_layout(void)
 {
-	//reset system map fp
-	if(fseek(systemmap_fp, 0, 0)) {
-			printf("Error setting the system map file position\n");
-			return -1;
-	}
-
-	output_fp = fopen(output_virt_layout_file_path, "w");
+	output_fp = open_output(output_virt_layout_file_path, "w");
 	if(!output_fp) {
 			printf("Error opening the output file for %s\n", output_virt_layout_file_path);
 			return -1;
@@ -1704,142 +2278,142 @@ int do_virt_to_phy(unsigned int address)
 	pgd = get_addr_from_smap("swapper_pg_dir", 14);
 	pgd = __pa(pgd);
 
-	printf("Virtual address: 0x%x\n",address);
-	printf("PGD: 0x%x\n",pgd);
+	fprintf(output_fp,"Virtual address: 0x%x\n",address);
+	fprintf(output_fp,"PGD: 0x%x\n",pgd);
 
 	pa_fld = (pgd & 0xFFFFC000);
 	pa_fld |= ((address & 0xFFF00000) >> 18);
 
-	printf("Level 1 descriptor: 0x%x\n",pa_fld);
+	fprintf(output_fp,"Level 1 descriptor: 0x%x\n",pa_fld);
 
-	if(read_uint_from_ramdump(ramdump_fp, pa_fld, &input_read_buf)) {
-		printf("ERROR:%d\n",__LINE__);
+	if(read_uint_from_ramdump(pa_fld, &input_read_buf)) {
+		fprintf(output_fp,"ERROR:%d\n",__LINE__);
 		return -1;
 	}
 
-	printf("Content of Level 1 descriptor: 0x%x\n",input_read_buf);
+	fprintf(output_fp,"Content of Level 1 descriptor: 0x%x\n",input_read_buf);
 
 	if (!(input_read_buf & 0x3)) { //[1:0]->00
-		printf("Level 1 indicates FAULT\n");
+		fprintf(output_fp,"Level 1 indicates FAULT\n");
 		return 0;
 	}
 
 	if ((input_read_buf & 0x2) && (input_read_buf & 0x1)) {//[1:0]->11
-		printf("Level 1 indicates RESERVED\n");
+		fprintf(output_fp,"Level 1 indicates RESERVED\n");
 		return 0;
 	}
 
 	if ((input_read_buf & 0x2) && (!(input_read_buf & 0x1))) {//[1:0]->10, section or super section
 
 		if (input_read_buf & (0x1 << 18)) {//super section
-			printf("SUPER SECTION(16MB)\n");
+			fprintf(output_fp,"SUPER SECTION(16MB)\n");
 			pa = (input_read_buf & 0xFF000000);
 			pa |= (address & 0x0FFFFFF);
-			printf("Physical address: 0x%x\n", pa);
+			fprintf(output_fp,"Physical address: 0x%x\n", pa);
 
-			printf("Attributes:\n");
-			printf("-----------\n");
+			fprintf(output_fp,"Attributes:\n");
+			fprintf(output_fp,"-----------\n");
 
 			//shareable
 			if (input_read_buf & (0x1 << 16))
-				printf("Shareable\n");
+				fprintf(output_fp,"Shareable\n");
 			else
-				printf("Non-Shareable\n");
+				fprintf(output_fp,"Non-Shareable\n");
 
 			if (!(input_read_buf & (0x1 << 15))) {
 				if ((!(input_read_buf & (0x1 << 11))) && (!(input_read_buf & (0x1 << 10))))
-					printf("P:no access,U:no access\n");
+					fprintf(output_fp,"P:no access,U:no access\n");
 				else if ((!(input_read_buf & (0x1 << 11))) && ((input_read_buf & (0x1 << 10))))
-					printf("P:R/W,U:no access\n");
+					fprintf(output_fp,"P:R/W,U:no access\n");
 				else if (((input_read_buf & (0x1 << 11))) && (!(input_read_buf & (0x1 << 10))))
-					printf("P:R/W,U:RO\n");
+					fprintf(output_fp,"P:R/W,U:RO\n");
 				else if (((input_read_buf & (0x1 << 11))) && ((input_read_buf & (0x1 << 10))))
-					printf("P:R/W,U:R/W\n");
+					fprintf(output_fp,"P:R/W,U:R/W\n");
 			} else {
 				if ((!(input_read_buf & (0x1 << 11))) && (!(input_read_buf & (0x1 << 10))))
-					printf("RESERVED\n");
+					fprintf(output_fp,"RESERVED\n");
 				else if ((!(input_read_buf & (0x1 << 11))) && ((input_read_buf & (0x1 << 10))))
-					printf("P:RO,U:no access\n");
+					fprintf(output_fp,"P:RO,U:no access\n");
 				else if (((input_read_buf & (0x1 << 11))) && (!(input_read_buf & (0x1 << 10))))
-					printf("P:RO,U:RO\n");
+					fprintf(output_fp,"P:RO,U:RO\n");
 				else if (((input_read_buf & (0x1 << 11))) && ((input_read_buf & (0x1 << 10))))
-					printf("P:RO,U:RO\n");
+					fprintf(output_fp,"P:RO,U:RO\n");
 			}
 
 			//XN
 			if (input_read_buf & (0x1 << 4)) {
-				printf("NO EXEC\n");
+				fprintf(output_fp,"NO EXEC\n");
 			} else {
-				printf("EXEC\n");
+				fprintf(output_fp,"EXEC\n");
 			}
 
 			//nG
 			if (input_read_buf & (0x1 << 17)) {
-				printf("nG set\n");
+				fprintf(output_fp,"nG set\n");
 			} else {
-				printf("nG not set\n");
+				fprintf(output_fp,"nG not set\n");
 			}
 
 			//NS
 			if (input_read_buf & (0x1 << 19)) {
-				printf("non-secure, if secure page table\n");
+				fprintf(output_fp,"non-secure, if secure page table\n");
 			} else {
-				printf("secure, if secure page table\n");
+				fprintf(output_fp,"secure, if secure page table\n");
 			}
 
 			return 0;
 
 		} else { //section
-			printf("SECTION(1MB)\n");
+			fprintf(output_fp,"SECTION(1MB)\n");
 			pa = (input_read_buf & 0xFFF00000);
 			pa |= (address & 0x00FFFFF);
-			printf("Physical address: 0x%x\n",pa);
+			fprintf(output_fp,"Physical address: 0x%x\n",pa);
 
 			//shareable
 			if (input_read_buf & (0x1 << 16))
-				printf("Shareable\n");
+				fprintf(output_fp,"Shareable\n");
 			else
-				printf("Non-Shareable\n");
+				fprintf(output_fp,"Non-Shareable\n");
 
 			if (!(input_read_buf & (0x1 << 15))) {
 				if ((!(input_read_buf & (0x1 << 11))) && (!(input_read_buf & (0x1 << 10))))
-					printf("P:no access,U:no access\n");
+					fprintf(output_fp,"P:no access,U:no access\n");
 				else if ((!(input_read_buf & (0x1 << 11))) && ((input_read_buf & (0x1 << 10))))
-					printf("P:R/W,U:no access\n");
+					fprintf(output_fp,"P:R/W,U:no access\n");
 				else if (((input_read_buf & (0x1 << 11))) && (!(input_read_buf & (0x1 << 10))))
-					printf("P:R/W,U:RO\n");
+					fprintf(output_fp,"P:R/W,U:RO\n");
 				else if (((input_read_buf & (0x1 << 11))) && ((input_read_buf & (0x1 << 10))))
-					printf("P:R/W,U:R/W\n");
+					fprintf(output_fp,"P:R/W,U:R/W\n");
 			} else {
 				if ((!(input_read_buf & (0x1 << 11))) && (!(input_read_buf & (0x1 << 10))))
-					printf("RESERVED\n");
+					fprintf(output_fp,"RESERVED\n");
 				else if ((!(input_read_buf & (0x1 << 11))) && ((input_read_buf & (0x1 << 10))))
-					printf("P:RO,U:no access\n");
+					fprintf(output_fp,"P:RO,U:no access\n");
 				else if (((input_read_buf & (0x1 << 11))) && (!(input_read_buf & (0x1 << 10))))
-					printf("P:RO,U:RO\n");
+					fprintf(output_fp,"P:RO,U:RO\n");
 				else if (((input_read_buf & (0x1 << 11))) && ((input_read_buf & (0x1 << 10))))
-					printf("P:RO,U:RO\n");
+					fprintf(output_fp,"P:RO,U:RO\n");
 			}
 
 			//XN
 			if (input_read_buf & (0x1 << 4)) {
-				printf("NO EXEC\n");
+				fprintf(output_fp,"NO EXEC\n");
 			} else {
-				printf("EXEC\n");
+				fprintf(output_fp,"EXEC\n");
 			}
 
 			//nG
 			if (input_read_buf & (0x1 << 17)) {
-				printf("nG set\n");
+				fprintf(output_fp,"nG set\n");
 			} else {
-				printf("nG not set\n");
+				fprintf(output_fp,"nG not set\n");
 			}
 
 			//NS
 			if (input_read_buf & (0x1 << 19)) {
-				printf("non-secure, if secure page table\n");
+				fprintf(output_fp,"non-secure, if secure page table\n");
 			} else {
-				printf("secure, if secure page table\n");
+				fprintf(output_fp,"secure, if secure page table\n");
 			}
 
 			return 0;
@@ -1853,83 +2427,83 @@ int do_virt_to_phy(unsigned int address)
 	pa_sld = (input_read_buf & 0xFFFFFC00);
 	pa_sld |= ((address & 0x000FF000) >> 10);
 
-	printf("Level 2 descriptor: 0x%x\n",pa_sld);
+	fprintf(output_fp,"Level 2 descriptor: 0x%x\n",pa_sld);
 
-	if(read_uint_from_ramdump(ramdump_fp, pa_sld, &input_read_buf)) {
-		printf("ERROR:%d\n",__LINE__);
+	if(read_uint_from_ramdump(pa_sld, &input_read_buf)) {
+		fprintf(output_fp,"ERROR:%d\n",__LINE__);
 		return -1;
 	}
 
-	printf("Content of Level 2 descriptor: 0x%x\n",input_read_buf);
+	fprintf(output_fp,"Content of Level 2 descriptor: 0x%x\n",input_read_buf);
 
 	if (input_read_buf & 0x2) { //Small page
-		printf("SMALL PAGE(4k)\n");
+		fprintf(output_fp,"SMALL PAGE(4k)\n");
 		pa =  input_read_buf & 0xFFFFF000;
 		pa |= address & 0x00000FFF;
 	} else { //Large page
-		printf("LARGE PAGE(64k)\n");
+		fprintf(output_fp,"LARGE PAGE(64k)\n");
 		pa =  input_read_buf & 0xFFFF0000;
 		pa |= address & 0x0000FFFF;
 	}
 
-	printf("Physical address: 0x%x\n",pa);
+	fprintf(output_fp,"Physical address: 0x%x\n",pa);
 
 	//shareable
 	if (input_read_buf & (0x1 << 10))
-		printf("Shareable\n");
+		fprintf(output_fp,"Shareable\n");
 	else
-		printf("Non-Shareable\n");
+		fprintf(output_fp,"Non-Shareable\n");
 
 
 	if (!(input_read_buf & (0x1 << 9))) {
 		if ((!(input_read_buf & (0x1 << 5))) && (!(input_read_buf & (0x1 << 4))))
-			printf("P:no access,U:no access\n");
+			fprintf(output_fp,"P:no access,U:no access\n");
 		else if ((!(input_read_buf & (0x1 << 5))) && ((input_read_buf & (0x1 << 4))))
-			printf("P:R/W,U:no access\n");
+			fprintf(output_fp,"P:R/W,U:no access\n");
 		else if (((input_read_buf & (0x1 << 5))) && (!(input_read_buf & (0x1 << 4))))
-			printf("P:R/W,U:RO\n");
+			fprintf(output_fp,"P:R/W,U:RO\n");
 		else if (((input_read_buf & (0x1 << 5))) && ((input_read_buf & (0x1 << 4))))
-			printf("P:R/W,U:R/W\n");
+			fprintf(output_fp,"P:R/W,U:R/W\n");
 	} else {
 		if ((!(input_read_buf & (0x1 << 5))) && (!(input_read_buf & (0x1 << 4))))
-			printf("RESERVED\n");
+			fprintf(output_fp,"RESERVED\n");
 		else if ((!(input_read_buf & (0x1 << 5))) && ((input_read_buf & (0x1 << 4))))
-			printf("P:RO,U:no access\n");
+			fprintf(output_fp,"P:RO,U:no access\n");
 		else if (((input_read_buf & (0x1 << 5))) && (!(input_read_buf & (0x1 << 4))))
-			printf("P:RO,U:RO\n");
+			fprintf(output_fp,"P:RO,U:RO\n");
 		else if (((input_read_buf & (0x1 << 5))) && ((input_read_buf & (0x1 << 4))))
-			printf("P:RO,U:RO\n");
+			fprintf(output_fp,"P:RO,U:RO\n");
 	}
 
 	if (input_read_buf & 0x2) { //Small page
 		//XN
 		if (input_read_buf & (0x1 << 1)) {
-			printf("NO EXEC\n");
+			fprintf(output_fp,"NO EXEC\n");
 		} else {
-			printf("EXEC\n");
+			fprintf(output_fp,"EXEC\n");
 		}
 	} else {
 		//XN
 		if (input_read_buf & (0x1 << 15)) {
-			printf("NO EXEC\n");
+			fprintf(output_fp,"NO EXEC\n");
 		} else {
-			printf("EXEC\n");
+			fprintf(output_fp,"EXEC\n");
 		}
 	}
 
 	//nG
 	if (input_read_buf & (0x1 << 11)) {
-		printf("nG set\n");
+		fprintf(output_fp,"nG set\n");
 	} else {
-		printf("nG not set\n");
+		fprintf(output_fp,"nG not set\n");
 	}
 
 
 	//NS
 	if (input_read_buf & (0x1 << 3)) {
-		printf("non-secure, if secure page table\n");
+		fprintf(output_fp,"non-secure, if secure page table\n");
 	} else {
-		printf("secure, if secure page table\n");
+		fprintf(output_fp,"secure, if secure page table\n");
 	}
 
 	return 0;
@@ -1945,12 +2519,6 @@ int Validate_sections(void)
 	unsigned int bss_end = 0;
 	unsigned int address = 0;
 
-	//reset system map fp
-	if(fseek(systemmap_fp, 0, 0)) {
-			printf("Error setting the system map file position\n");
-			return -1;
-	}
-
 	text_start = get_addr_from_smap("_text", 5);
 	text_end = get_addr_from_smap("_etext", 6);
 	data_start = get_addr_from_smap("_sdata", 6);
@@ -1987,13 +2555,16 @@ unsigned int do_pg_tbl_wlkthr_non_logical(unsigned int address)
 	unsigned int input_read_buf=0;
 	unsigned int pgd, pa_fld, pa_sld, pa, saved_fld;
 
+	if(cur_stats)
+		cur_stats->walks++;
+
 	pgd = get_addr_from_smap("swapper_pg_dir", 14);
 	pgd = __pa(pgd);
 
 	pa_fld = (pgd & 0xFFFFC000);
 	pa_fld |= ((address & 0xFFF00000) >> 18);
 
-	if(read_uint_from_ramdump(ramdump_fp, pa_fld, &input_read_buf)) {
+	if(read_uint_from_ramdump(pa_fld, &input_read_buf)) {
 		printf("ERROR detected in reading at address 0x%x:%d\n",address, __LINE__);
 		return -1;
 	}
@@ -2031,7 +2602,7 @@ unsigned int do_pg_tbl_wlkthr_non_logical(unsigned int address)
 	pa_sld = (input_read_buf & 0xFFFFFC00);
 	pa_sld |= ((address & 0x000FF000) >> 10);
 
-	if(read_uint_from_ramdump(ramdump_fp, pa_sld, &input_read_buf)) {
+	if(read_uint_from_ramdump(pa_sld, &input_read_buf)) {
 		printf("ERROR in reading for address 0x%x:%d\n",address, __LINE__);
 		return -1;
 	}
@@ -2055,13 +2626,16 @@ unsigned int do_pg_tbl_wlkthr_logical(unsigned int address)
 	unsigned int input_read_buf=0;
 	unsigned int pgd, pa_fld, pa_sld, pa, saved_fld;
 
+	if(cur_stats)
+		cur_stats->walks++;
+
 	pgd = get_addr_from_smap("swapper_pg_dir", 14);
 	pgd = __pa(pgd);
 
 	pa_fld = (pgd & 0xFFFFC000);
 	pa_fld |= ((address & 0xFFF00000) >> 18);
 
-	if(read_uint_from_ramdump(ramdump_fp, pa_fld, &input_read_buf)) {
+	if(read_uint_from_ramdump(pa_fld, &input_read_buf)) {
 		printf("ERROR detected in reading at address 0x%x:%d\n",address, __LINE__);
 		return -1;
 	}
@@ -2108,7 +2682,7 @@ unsigned int do_pg_tbl_wlkthr_logical(unsigned int address)
 	pa_sld = (input_read_buf & 0xFFFFFC00);
 	pa_sld |= ((address & 0x000FF000) >> 10);
 
-	if(read_uint_from_ramdump(ramdump_fp, pa_sld, &input_read_buf)) {
+	if(read_uint_from_ramdump(pa_sld, &input_read_buf)) {
 		printf("ERROR in reading for address 0x%x:%d\n",address, __LINE__);
 		return -1;
 	}
@@ -2137,20 +2711,11 @@ unsigned int do_pg_tbl_wlkthr_logical(unsigned int address)
 int Extract_smap_pgtbl(void)
 {
 	unsigned int address;
-	unsigned char smap_buf[150];
-	char* symbol;
 	unsigned int input_read_buf=0;
 	unsigned int pgd, pa_fld, pa_sld, pa, saved_fld;
+	unsigned int i;
 
-#define SYSMAP_LINE_SIZE 149
-
-	//reset system map fp
-	if(fseek(systemmap_fp, 0, 0)) {
-			printf("Error setting the system map file position\n");
-			return -1;
-	}
-
-	output_fp = fopen(output_smap_pgtbl_file_path, "w");
+	output_fp = open_output(output_smap_pgtbl_file_path, "w");
 	if(!output_fp) {
 			printf("Error opening the output file for smap pgtbl%s\n", output_smap_pgtbl_file_path);
 			return -1;
@@ -2163,22 +2728,11 @@ int Extract_smap_pgtbl(void)
 	pgd = get_addr_from_smap("swapper_pg_dir", 14);
 	pgd = __pa(pgd);
 
-	//reset system map fp
-	if(fseek(systemmap_fp, 0, 0)) {
-			printf("Error setting the system map file position\n");
-			return -1;
-	}
-
-    while(!feof(systemmap_fp) && !ferror(systemmap_fp)) {
+    for(i = 0; i < cur_dump->smap->nr_syms; i++) {
 
-	   if(!(fgets(smap_buf, SYSMAP_LINE_SIZE, systemmap_fp))) {
-			return 0;
-	   }
-	   address = strtoul(strtok(smap_buf," "), NULL, 16);
-	   while(symbol =  strtok(NULL," ")) {
-			if(symbol[0] == '$')
-				  address = 9999; //invalid
-	   }
+	   address = cur_dump->smap->syms[i].address;
+	   if(cur_dump->smap->syms[i].mapping)
+			address = 9999; //invalid
 
 	   if (address < 0xc0000000)
 	   		continue;
@@ -2193,7 +2747,7 @@ int Extract_smap_pgtbl(void)
 
 	   		fprintf(output_fp,"%20x",pa_fld);
 
-            if(read_uint_from_ramdump(ramdump_fp, pa_fld, &input_read_buf)) {
+            if(read_uint_from_ramdump(pa_fld, &input_read_buf)) {
             	printf("ERROR:%d",__LINE__);
             	return -1;
 			}
@@ -2347,7 +2901,7 @@ int Extract_smap_pgtbl(void)
 
 			fprintf(output_fp,"%20x",pa_sld);
 
-            if(read_uint_from_ramdump(ramdump_fp, pa_sld, &input_read_buf)) {
+            if(read_uint_from_ramdump(pa_sld, &input_read_buf)) {
             	printf("ERROR:%d",__LINE__);
             	return -1;
 			}
@@ -2435,70 +2989,116 @@ int Extract_smap_pgtbl(void)
 	return 0;
 }
 
-int Extract_irq_desc(void)
+/*
+ * With CONFIG_SPARSE_IRQ the descriptors are not in a flat irq_desc[]
+ * array, but are allocated on demand and hung off irq_desc_tree, a
+ * radix tree indexed by the irq number. The walker below reads each
+ * tree node in one go and keeps the internal nodes cached, since every
+ * lookup from 0 to nr_irqs passes through the same few nodes.
+ */
+#define RADIX_TREE_MAP_SHIFT 6
+#define RADIX_TREE_MAP_SIZE (1UL << RADIX_TREE_MAP_SHIFT)
+#define RADIX_TREE_MAP_MASK (RADIX_TREE_MAP_SIZE - 1)
+#define RADIX_TREE_INDIRECT_PTR 1
+#define RADIX_TREE_NODE_CACHE_SIZE 64
+
+#define OFFSETOF_ROOT_HEIGHT 0x0
+#define OFFSETOF_ROOT_RNODE 0x8
+#define OFFSETOF_NODE_HEIGHT 0x0
+#define OFFSETOF_NODE_SLOTS 0x10
+
+struct radix_tree_node_cache {
+	unsigned int address;
+	unsigned int slots[RADIX_TREE_MAP_SIZE];
+};
+
+static unsigned int* radix_tree_get_node_slots(struct radix_tree_node_cache *cache, unsigned int node)
 {
+	struct radix_tree_node_cache *entry;
 
-#define NO_OF_IRQS 492
-#define IRQ_DESC_SIZE 0x60
+	entry = &cache[(node >> 8) % RADIX_TREE_NODE_CACHE_SIZE];
+	if (entry->address == node)
+		return entry->slots;
 
-		unsigned int address;
-        int irqs = 0;
-        unsigned int input_read_buf=0;
-        unsigned int input_read_buf2=0;
-        char name_buf[15];
+	//read all the slots of the node in one shot
+	if(read_buf_from_ramdump(__pa(node + OFFSETOF_NODE_SLOTS), sizeof(entry->slots), (char*)entry->slots)) {
+		printf("ERROR:%d\n",__LINE__);
+		entry->address = 0;
+		return NULL;
+	}
 
-        //reset system map fp
-        if(fseek(systemmap_fp, 0, 0)) {
-                printf("Error setting the system map file position\n");
-                return -1;
-        }
+	entry->address = node;
+	return entry->slots;
+}
 
-        output_fp = fopen(output_irq_file_path, "w");
-        if(!output_fp) {
-                printf("Error opening the output file for irq desc%s\n", output_irq_file_path);
-                return -1;
-        }
+//returns the item at index, 0 if there is none. cache holds
+//RADIX_TREE_NODE_CACHE_SIZE nodes, one per walk of the tree.
+unsigned int radix_tree_lookup(struct radix_tree_node_cache *cache, unsigned int root, unsigned int index)
+{
+	unsigned int height, shift, node;
+	unsigned int *slots;
 
-		address = get_addr_from_smap("irq_desc", 8);
+	if(read_uint_from_ramdump(__pa(root + OFFSETOF_ROOT_HEIGHT), &height))
+		return 0;
 
-		fprintf(output_fp,"%s","Bit masks for state_use_accessors\n");
-		fprintf(output_fp,"%s","IRQD_TRIGGER_MASK               = 0xf\n");
-		fprintf(output_fp,"%s","IRQD_SETAFFINITY_PENDING        = (1 <<  8)\n");
-		fprintf(output_fp,"%s","IRQD_NO_BALANCING               = (1 << 10)\n");
-		fprintf(output_fp,"%s","IRQD_PER_CPU                    = (1 << 11)\n");
-		fprintf(output_fp,"%s","IRQD_AFFINITY_SET               = (1 << 12)\n");
-		fprintf(output_fp,"%s","IRQD_LEVEL                      = (1 << 13)\n");
-		fprintf(output_fp,"%s","IRQD_WAKEUP_STATE               = (1 << 14)\n");
-		fprintf(output_fp,"%s","IRQD_MOVE_PCNTXT                = (1 << 15)\n");
-		fprintf(output_fp,"%s","IRQD_IRQ_DISABLED               = (1 << 16)\n");
-		fprintf(output_fp,"%s","IRQD_IRQ_MASKED                 = (1 << 17)\n");
-		fprintf(output_fp,"%s","IRQD_IRQ_INPROGRESS             = (1 << 18)\n");
-		fprintf(output_fp,"%s","-------------------------------------------\n");
+	if(read_uint_from_ramdump(__pa(root + OFFSETOF_ROOT_RNODE), &node))
+		return 0;
 
-        fprintf(output_fp,"%15s%15s%20s%15s%20s%20s\n","IRQ_NUMBER","KSTAT_IRQS", "STATE_USE_ACCESSORS", "CHIP-NAME", "HANDLER", "DEV_NAME");
+	if (!node)
+		return 0;
+
+	//direct pointer, the tree holds only index 0
+	if (!(node & RADIX_TREE_INDIRECT_PTR))
+		return index ? 0 : node;
+
+	node &= ~RADIX_TREE_INDIRECT_PTR;
+
+	if (height * RADIX_TREE_MAP_SHIFT < 32 && (index >> (height * RADIX_TREE_MAP_SHIFT)))
+		return 0;
+
+	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
+
+	while (height > 0) {
+		if (!(slots = radix_tree_get_node_slots(cache, node)))
+			return 0;
 
+		node = slots[(index >> shift) & RADIX_TREE_MAP_MASK] & ~RADIX_TREE_INDIRECT_PTR;
+		if (!node)
+			return 0;
+
+		shift -= RADIX_TREE_MAP_SHIFT;
+		height--;
+	}
+
+	return node;
+}
+
+int Display_irq_desc(unsigned int desc)
+{
 #define OFFSETOF_SUA 0x8
 #define OFFSETOF_CHIP 0x0c
 #define OFFSETOF_ACTION 0x28
 #define OFFSETOF_NAME 0x24
 
-        for(irqs=0; irqs < NO_OF_IRQS; irqs++) {
+        unsigned int input_read_buf=0;
+        unsigned int input_read_buf2=0;
+        char name_buf[15];
 
              //irq
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(address + (irqs * IRQ_DESC_SIZE)), &input_read_buf))
+            if(!read_uint_from_ramdump(__pa(desc), &input_read_buf))
             	fprintf(output_fp,"\n%15d",input_read_buf);
             else {
 				printf("ERROR:%d",__LINE__);
 				return -1;
 			}
 
-            if(read_uint_from_ramdump(ramdump_fp, __pa(address + (irqs * IRQ_DESC_SIZE) + OFFSETOF_KSTATIRQS), &input_read_buf)) {
+            if(read_uint_from_ramdump(__pa(desc + OFFSETOF_KSTATIRQS), &input_read_buf)) {
             	printf("ERROR:%d",__LINE__);
             	return -1;
 			}
 
             //kstat_irqs
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(input_read_buf), &input_read_buf))
+            if(!read_uint_from_ramdump(__pa(input_read_buf), &input_read_buf))
             	fprintf(output_fp,"%15d",input_read_buf);
             else {
 				printf("ERROR:%d",__LINE__);
@@ -2506,32 +3106,32 @@ int Extract_irq_desc(void)
 			}
 
             //state_use_accessors
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(address + (irqs * IRQ_DESC_SIZE) + OFFSETOF_SUA), &input_read_buf))
+            if(!read_uint_from_ramdump(__pa(desc + OFFSETOF_SUA), &input_read_buf))
             	fprintf(output_fp,"%20x",input_read_buf);
             else {
 				printf("ERROR:%d",__LINE__);
 				return -1;
 			}
 
-            if(read_uint_from_ramdump(ramdump_fp, __pa(address + (irqs * IRQ_DESC_SIZE) + OFFSETOF_CHIP), &input_read_buf)) {
+            if(read_uint_from_ramdump(__pa(desc + OFFSETOF_CHIP), &input_read_buf)) {
             	printf("ERROR:%d",__LINE__);
             	return -1;
 			}
 
-            if(read_uint_from_ramdump(ramdump_fp, __pa(input_read_buf), &input_read_buf)) {
+            if(read_uint_from_ramdump(__pa(input_read_buf), &input_read_buf)) {
             	printf("ERROR:%d",__LINE__);
             	return -1;
 			}
 //printf("0x%x\n",input_read_buf);
             //irq_name
-            if(!read_buf_from_ramdump(ramdump_fp, __pa(input_read_buf), 14, &name_buf))
+            if(!read_buf_from_ramdump(__pa(input_read_buf), 14, name_buf))
             	fprintf(output_fp,"%15s",name_buf);
             else {
 				printf("ERROR:%d",__LINE__);
 				return -1;
 			}
 
-            if(read_uint_from_ramdump(ramdump_fp, __pa(address + (irqs * IRQ_DESC_SIZE) + OFFSETOF_ACTION), &input_read_buf)) {
+            if(read_uint_from_ramdump(__pa(desc + OFFSETOF_ACTION), &input_read_buf)) {
             	printf("ERROR:%d",__LINE__);
             	return -1;
 			}
@@ -2541,14 +3141,14 @@ int Extract_irq_desc(void)
 				fprintf(output_fp,"%20s\n","NA");
 			} else {
 
-			    if(!read_uint_from_ramdump(ramdump_fp, __pa(input_read_buf), &input_read_buf2))
+			    if(!read_uint_from_ramdump(__pa(input_read_buf), &input_read_buf2))
             		fprintf(output_fp,"%20x",input_read_buf2);
             	else {
 					printf("ERROR:%d",__LINE__);
 					return -1;
 				}
 
-            	if(read_uint_from_ramdump(ramdump_fp, __pa(input_read_buf + OFFSETOF_NAME), &input_read_buf2)) {
+            	if(read_uint_from_ramdump(__pa(input_read_buf + OFFSETOF_NAME), &input_read_buf2)) {
             		printf("ERROR:%d",__LINE__);
             		return -1;
 				}
@@ -2556,46 +3156,135 @@ int Extract_irq_desc(void)
 //printf("0x%x,0x%x\n", input_read_buf2, __pa(input_read_buf2));
 				if (__pa(input_read_buf2) < RAM_START) {
 					fprintf(output_fp,"%20s\n","NA"); //dynamic allocation. change this later. Do a page table WT and get the name.
-					continue;
+					return 0;
 				}
 
-			    if(!read_buf_from_ramdump(ramdump_fp, __pa(input_read_buf2), 14, &name_buf))
+			    if(!read_buf_from_ramdump(__pa(input_read_buf2), 14, name_buf))
             		fprintf(output_fp,"%20s\n",name_buf);
             	else {
 					printf("ERROR:%d",__LINE__);
 					return -1;
 				}
 			}
-        }
 
-        fclose(output_fp);
+#undef OFFSETOF_NAME
         return 0;
 }
 
-int Extract_meminfo(void)
+int Extract_irq_desc(void)
 {
+
+//used only if nr_irqs is missing in System.map
+#define NO_OF_IRQS 492
+//more than any SoC has, nr_irqs above it is corrupt
+#define MAX_NR_IRQS (1 << 16)
+#define IRQ_DESC_SIZE 0x60
+
 		unsigned int address;
+		unsigned int desc;
+		unsigned int nr_irqs = NO_OF_IRQS;
+		struct radix_tree_node_cache *radix_node_cache = NULL;
+		int sparse_irq = 0;
         int irqs = 0;
-        unsigned int input_read_buf=0;
-        unsigned long vm_buf[VM_BUF_SIZE];
 
-        //reset system map fp
-        if(fseek(systemmap_fp, 0, 0)) {
-                printf("Error setting the system map file position\n");
+        output_fp = open_output(output_irq_file_path, "w");
+        if(!output_fp) {
+                printf("Error opening the output file for irq desc%s\n", output_irq_file_path);
                 return -1;
         }
 
-        output_fp = fopen(output_meminfo_file_path, "w");
+		address = get_addr_from_smap("nr_irqs", 7);
+		if (address && read_uint_from_ramdump(__pa(address), &nr_irqs)) {
+			printf("ERROR:%d",__LINE__);
+			fclose(output_fp);
+			return -1;
+		}
+
+		if (nr_irqs > MAX_NR_IRQS) {
+			printf("nr_irqs %u is corrupt, reading only %d irqs\n", nr_irqs, MAX_NR_IRQS);
+			nr_irqs = MAX_NR_IRQS;
+		}
+
+		//CONFIG_SPARSE_IRQ
+		address = get_addr_from_smap("irq_desc_tree", 13);
+		if (address) {
+			sparse_irq = 1;
+			radix_node_cache = (struct radix_tree_node_cache*)calloc(RADIX_TREE_NODE_CACHE_SIZE, sizeof(struct radix_tree_node_cache));
+			if (!radix_node_cache) {
+				printf("ERROR:%d",__LINE__);
+				fclose(output_fp);
+				return -1;
+			}
+		} else
+			address = get_addr_from_smap("irq_desc", 8);
+
+		fprintf(output_fp,"nr_irqs = %d (%s)\n", nr_irqs, sparse_irq ? "irq_desc_tree" : "irq_desc");
+		fprintf(output_fp,"%s","Bit masks for state_use_accessors\n");
+		fprintf(output_fp,"%s","IRQD_TRIGGER_MASK               = 0xf\n");
+		fprintf(output_fp,"%s","IRQD_SETAFFINITY_PENDING        = (1 <<  8)\n");
+		fprintf(output_fp,"%s","IRQD_NO_BALANCING               = (1 << 10)\n");
+		fprintf(output_fp,"%s","IRQD_PER_CPU                    = (1 << 11)\n");
+		fprintf(output_fp,"%s","IRQD_AFFINITY_SET               = (1 << 12)\n");
+		fprintf(output_fp,"%s","IRQD_LEVEL                      = (1 << 13)\n");
+		fprintf(output_fp,"%s","IRQD_WAKEUP_STATE               = (1 << 14)\n");
+		fprintf(output_fp,"%s","IRQD_MOVE_PCNTXT                = (1 << 15)\n");
+		fprintf(output_fp,"%s","IRQD_IRQ_DISABLED               = (1 << 16)\n");
+		fprintf(output_fp,"%s","IRQD_IRQ_MASKED                 = (1 << 17)\n");
+		fprintf(output_fp,"%s","IRQD_IRQ_INPROGRESS             = (1 << 18)\n");
+		fprintf(output_fp,"%s","-------------------------------------------\n");
+
+        fprintf(output_fp,"%15s%15s%20s%15s%20s%20s\n","IRQ_NUMBER","KSTAT_IRQS", "STATE_USE_ACCESSORS", "CHIP-NAME", "HANDLER", "DEV_NAME");
+
+        for(irqs=0; irqs < nr_irqs; irqs++) {
+
+			if (sparse_irq) {
+				desc = radix_tree_lookup(radix_node_cache, address, irqs);
+				//not allocated
+				if (!desc)
+					continue;
+			} else
+				desc = address + (irqs * IRQ_DESC_SIZE);
+
+			if (Display_irq_desc(desc))
+				break;
+        }
+
+		free(radix_node_cache);
+
+        fclose(output_fp);
+        return irqs < nr_irqs ? -1 : 0;
+}
+
+int Extract_meminfo(void)
+{
+        int ret;
+
+        output_fp = open_output(output_meminfo_file_path, "w");
         if(!output_fp) {
                 printf("Error opening the output file for meminfo desc%s\n", output_file_path);
                 return -1;
         }
 
+        ret = Write_meminfo();
+        fclose(output_fp);
+
+        return ret;
+}
+
+/*Writes meminfo to output_fp, for the file or a query*/
+int Write_meminfo(void)
+{
+		unsigned int address;
+        int irqs = 0;
+        unsigned int input_read_buf=0;
+        unsigned long vm_buf[VM_BUF_SIZE];
+
 		address = get_addr_from_smap("vm_stat", 7);
-        if(read_buf_from_ramdump(ramdump_fp, __pa(address), (VM_BUF_SIZE * 4), vm_buf)) {
+        if(read_buf_from_ramdump(__pa(address), (VM_BUF_SIZE * 4), vm_buf)) {
             printf("ERROR:%d",__LINE__);
             return -1;
 		}
+        snap_vm_stat(vm_buf);
 
         fprintf(output_fp,"Meminfo:\n");
         fprintf(output_fp,"--------\n");
@@ -2690,8 +3379,6 @@ int Extract_meminfo(void)
 
         fprintf(output_fp,"------------------------------------------------\n");
 
-        fclose(output_fp);
-
 		return 0;
 }
 
@@ -2705,7 +3392,7 @@ int Display_thread(unsigned int thread_add)
         unsigned char comm_buf[TASK_COMM_LEN];
         char* symbol;
         int signed_read_buf=0;
-        unsigned char kstack_name_buf[100];
+        unsigned char kstack_name_buf[MAX_PATH];
         char* kstack_buf;
         int pid, tid;
         int count = 0;
@@ -2718,7 +3405,7 @@ int Display_thread(unsigned int thread_add)
 
         do {
             //COMM
-            if(!read_buf_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_COMM), TASK_COMM_LEN, comm_buf))
+            if(!read_buf_from_ramdump(__pa(proc + OFFSETOF_COMM), TASK_COMM_LEN, comm_buf))
             	fprintf(output_fp,"\n\n%20s",comm_buf);
             else {
 				printf("ERROR:%d",__LINE__);
@@ -2729,7 +3416,7 @@ int Display_thread(unsigned int thread_add)
             fprintf(output_fp,"%20x",proc);
 
             //PID
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_PID), &input_read_buf)) {
+            if(!read_uint_from_ramdump(__pa(proc + OFFSETOF_PID), &input_read_buf)) {
             	fprintf(output_fp,"%8d",input_read_buf);
             	pid = input_read_buf;
             } else {
@@ -2738,7 +3425,7 @@ int Display_thread(unsigned int thread_add)
 			}
 
             //TID
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_TID), &input_read_buf)) {
+            if(!read_uint_from_ramdump(__pa(proc + OFFSETOF_TID), &input_read_buf)) {
             	fprintf(output_fp,"%8d",input_read_buf);
             	tid = input_read_buf;
             } else {
@@ -2749,7 +3436,7 @@ int Display_thread(unsigned int thread_add)
 #define OFFSETOF_STATE      0x0
 
             //STATE
-            if(read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_STATE), &input_read_buf)) {
+            if(read_uint_from_ramdump(__pa(proc + OFFSETOF_STATE), &input_read_buf)) {
             	printf("ERROR:%d",__LINE__);
             	return -1;
 			}
@@ -2788,7 +3475,7 @@ int Display_thread(unsigned int thread_add)
 
 #define OFFSETOF_FLAGS      0xc
             //FLAGS
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_FLAGS), &input_read_buf))
+            if(!read_uint_from_ramdump(__pa(proc + OFFSETOF_FLAGS), &input_read_buf))
             	fprintf(output_fp,"%15x",input_read_buf);
             else {
 				printf("ERROR:%d",__LINE__);
@@ -2797,7 +3484,7 @@ int Display_thread(unsigned int thread_add)
 #undef OFFSETOF_FLAGS
 
             //PRIO
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_PRIO), &input_read_buf))
+            if(!read_uint_from_ramdump(__pa(proc + OFFSETOF_PRIO), &input_read_buf))
             	fprintf(output_fp,"%8d",input_read_buf);
             else {
 				printf("ERROR:%d",__LINE__);
@@ -2805,7 +3492,7 @@ int Display_thread(unsigned int thread_add)
 			}
 
             //STATICPRIO
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_STATICPRIO), &input_read_buf))
+            if(!read_uint_from_ramdump(__pa(proc + OFFSETOF_STATICPRIO), &input_read_buf))
             	fprintf(output_fp,"%15d",input_read_buf);
             else {
 				printf("ERROR:%d",__LINE__);
@@ -2813,7 +3500,7 @@ int Display_thread(unsigned int thread_add)
 			}
 
             //NORMALPRIO
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_NORMALPRIO), &input_read_buf))
+            if(!read_uint_from_ramdump(__pa(proc + OFFSETOF_NORMALPRIO), &input_read_buf))
             	fprintf(output_fp,"%15d",input_read_buf);
             else {
 				printf("ERROR:%d",__LINE__);
@@ -2821,7 +3508,7 @@ int Display_thread(unsigned int thread_add)
 			}
 
             //MM
-            if(read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_MM), &input_read_buf)) {
+            if(read_uint_from_ramdump(__pa(proc + OFFSETOF_MM), &input_read_buf)) {
             	printf("ERROR:%d",__LINE__);
             	return -1;
 			}
@@ -2829,7 +3516,7 @@ int Display_thread(unsigned int thread_add)
             if(input_read_buf) {
                    	mm_start = input_read_buf;
                    	//RSS
-            		if(!read_buf_from_ramdump(ramdump_fp, __pa(mm_start + OFFSETOF_RSSSTAT), sizeof(struct mm_rss_stat), &mm_rss))
+            		if(!read_buf_from_ramdump(__pa(mm_start + OFFSETOF_RSSSTAT), sizeof(struct mm_rss_stat), &mm_rss))
             			fprintf(output_fp,"%20ld %20ld %20ld %20ld", mm_rss.count[0], mm_rss.count[1], mm_rss.count[2], mm_rss.count[3]);
             		else {
 						printf("ERROR:%d",__LINE__);
@@ -2840,7 +3527,7 @@ int Display_thread(unsigned int thread_add)
             }
 
             //min_flt
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_MINFLT), &input_read_buf))
+            if(!read_uint_from_ramdump(__pa(proc + OFFSETOF_MINFLT), &input_read_buf))
             	fprintf(output_fp,"%15d",input_read_buf);
             else {
 				printf("ERROR:%d",__LINE__);
@@ -2848,7 +3535,7 @@ int Display_thread(unsigned int thread_add)
 			}
 
             //maj_flt
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_MAJFLT), &input_read_buf))
+            if(!read_uint_from_ramdump(__pa(proc + OFFSETOF_MAJFLT), &input_read_buf))
             	fprintf(output_fp,"%15d",input_read_buf);
             else {
 				printf("ERROR:%d",__LINE__);
@@ -2856,13 +3543,13 @@ int Display_thread(unsigned int thread_add)
 			}
 
             //signal
-            if(read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_SIGNAL), &input_read_buf)) {
+            if(read_uint_from_ramdump(__pa(proc + OFFSETOF_SIGNAL), &input_read_buf)) {
             	printf("ERROR:%d",__LINE__);
             	return -1;
 			}
 
             //oom_adj
-            if(!read_int_from_ramdump(ramdump_fp, __pa(input_read_buf + OFFSETOF_OOMADJ), &signed_read_buf))
+            if(!read_int_from_ramdump(__pa(input_read_buf + OFFSETOF_OOMADJ), &signed_read_buf))
             	fprintf(output_fp,"%15d",signed_read_buf);
             else {
 				printf("ERROR:%d",__LINE__);
@@ -2870,7 +3557,7 @@ int Display_thread(unsigned int thread_add)
 			}
 
             //stack start
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_KSTACK), &input_read_buf))
+            if(!read_uint_from_ramdump(__pa(proc + OFFSETOF_KSTACK), &input_read_buf))
             	fprintf(output_fp,"%15x",input_read_buf);
             else {
 				printf("ERROR:%d",__LINE__);
@@ -2891,7 +3578,7 @@ int Display_thread(unsigned int thread_add)
 			}
 
 			sprintf(kstack_name_buf,"kstacks_per_task\\kstack_%d_%d_%s.bin",pid,tid,comm_buf);
-        	output_stack_fp = fopen(kstack_name_buf, "wb");
+        	output_stack_fp = open_output(kstack_name_buf, "wb");
         	if(!output_stack_fp) {
                 printf("Error opening the output file for kstack file %s\n", kstack_name_buf);
                 return -1;
@@ -2899,7 +3586,7 @@ int Display_thread(unsigned int thread_add)
 
 			kstack_buf = (char*)malloc(KSTACK_SIZE);
 
-        	if(read_buf_from_ramdump(ramdump_fp, __pa(kstack_start), KSTACK_SIZE, kstack_buf)) {
+        	if(read_buf_from_ramdump(__pa(kstack_start), KSTACK_SIZE, kstack_buf)) {
             	printf("ERROR:%d",__LINE__);
             	return -1;
 			}
@@ -2917,7 +3604,7 @@ int Display_thread(unsigned int thread_add)
 #define OFFSETOF_CPUCONTEXT 0x1c
 
 			sprintf(kstack_name_buf,"cpu_context_per_task\\cpu_context_%d_%d_%s.txt",pid,tid,comm_buf);
-        	output_stack_fp = fopen(kstack_name_buf, "w");
+        	output_stack_fp = open_output(kstack_name_buf, "w");
         	if(!output_stack_fp) {
                 printf("Error opening the output file for cpu context file %s\n", kstack_name_buf);
                 return -1;
@@ -2925,7 +3612,7 @@ int Display_thread(unsigned int thread_add)
 
         	for(count = 0; count < 10; count++) {
 
-			            if(!read_uint_from_ramdump(ramdump_fp, __pa(kstack_start + OFFSETOF_CPUCONTEXT + (4 * count)), &input_read_buf)) {
+			            if(!read_uint_from_ramdump(__pa(kstack_start + OFFSETOF_CPUCONTEXT + (4 * count)), &input_read_buf)) {
 			            	if (count < 6)
 			            		fprintf(output_stack_fp,"r%d\t\t0x%x\n",count+4, input_read_buf);
 			            	else if (count == 6)
@@ -2948,7 +3635,7 @@ int Display_thread(unsigned int thread_add)
 #undef OFFSETOF_CPUCONTEXT
 
             //preempt_count
-            if(!read_uint_from_ramdump(ramdump_fp, __pa(kstack_start + OFFSETOF_PREEMPTCOUNT), &input_read_buf))
+            if(!read_uint_from_ramdump(__pa(kstack_start + OFFSETOF_PREEMPTCOUNT), &input_read_buf))
             	fprintf(output_fp,"%15x",input_read_buf);
             else {
 				printf("ERROR:%d",__LINE__);
@@ -2956,7 +3643,7 @@ int Display_thread(unsigned int thread_add)
 			}
 
             //task->next
-            if(read_uint_from_ramdump(ramdump_fp, __pa(proc + OFFSETOF_THREADGROUP), &input_read_buf)) {
+            if(read_uint_from_ramdump(__pa(proc + OFFSETOF_THREADGROUP), &input_read_buf)) {
             	printf("ERROR:%d",__LINE__);
             	return -1;
 			}
@@ -2969,3 +3656,2099 @@ int Display_thread(unsigned int thread_add)
 
         return 0;
 }
+
+/*
+ * Dumps the kernel log buffer (what dmesg would show).
+ * Kernels before 3.5 keep a plain character ring buffer indexed by
+ * log_end, newer ones keep struct printk_log records between
+ * log_first_idx and log_next_idx. The text is written in the same
+ * "[%5lu.%06lu] " form printk uses, so that crash_search can parse it
+ * directly, e.g. extract_ramdump -r dump -m System.map -k | crash_search -i - -v vmlinux
+ */
+int Extract_kernel_log(FILE* log_fp)
+{
+	unsigned int address;
+	unsigned int log_buf = 0;
+	unsigned int log_buf_len = 0;
+	unsigned int first_idx, next_idx, idx;
+	unsigned int records = 0;
+	int wrapped = 0;
+	unsigned int log_end, logged_chars;
+	unsigned long long ts_nsec;
+	unsigned short len, text_len;
+	char* buf;
+
+//struct printk_log
+#define PRINTK_LOG_HDR_SIZE 0x10
+#define OFFSETOF_TS_NSEC 0x0
+#define OFFSETOF_LEN 0x8
+#define OFFSETOF_TEXT_LEN 0xa
+
+	address = get_addr_from_smap("log_buf", 7);
+	if(!address || read_uint_from_ramdump(__pa(address), &log_buf)) {
+		fprintf(stderr, "ERROR:%d\n",__LINE__);
+		return -1;
+	}
+
+	address = get_addr_from_smap("log_buf_len", 11);
+	if(!address || read_uint_from_ramdump(__pa(address), &log_buf_len)) {
+		fprintf(stderr, "ERROR:%d\n",__LINE__);
+		return -1;
+	}
+
+	if (log_buf_len < PRINTK_LOG_HDR_SIZE || (log_buf_len & (log_buf_len - 1))) {
+		fprintf(stderr, "Invalid log_buf_len %u\n", log_buf_len);
+		return -1;
+	}
+
+	buf = (char*)malloc(log_buf_len);
+	if (!buf) {
+		fprintf(stderr, "ERROR:%d\n",__LINE__);
+		return -1;
+	}
+
+	//one read for the whole buffer, the rest is done in memory
+	if(read_buf_from_ramdump(__pa(log_buf), log_buf_len, buf)) {
+		fprintf(stderr, "ERROR:%d\n",__LINE__);
+		free(buf);
+		return -1;
+	}
+
+	address = get_addr_from_smap("log_first_idx", 13);
+	if (address) {
+		//structured printk records
+		if(read_uint_from_ramdump(__pa(address), &first_idx)) {
+			fprintf(stderr, "ERROR:%d\n",__LINE__);
+			free(buf);
+			return -1;
+		}
+
+		address = get_addr_from_smap("log_next_idx", 12);
+		if(!address || read_uint_from_ramdump(__pa(address), &next_idx)) {
+			fprintf(stderr, "ERROR:%d\n",__LINE__);
+			free(buf);
+			return -1;
+		}
+
+		//a corrupt dump must not loop: at most one wrap and as many
+		//records as the smallest of them fits in the buffer
+		idx = first_idx;
+		while (idx != next_idx) {
+			if (++records > log_buf_len / PRINTK_LOG_HDR_SIZE) {
+				fprintf(stderr, "Too many log records, next_idx %u not found\n", next_idx);
+				break;
+			}
+
+			if (idx > log_buf_len - PRINTK_LOG_HDR_SIZE) {
+				fprintf(stderr, "Corrupt log record at %u\n", idx);
+				break;
+			}
+
+			memcpy(&len, buf + idx + OFFSETOF_LEN, sizeof(len));
+
+			//a zero length record means wrap around to the start
+			if (!len) {
+				if (!idx || wrapped) {
+					fprintf(stderr, "Corrupt log record at %u\n", idx);
+					break;
+				}
+				wrapped = 1;
+				idx = 0;
+				continue;
+			}
+
+			memcpy(&ts_nsec, buf + idx + OFFSETOF_TS_NSEC, sizeof(ts_nsec));
+			memcpy(&text_len, buf + idx + OFFSETOF_TEXT_LEN, sizeof(text_len));
+
+			if ((idx + len > log_buf_len) || (PRINTK_LOG_HDR_SIZE + text_len > len)) {
+				fprintf(stderr, "Corrupt log record at %u\n", idx);
+				break;
+			}
+
+			fprintf(log_fp, "[%5lu.%06lu] ", (unsigned long)(ts_nsec / 1000000000ULL),
+					(unsigned long)((ts_nsec % 1000000000ULL) / 1000));
+			fwrite(buf + idx + PRINTK_LOG_HDR_SIZE, 1, text_len, log_fp);
+			fputc('\n', log_fp);
+
+			idx += len;
+		}
+	} else {
+		//plain ring buffer, LOG_BUF(idx) is log_buf[idx & (log_buf_len - 1)]
+		address = get_addr_from_smap("log_end", 7);
+		if(!address || read_uint_from_ramdump(__pa(address), &log_end)) {
+			fprintf(stderr, "ERROR:%d\n",__LINE__);
+			free(buf);
+			return -1;
+		}
+
+		address = get_addr_from_smap("logged_chars", 12);
+		if(!address || read_uint_from_ramdump(__pa(address), &logged_chars))
+			logged_chars = log_end < log_buf_len ? log_end : log_buf_len;
+
+		if (logged_chars > log_buf_len)
+			logged_chars = log_buf_len;
+
+		idx = (log_end - logged_chars) & (log_buf_len - 1);
+		if (idx + logged_chars > log_buf_len) {
+			fwrite(buf + idx, 1, log_buf_len - idx, log_fp);
+			fwrite(buf, 1, logged_chars - (log_buf_len - idx), log_fp);
+		} else
+			fwrite(buf + idx, 1, logged_chars, log_fp);
+	}
+
+	free(buf);
+
+	return 0;
+}
+
+/*Interactive shell (-i). The image and System.map stay loaded, so
+ *each answer is only a few reads of the mapping. Commands come from
+ *stdin, a terminal or a script, or from a file with "source".
+ */
+#define SHELL_LINE_SIZE 512
+#define SHELL_HISTORY_SIZE 1000
+#define SHELL_SOURCE_DEPTH 8
+#define LIST_WALK_LIMIT 100000
+#define SHELL_RD_LIMIT 65536	/*words, 256KB*/
+
+char* shell_history[SHELL_HISTORY_SIZE];
+int nr_shell_history;
+
+void shell_help(void)
+{
+	fprintf(output_fp, "vtop <va>                  page table walk of a virtual address\n");
+	fprintf(output_fp, "sym <addr>                 symbol at or below an address\n");
+	fprintf(output_fp, "rd <va> [n]                n words from a virtual address, at most %d\n", SHELL_RD_LIMIT);
+	fprintf(output_fp, "task <pid>                 tasks with this pid or tid\n");
+	fprintf(output_fp, "ps                         all the tasks\n");
+	fprintf(output_fp, "meminfo                    the meminfo summary\n");
+	fprintf(output_fp, "search <val>               physical addresses holding a word\n");
+	fprintf(output_fp, "slab [name]                kmem_caches whose name starts with name\n");
+	fprintf(output_fp, "list-walk <head> <offset>  entries of a list_head list\n");
+	fprintf(output_fp, "source <file>              runs the commands of a file\n");
+	fprintf(output_fp, "history, !!, !n            earlier commands\n");
+	fprintf(output_fp, "quit\n");
+}
+
+int cmp_smap_addr(const void* a, const void* b)
+{
+	struct smap_sym* syms = cur_dump->smap->syms;
+	unsigned int x = *(const unsigned int*)a, y = *(const unsigned int*)b;
+
+	if(syms[x].address != syms[y].address)
+		return syms[x].address < syms[y].address ? -1 : 1;
+	return x < y ? -1 : 1;
+}
+
+/*Builds the by_addr index the first time it is needed*/
+int smap_addr_index(void)
+{
+	struct smap* smap = cur_dump->smap;
+	unsigned int i;
+
+	if(smap_ready())
+		return -1;
+
+	EnterCriticalSection(&smap->lock);
+	if(!smap->by_addr) {
+		smap->by_addr = malloc((smap->nr_syms + 1) * sizeof(unsigned int));
+		for(i = 0; smap->by_addr && i < smap->nr_syms; i++) {
+			if(!smap->syms[i].mapping)
+				smap->by_addr[smap->nr_by_addr++] = i;
+		}
+		if(smap->by_addr)
+			qsort(smap->by_addr, smap->nr_by_addr, sizeof(unsigned int), cmp_smap_addr);
+	}
+	LeaveCriticalSection(&smap->lock);
+	if(!smap->by_addr) {
+		fprintf(output_fp, "Out of memory sorting the system map\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*Nearest symbol at or below address, NULL if there is none*/
+char* shell_symbol(unsigned int address, unsigned int* offset)
+{
+	struct smap* smap = cur_dump->smap;
+	int lo, hi, mid, found = -1;
+
+	if(cur_stats)
+		cur_stats->lookups++;
+
+	if(smap_addr_index())
+		return NULL;
+
+	lo = 0;
+	hi = (int)smap->nr_by_addr - 1;
+	while(lo <= hi) {
+		mid = lo + (hi - lo) / 2;
+		if(smap->syms[smap->by_addr[mid]].address <= address) {
+			found = mid;
+			lo = mid + 1;
+		} else
+			hi = mid - 1;
+	}
+	if(found < 0)
+		return NULL;
+
+	*offset = address - smap->syms[smap->by_addr[found]].address;
+	return smap->syms[smap->by_addr[found]].name;
+}
+
+/*Reads a word at a virtual address, through the page tables*/
+int shell_read_uint(unsigned int va, unsigned int* val)
+{
+	unsigned int pa = do_pg_tbl_wlkthr_non_logical(va);
+
+	if(pa == (unsigned int)-1)
+		return -1;
+
+	return read_uint_from_ramdump(pa, val);
+}
+
+const char* task_state_name(unsigned int state)
+{
+	switch(state) {
+		case TASK_RUNNING:
+			return task_state[0];
+		case TASK_INTERRUPTIBLE:
+			return task_state[1];
+		case TASK_UNINTERRUPTIBLE:
+			return task_state[2];
+		case __TASK_STOPPED:
+			return task_state[3];
+		case __TASK_TRACED:
+			return task_state[4];
+		case TASK_DEAD:
+			return task_state[5];
+		case TASK_WAKEKILL:
+			return task_state[6];
+		case TASK_WAKING:
+			return task_state[7];
+	}
+
+	return "??";
+}
+
+/*The tasks with this pid or tid, or all of them*/
+void shell_task(unsigned int pid, int all)
+{
+	unsigned int init_proc_address, proc, thread, val, state;
+	unsigned int found = 0, count = 0;
+	unsigned char comm_buf[TASK_COMM_LEN + 1];
+	int p, t;
+
+	init_proc_address = get_addr_from_smap("init_task", 9);
+	if(!init_proc_address) {
+		fprintf(output_fp, "init_task not in the system map\n");
+		return;
+	}
+
+	proc = init_proc_address;
+	do {
+		thread = proc;
+		do {
+			if(read_int_from_ramdump(__pa(thread + OFFSETOF_PID), &p) ||
+				read_int_from_ramdump(__pa(thread + OFFSETOF_TID), &t))
+				return;
+
+			if(all || p == (int)pid || t == (int)pid) {
+				comm_buf[TASK_COMM_LEN] = 0;
+				if(read_buf_from_ramdump(__pa(thread + OFFSETOF_COMM), TASK_COMM_LEN, comm_buf) ||
+					read_uint_from_ramdump(__pa(thread), &state) ||
+					read_uint_from_ramdump(__pa(thread + OFFSETOF_KSTACK), &val))
+					return;
+				fprintf(output_fp, "%-16s task_struct 0x%x pid %d tid %d state %s kstack 0x%x-0x%x\n",
+					comm_buf, thread, p, t, task_state_name(state), val, val + 8192);
+				found++;
+			}
+
+			if(read_uint_from_ramdump(__pa(thread + OFFSETOF_THREADGROUP), &val))
+				return;
+			thread = val - OFFSETOF_THREADGROUP;
+		} while(thread != proc && ++count < LIST_WALK_LIMIT);
+
+		if(read_uint_from_ramdump(__pa(proc + OFFSETOF_TASKS), &val))
+			return;
+		proc = val - OFFSETOF_TASKS;
+	} while(proc != init_proc_address && ++count < LIST_WALK_LIMIT);
+
+	if(!found && !all)
+		fprintf(output_fp, "No task with pid %u\n", pid);
+}
+
+void shell_search(unsigned int val)
+{
+	struct ramdump* dump = cur_dump;
+	unsigned long long i;
+	unsigned int word;
+
+	for(i = 0; i + 4 <= dump->size; i += 4) {
+		if(dump->image)
+			memcpy(&word, dump->image + i, 4);
+		else if(read_uint_from_ramdump(RAM_START + i, &word))
+			return;
+		if(word == val)
+			fprintf(output_fp, "pa 0x%x va 0x%x\n", (unsigned int)(RAM_START + i), __va(RAM_START + i));
+	}
+}
+
+void shell_slab(const char* name)
+{
+	unsigned int head, next, cache, val, count = 0;
+	char name_buf[KMEMCACHE_NAME_SIZE + 1];
+
+	head = get_addr_from_smap("cache_chain", 11);
+	if(!head) {
+		fprintf(output_fp, "cache_chain not in the system map\n");
+		return;
+	}
+
+	if(read_uint_from_ramdump(__pa(head), &next))
+		return;
+
+	while(next != head && ++count < LIST_WALK_LIMIT) {
+		cache = next - OFFSETOF_KMEMCACHE_NEXT;
+		name_buf[KMEMCACHE_NAME_SIZE] = 0;
+		if(!read_uint_from_ramdump(__pa(cache + OFFSETOF_KEMEMCACHE_NAME), &val) &&
+			!read_buf_from_ramdump(do_pg_tbl_wlkthr_non_logical(val), KMEMCACHE_NAME_SIZE, name_buf) &&
+			!strncmp(name_buf, name, strlen(name)))
+			fprintf(output_fp, "%-20s kmem_cache 0x%x\n", name_buf, cache);
+
+		if(read_uint_from_ramdump(__pa(next), &next))
+			return;
+	}
+}
+
+void shell_list_walk(unsigned int head, unsigned int offset)
+{
+	unsigned int next, count = 0;
+
+	if(shell_read_uint(head, &next))
+		return;
+
+	while(next != head && count < LIST_WALK_LIMIT) {
+		fprintf(output_fp, "%6u: 0x%x\n", count++, next - offset);
+		if(shell_read_uint(next, &next))
+			return;
+	}
+	fprintf(output_fp, "%u entries\n", count);
+}
+
+/*Runs one command. Returns 1 for quit.*/
+int shell_command(char* line, int depth)
+{
+	char cmd[32], arg[SHELL_LINE_SIZE];
+	unsigned int a = 0, b = 0, val, off, i;
+	int n;
+	char* name;
+	FILE* fp;
+
+	n = sscanf(line, "%31s %x %x", cmd, &a, &b);
+	if(n < 1)
+		return 0;
+
+	if(!strcmp(cmd, "quit") || !strcmp(cmd, "exit"))
+		return 1;
+	else if(!strcmp(cmd, "help"))
+		shell_help();
+	else if(!strcmp(cmd, "vtop") && n >= 2)
+		do_virt_to_phy(a);
+	else if(!strcmp(cmd, "sym") && n >= 2) {
+		name = shell_symbol(a, &off);
+		if(name)
+			fprintf(output_fp, "0x%x %s+0x%x\n", a, name, off);
+		else
+			fprintf(output_fp, "0x%x ??\n", a);
+	} else if(!strcmp(cmd, "rd") && n >= 2) {
+		if(n < 3)
+			b = 1;
+		if(b > SHELL_RD_LIMIT) {
+			fprintf(output_fp, "rd: reading the first %d of 0x%x words\n", SHELL_RD_LIMIT, b);
+			b = SHELL_RD_LIMIT;
+		}
+		for(i = 0; i < b; i++) {
+			if(!(i % 4))
+				fprintf(output_fp, "%s%08x:", i ? "\n" : "", a + i * 4);
+			if(shell_read_uint(a + i * 4, &val))
+				break;
+			fprintf(output_fp, " %08x", val);
+		}
+		fprintf(output_fp, "\n");
+	} else if(!strcmp(cmd, "task") && sscanf(line, "%*s %u", &a) == 1)
+		shell_task(a, 0);
+	else if(!strcmp(cmd, "ps"))
+		shell_task(0, 1);
+	else if(!strcmp(cmd, "meminfo"))
+		Write_meminfo();
+	else if(!strcmp(cmd, "search") && n >= 2)
+		shell_search(a);
+	else if(!strcmp(cmd, "slab")) {
+		if(sscanf(line, "%*s %511s", arg) != 1)
+			arg[0] = 0;
+		shell_slab(arg);
+	} else if(!strcmp(cmd, "list-walk") && n >= 2)
+		shell_list_walk(a, n >= 3 ? b : 0);
+	else if(!strcmp(cmd, "source") && sscanf(line, "%*s %511s", arg) == 1) {
+		if(depth >= SHELL_SOURCE_DEPTH) {
+			fprintf(output_fp, "source nested too deep\n");
+			return 0;
+		}
+		fp = fopen(arg, "r");
+		if(!fp) {
+			fprintf(output_fp, "Error opening %s\n", arg);
+			return 0;
+		}
+		n = shell(fp, depth + 1);
+		fclose(fp);
+		return n;
+	} else if(!strcmp(cmd, "history")) {
+		for(i = 0; i < (unsigned int)nr_shell_history; i++)
+			fprintf(output_fp, "%4u  %s\n", i + 1, shell_history[i]);
+	} else
+		fprintf(output_fp, "Unknown command or missing argument, try help\n");
+
+	return 0;
+}
+
+/*Reads commands from fp till quit or the end of it*/
+int shell(FILE* fp, int depth)
+{
+	char line[SHELL_LINE_SIZE];
+	char* p;
+	int n, interactive = !depth && _isatty(_fileno(fp));
+
+	while(1) {
+		if(interactive) {
+			printf("ramdump> ");
+			fflush(stdout);
+		}
+		if(!fgets(line, sizeof(line), fp))
+			return 0;
+		line[strcspn(line, "\r\n")] = 0;
+		for(p = line; *p == ' ' || *p == '\t'; p++)
+			;
+		if(!*p || *p == '#')
+			continue;
+
+		//!! and !n run an earlier command again
+		if(*p == '!') {
+			n = p[1] == '!' ? nr_shell_history : atoi(p + 1);
+			if(n < 1 || n > nr_shell_history) {
+				printf("No command %s in the history\n", p);
+				continue;
+			}
+			strcpy(line, shell_history[n - 1]);
+			p = line;
+			if(interactive)
+				printf("%s\n", p);
+		}
+
+		if(!depth && nr_shell_history < SHELL_HISTORY_SIZE && strncmp(p, "history", 7)) {
+			shell_history[nr_shell_history] = strdup(p);
+			if(shell_history[nr_shell_history])
+				nr_shell_history++;
+		}
+
+		if(shell_command(p, depth))
+			return 1;
+		fflush(stdout);
+	}
+}
+
+/*Query daemon (-d socket). The shell commands are served over a
+ *Unix domain socket by a pool of threads (-j), all of them reading
+ *the one mapping and System.map. A request is one command line and
+ *its answer is "OK <bytes>\n" followed by that many bytes of text.
+ *-c socket is a small client that sends the lines of stdin.
+ */
+#define DAEMON_BACKLOG 64
+#define DAEMON_BUF_SIZE 65536
+
+SOCKET daemon_socket = INVALID_SOCKET;
+
+int send_all(SOCKET s, const char* buf, int len)
+{
+	int n;
+
+	while(len > 0) {
+		n = send(s, buf, len, 0);
+		if(n <= 0)
+			return -1;
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/*Reads a line into buf without the newline, -1 at the end of input*/
+int recv_line(SOCKET s, char* buf, int size)
+{
+	int len = 0;
+	char c;
+
+	while(recv(s, &c, 1, 0) == 1) {
+		if(c == '\n') {
+			buf[len] = 0;
+			if(len && buf[len - 1] == '\r')
+				buf[len - 1] = 0;
+			return len;
+		}
+		if(len < size - 1)
+			buf[len++] = c;
+	}
+
+	return -1;
+}
+
+/*Answers the requests of one client. The answer is written to the
+ *scratch file of the worker, then sent with its length.
+ */
+void serve_client(SOCKET s, FILE* scratch, char* buf)
+{
+	char line[SHELL_LINE_SIZE], cmd[32];
+	long len, done;
+	int n, quit;
+
+	while(recv_line(s, line, sizeof(line)) >= 0) {
+		rewind(scratch);
+		output_fp = scratch;
+
+		//no files of the daemon host are read for a client
+		if(sscanf(line, "%31s", cmd) == 1 && !strcmp(cmd, "source")) {
+			fprintf(scratch, "source is not served\n");
+			quit = 0;
+		} else
+			quit = shell_command(line, 0);
+
+		fflush(scratch);
+		len = ftell(scratch);
+		rewind(scratch);
+
+		n = sprintf(buf, "OK %ld\n", len);
+		if(send_all(s, buf, n))
+			return;
+		for(done = 0; done < len; done += n) {
+			n = fread(buf, 1, len - done < DAEMON_BUF_SIZE ? len - done : DAEMON_BUF_SIZE, scratch);
+			if(n <= 0 || send_all(s, buf, n))
+				return;
+		}
+
+		if(quit)
+			return;
+	}
+}
+
+DWORD WINAPI daemon_thread(LPVOID arg)
+{
+	SOCKET s;
+	FILE* scratch;
+	char* buf;
+
+	//T: kept in memory if it fits, D: deleted when closed
+	scratch = fopen(arg, "w+bTD");
+	buf = malloc(DAEMON_BUF_SIZE);
+	if(!scratch || !buf) {
+		printf("Error opening the scratch file %s\n", (char*)arg);
+		free(buf);
+		return 1;
+	}
+
+	while((s = accept(daemon_socket, NULL, NULL)) != INVALID_SOCKET) {
+		serve_client(s, scratch, buf);
+		closesocket(s);
+	}
+
+	fclose(scratch);
+	free(buf);
+	return 0;
+}
+
+int run_daemon(const char* path, int nr_threads)
+{
+	HANDLE threads[MAXIMUM_WAIT_OBJECTS];
+	char scratch_path[MAXIMUM_WAIT_OBJECTS][MAX_PATH];
+	char temp_dir[MAX_PATH];
+	struct sockaddr_un addr;
+	SYSTEM_INFO info;
+	WSADATA wsa;
+	int i, n = 0;
+
+	if(WSAStartup(MAKEWORD(2, 2), &wsa)) {
+		printf("Error starting winsock\n");
+		return -1;
+	}
+
+	if(strlen(path) >= sizeof(addr.sun_path)) {
+		printf("Socket path %s is too long\n", path);
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	DeleteFile(path);
+
+	daemon_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(daemon_socket == INVALID_SOCKET ||
+		bind(daemon_socket, (struct sockaddr*)&addr, sizeof(addr)) ||
+		listen(daemon_socket, DAEMON_BACKLOG)) {
+		printf("Error listening on %s\n", path);
+		return -1;
+	}
+
+	if(nr_threads <= 0) {
+		GetSystemInfo(&info);
+		nr_threads = info.dwNumberOfProcessors;
+	}
+	if(nr_threads > MAXIMUM_WAIT_OBJECTS)
+		nr_threads = MAXIMUM_WAIT_OBJECTS;
+	if(nr_threads < 1)
+		nr_threads = 1;
+
+	//the indices are built before the first client, not by it
+	output_fp = stdout;
+	smap_addr_index();
+
+	if(!GetTempPath(MAX_PATH, temp_dir))
+		strcpy(temp_dir, ".");
+
+	for(i = 0; i < nr_threads; i++) {
+		if(!GetTempFileName(temp_dir, "rdq", 0, scratch_path[i]))
+			break;
+		threads[n] = CreateThread(NULL, 0, daemon_thread, scratch_path[i], 0, NULL);
+		if(!threads[n]) {
+			printf("Error starting the thread %d\n", i);
+			break;
+		}
+		n++;
+	}
+	if(!n) {
+		printf("No worker could be started\n");
+		return -1;
+	}
+
+	printf("Serving %s with %d threads\n", path, n);
+	fflush(stdout);
+
+	WaitForMultipleObjects(n, threads, TRUE, INFINITE);
+	closesocket(daemon_socket);
+	WSACleanup();
+
+	return 0;
+}
+
+/*Sends the lines of stdin to the daemon and prints the answers*/
+int run_client(const char* path)
+{
+	struct sockaddr_un addr;
+	char line[SHELL_LINE_SIZE];
+	char* buf;
+	SOCKET s;
+	WSADATA wsa;
+	long len, done;
+	int n;
+
+	if(WSAStartup(MAKEWORD(2, 2), &wsa)) {
+		printf("Error starting winsock\n");
+		return -1;
+	}
+
+	if(strlen(path) >= sizeof(addr.sun_path)) {
+		printf("Socket path %s is too long\n", path);
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(s == INVALID_SOCKET || connect(s, (struct sockaddr*)&addr, sizeof(addr))) {
+		printf("Error connecting to %s\n", path);
+		return -1;
+	}
+
+	buf = malloc(DAEMON_BUF_SIZE);
+	if(!buf) {
+		printf("Out of memory\n");
+		closesocket(s);
+		return -1;
+	}
+
+	while(fgets(line, sizeof(line), stdin)) {
+		line[strcspn(line, "\r\n")] = 0;
+		strcat(line, "\n");
+		if(send_all(s, line, strlen(line)))
+			break;
+
+		if(recv_line(s, buf, DAEMON_BUF_SIZE) < 0 || sscanf(buf, "OK %ld", &len) != 1) {
+			printf("Bad answer from %s\n", path);
+			break;
+		}
+		for(done = 0; done < len; done += n) {
+			n = recv(s, buf, len - done < DAEMON_BUF_SIZE ? len - done : DAEMON_BUF_SIZE, 0);
+			if(n <= 0)
+				break;
+			fwrite(buf, 1, n, stdout);
+		}
+		fflush(stdout);
+		if(done < len)
+			break;
+	}
+
+	free(buf);
+	closesocket(s);
+	WSACleanup();
+
+	return 0;
+}
+
+/*-D: the meminfo, slab, buddy, pagetype and task extractors run on
+ *two dumps at once, each thread writing the files of its dump under a
+ *directory of its own. What they see goes in a snapshot as well, and
+ *the two snapshots are compared in diff.txt.
+ */
+unsigned char* output_diff_file_path = "./diff.txt";
+
+const char* diff_extractors[] = {"meminfo", "slab", "buddy", "pagetype", "tasks"};
+
+#define NR_DIFF_EXTRACTORS (sizeof(diff_extractors) / sizeof(diff_extractors[0]))
+
+const char* vm_stat_names[VM_BUF_SIZE] = {
+	"nr_free_pages", "nr_inactive_anon", "nr_active_anon", "nr_inactive_file",
+	"nr_active_file", "nr_unevictable", "nr_mlock", "nr_anon_pages",
+	"nr_mapped", "nr_file_pages", "nr_dirty", "nr_writeback",
+	"nr_slab_reclaimable", "nr_slab_unreclaimable", "nr_page_table_pages", "nr_kernel_stack",
+	"nr_unstable", "nr_bounce", "nr_vmscan_write", "nr_writeback_temp",
+	"nr_isolated_anon", "nr_isolated_file", "nr_shmem", "nr_dirtied",
+	"nr_written", "nr_free_cma", "nr_cma_anon", "nr_cma_file",
+	"nr_cma_inactive_anon", "nr_cma_active_anon", "nr_cma_inactive_file"
+};
+
+struct snap_cache {
+	char name[KMEMCACHE_NAME_SIZE + 1];
+	unsigned long active_objs;
+	unsigned long num_objs;
+	unsigned int size;
+};
+
+struct snap_task {
+	int pid;
+	char comm[TASK_COMM_LEN + 1];
+	unsigned long rss;
+};
+
+struct snapshot {
+	struct ramdump* dump;
+	const char* dir;
+	int vm_stat_valid;
+	unsigned int vm_stat[VM_BUF_SIZE];
+	unsigned int nr_free[MAX_ORDER];
+	unsigned int free_count[MIGRATE_TYPES][MAX_ORDER];
+	struct snap_cache* caches;
+	unsigned int nr_caches, max_caches;
+	struct snap_task* tasks;
+	unsigned int nr_tasks, max_tasks;
+	int ret;
+};
+
+/*A row of the report, side is 0 when in both dumps, 1 when only in
+ *the first and 2 when only in the second
+ */
+struct snap_delta {
+	const char* name;
+	int pid;
+	int side;
+	long before, after;
+	long before2, after2;
+};
+
+__thread struct snapshot* cur_snapshot;
+
+/*Room for one more entry in an array of a snapshot*/
+void* snap_grow(void** array, unsigned int nr, unsigned int* max, size_t size)
+{
+	void* grown;
+
+	if(nr < *max)
+		return *array;
+
+	grown = realloc(*array, (*max ? *max * 2 : 64) * size);
+	if(!grown) {
+		printf("Out of memory for the snapshot of %s\n", cur_snapshot->dump->path);
+		cur_snapshot->ret = -1;
+		return NULL;
+	}
+	*max = *max ? *max * 2 : 64;
+	*array = grown;
+
+	return grown;
+}
+
+void snap_vm_stat(const void* vm_buf)
+{
+	if(!cur_snapshot)
+		return;
+
+	memcpy(cur_snapshot->vm_stat, vm_buf, sizeof(cur_snapshot->vm_stat));
+	cur_snapshot->vm_stat_valid = 1;
+}
+
+void snap_cache(const char* name, unsigned long active_objs, unsigned long num_objs, unsigned int size)
+{
+	struct snapshot* s = cur_snapshot;
+	struct snap_cache* c;
+
+	if(!s || !snap_grow((void**)&s->caches, s->nr_caches, &s->max_caches, sizeof(*c)))
+		return;
+
+	c = &s->caches[s->nr_caches++];
+	snprintf(c->name, sizeof(c->name), "%s", name);
+	c->active_objs = active_objs;
+	c->num_objs = num_objs;
+	c->size = size;
+}
+
+void snap_task(int pid, const char* comm, unsigned long rss)
+{
+	struct snapshot* s = cur_snapshot;
+	struct snap_task* t;
+
+	if(!s || !snap_grow((void**)&s->tasks, s->nr_tasks, &s->max_tasks, sizeof(*t)))
+		return;
+
+	t = &s->tasks[s->nr_tasks++];
+	t->pid = pid;
+	snprintf(t->comm, sizeof(t->comm), "%.*s", TASK_COMM_LEN, comm);
+	t->rss = rss;
+}
+
+void snap_buddy(int order, unsigned int nr_free)
+{
+	if(cur_snapshot && order < MAX_ORDER)
+		cur_snapshot->nr_free[order] = nr_free;
+}
+
+void snap_pagetype(int type, int order, unsigned int count)
+{
+	if(cur_snapshot && type < MIGRATE_TYPES && order < MAX_ORDER)
+		cur_snapshot->free_count[type][order] = count;
+}
+
+DWORD WINAPI diff_thread(LPVOID arg)
+{
+	struct snapshot* s = arg;
+	struct extractor* e;
+	unsigned int i;
+
+	cur_dump = s->dump;
+	cur_snapshot = s;
+	output_dir = s->dir;
+	CreateDirectory(s->dir, NULL);
+
+	for(i = 0; i < NR_DIFF_EXTRACTORS; i++) {
+		e = find_extractor(diff_extractors[i], strlen(diff_extractors[i]));
+		if(e->skip)
+			continue;
+		if(e->extract()) {
+			printf("Failed to extract %s of %s..but continuing\n", e->name, s->dump->path);
+			s->ret = -1;
+		}
+	}
+
+	return 0;
+}
+
+int cmp_snap_cache(const void* a, const void* b)
+{
+	return strcmp(((const struct snap_cache*)a)->name, ((const struct snap_cache*)b)->name);
+}
+
+int cmp_snap_task(const void* a, const void* b)
+{
+	const struct snap_task *x = a, *y = b;
+
+	if(x->pid != y->pid)
+		return x->pid < y->pid ? -1 : 1;
+	return strcmp(x->comm, y->comm);
+}
+
+/*Matched rows first, by the largest growth, then what is only in one
+ *dump, the largest first
+ */
+int cmp_snap_delta(const void* a, const void* b)
+{
+	const struct snap_delta *x = a, *y = b;
+	long dx, dy;
+
+	if(x->side != y->side)
+		return x->side < y->side ? -1 : 1;
+	dx = x->side == 1 ? x->before : x->after - x->before;
+	dy = y->side == 1 ? y->before : y->after - y->before;
+	if(dx != dy)
+		return dx > dy ? -1 : 1;
+	dx = x->after2 - x->before2;
+	dy = y->after2 - y->before2;
+	if(dx != dy)
+		return dx > dy ? -1 : 1;
+	if(x->pid != y->pid)
+		return x->pid < y->pid ? -1 : 1;
+	return strcmp(x->name, y->name);
+}
+
+const char* delta_side[] = {"", "gone", "new"};
+
+void diff_vm_stat(struct snapshot* a, struct snapshot* b)
+{
+	struct snap_delta rows[VM_BUF_SIZE];
+	int i, n = 0;
+
+	fprintf(output_fp, "vm_stat (pages):\n");
+	fprintf(output_fp, "%-24s%12s%12s%12s\n", "item", "before", "after", "delta");
+	if(!a->vm_stat_valid || !b->vm_stat_valid) {
+		fprintf(output_fp, "not read from both dumps\n\n");
+		return;
+	}
+
+	for(i = 0; i < VM_BUF_SIZE; i++) {
+		if(a->vm_stat[i] == b->vm_stat[i])
+			continue;
+		memset(&rows[n], 0, sizeof(rows[n]));
+		rows[n].name = vm_stat_names[i];
+		rows[n].before = (long)a->vm_stat[i];
+		rows[n].after = (long)b->vm_stat[i];
+		n++;
+	}
+	qsort(rows, n, sizeof(rows[0]), cmp_snap_delta);
+
+	for(i = 0; i < n; i++)
+		fprintf(output_fp, "%-24s%12ld%12ld%+12ld\n", rows[i].name, rows[i].before,
+				rows[i].after, rows[i].after - rows[i].before);
+	fprintf(output_fp, "\n");
+}
+
+void diff_free_pages(struct snapshot* a, struct snapshot* b)
+{
+	long before, after;
+	int i, j;
+
+	fprintf(output_fp, "buddy nr_free:\n");
+	fprintf(output_fp, "%-24s%12s%12s%12s\n", "order", "before", "after", "delta");
+	for(i = 0; i < MAX_ORDER; i++)
+		fprintf(output_fp, "%-24d%12u%12u%+12ld\n", i, a->nr_free[i], b->nr_free[i],
+				(long)b->nr_free[i] - (long)a->nr_free[i]);
+
+	fprintf(output_fp, "\nfree pages per migrate type:\n");
+	fprintf(output_fp, "%-24s%12s%12s%12s\n", "type", "before", "after", "delta");
+	for(i = 0; i < MIGRATE_TYPES; i++) {
+		before = after = 0;
+		for(j = 0; j < MAX_ORDER; j++) {
+			before += (long)a->free_count[i][j] << j;
+			after += (long)b->free_count[i][j] << j;
+		}
+		fprintf(output_fp, "%-24s%12ld%12ld%+12ld\n", migratetype_names[i], before, after, after - before);
+	}
+	fprintf(output_fp, "\n");
+}
+
+int diff_caches(struct snapshot* a, struct snapshot* b)
+{
+	struct snap_delta* rows;
+	unsigned int i = 0, j = 0, n = 0;
+	int c;
+
+	rows = malloc((a->nr_caches + b->nr_caches + 1) * sizeof(*rows));
+	if(!rows) {
+		printf("Out of memory for the diff of the caches\n");
+		return -1;
+	}
+
+	qsort(a->caches, a->nr_caches, sizeof(*a->caches), cmp_snap_cache);
+	qsort(b->caches, b->nr_caches, sizeof(*b->caches), cmp_snap_cache);
+
+	while(i < a->nr_caches || j < b->nr_caches) {
+		if(i == a->nr_caches)
+			c = 1;
+		else if(j == b->nr_caches)
+			c = -1;
+		else
+			c = cmp_snap_cache(&a->caches[i], &b->caches[j]);
+
+		memset(&rows[n], 0, sizeof(rows[n]));
+		if(c <= 0) {
+			rows[n].name = a->caches[i].name;
+			rows[n].before = a->caches[i].num_objs;
+			rows[n].before2 = a->caches[i].active_objs;
+			i++;
+		}
+		if(c >= 0) {
+			rows[n].name = b->caches[j].name;
+			rows[n].after = b->caches[j].num_objs;
+			rows[n].after2 = b->caches[j].active_objs;
+			j++;
+		}
+		rows[n].side = c < 0 ? 1 : c > 0 ? 2 : 0;
+		n++;
+	}
+	qsort(rows, n, sizeof(*rows), cmp_snap_delta);
+
+	fprintf(output_fp, "slab caches, by growth of num_objs:\n");
+	fprintf(output_fp, "%-24s%12s%12s%12s%12s%12s%12s%6s\n", "name", "num_objs", "after", "delta",
+			"active_objs", "after", "delta", "");
+	for(i = 0; i < n; i++)
+		fprintf(output_fp, "%-24s%12ld%12ld%+12ld%12ld%12ld%+12ld%6s\n", rows[i].name,
+				rows[i].before, rows[i].after, rows[i].after - rows[i].before,
+				rows[i].before2, rows[i].after2, rows[i].after2 - rows[i].before2,
+				delta_side[rows[i].side]);
+	fprintf(output_fp, "\n");
+
+	free(rows);
+	return 0;
+}
+
+/*Tasks are matched by pid and comm, a reused pid is a new task*/
+int diff_tasks(struct snapshot* a, struct snapshot* b)
+{
+	struct snap_delta* rows;
+	unsigned int i = 0, j = 0, n = 0;
+	int c, side = -1;
+
+	rows = malloc((a->nr_tasks + b->nr_tasks + 1) * sizeof(*rows));
+	if(!rows) {
+		printf("Out of memory for the diff of the tasks\n");
+		return -1;
+	}
+
+	qsort(a->tasks, a->nr_tasks, sizeof(*a->tasks), cmp_snap_task);
+	qsort(b->tasks, b->nr_tasks, sizeof(*b->tasks), cmp_snap_task);
+
+	while(i < a->nr_tasks || j < b->nr_tasks) {
+		if(i == a->nr_tasks)
+			c = 1;
+		else if(j == b->nr_tasks)
+			c = -1;
+		else
+			c = cmp_snap_task(&a->tasks[i], &b->tasks[j]);
+
+		memset(&rows[n], 0, sizeof(rows[n]));
+		if(c <= 0) {
+			rows[n].name = a->tasks[i].comm;
+			rows[n].pid = a->tasks[i].pid;
+			rows[n].before = a->tasks[i].rss;
+			i++;
+		}
+		if(c >= 0) {
+			rows[n].name = b->tasks[j].comm;
+			rows[n].pid = b->tasks[j].pid;
+			rows[n].after = b->tasks[j].rss;
+			j++;
+		}
+		rows[n].side = c < 0 ? 1 : c > 0 ? 2 : 0;
+		n++;
+	}
+	qsort(rows, n, sizeof(*rows), cmp_snap_delta);
+
+	for(i = 0; i < n; i++) {
+		if(rows[i].side != side) {
+			side = rows[i].side;
+			fprintf(output_fp, "%s\n", side == 0 ? "tasks, by growth of rss (pages):" :
+					side == 1 ? "\nmissing tasks:" : "\nnew tasks:");
+			fprintf(output_fp, "%-20s%8s%12s%12s%12s\n", "COMM", "PID", "before", "after", "delta");
+		}
+		fprintf(output_fp, "%-20s%8d%12ld%12ld%+12ld\n", rows[i].name, rows[i].pid,
+				rows[i].before, rows[i].after, rows[i].after - rows[i].before);
+	}
+	fprintf(output_fp, "\n");
+
+	free(rows);
+	return 0;
+}
+
+int run_diff(const char* path, const char* smap_path)
+{
+	struct ramdump after;
+	struct smap after_smap;
+	struct snapshot snaps[2];
+	HANDLE threads[2];
+	int i, n = 0, ret = 0;
+
+	memset(&after, 0, sizeof(after));
+	after.path = path;
+	after.smap = &main_smap;
+	if(smap_path) {
+		memset(&after_smap, 0, sizeof(after_smap));
+		after_smap.path = smap_path;
+		InitializeCriticalSection(&after_smap.lock);
+		after.smap = &after_smap;
+	}
+	if(map_ramdump(&after))
+		return -1;
+
+	memset(snaps, 0, sizeof(snaps));
+	snaps[0].dump = &main_dump;
+	snaps[0].dir = "before";
+	snaps[1].dump = &after;
+	snaps[1].dir = "after";
+
+	for(i = 0; i < 2; i++) {
+		threads[n] = CreateThread(NULL, 0, diff_thread, &snaps[i], 0, NULL);
+		if(threads[n])
+			n++;
+		else
+			diff_thread(&snaps[i]);
+	}
+	WaitForMultipleObjects(n, threads, TRUE, INFINITE);
+	for(i = 0; i < n; i++)
+		CloseHandle(threads[i]);
+
+	output_fp = open_output(output_diff_file_path, "w");
+	if(!output_fp) {
+		printf("Error opening the output file %s\n", output_diff_file_path);
+		ret = -1;
+	} else {
+		fprintf(output_fp, "Ramdump diff\n");
+		fprintf(output_fp, "------------\n");
+		fprintf(output_fp, "before: %s\nafter:  %s\n\n", main_dump.path, after.path);
+		diff_vm_stat(&snaps[0], &snaps[1]);
+		diff_free_pages(&snaps[0], &snaps[1]);
+		if(diff_caches(&snaps[0], &snaps[1]) || diff_tasks(&snaps[0], &snaps[1]))
+			ret = -1;
+		fclose(output_fp);
+	}
+
+	for(i = 0; i < 2; i++) {
+		free(snaps[i].caches);
+		free(snaps[i].tasks);
+	}
+	unmap_ramdump(&after);
+	if(after.smap != &main_smap)
+		free_smap(&after_smap);
+
+	return ret;
+}
+
+/*-B: every ramdump of a directory, each with the System.map of the
+ *same name (dump.bin, dump.map), else the System.map of the directory,
+ *else the one of -m. The dumps run in parallel on -j threads, one
+ *thread per dump, each with its files under <dump>.out and at most
+ *its budget of the image mapped. System.maps with the same contents
+ *are read once and shared. Every dump gets a row in batch_summary.txt.
+ */
+unsigned char* output_batch_file_path = "./batch_summary.txt";
+
+const char* batch_extractors[] = {"meminfo", "slab", "tasks", "klog"};
+
+#define NR_BATCH_EXTRACTORS (sizeof(batch_extractors) / sizeof(batch_extractors[0]))
+#define BATCH_TOP_CACHES 5
+
+struct batch_smap {
+	char path[MAX_PATH];
+	unsigned long long hash;
+	struct smap* smap;
+};
+
+struct batch_dump {
+	char name[MAX_PATH];
+	char path[MAX_PATH];
+	char dir[MAX_PATH];
+	struct ramdump dump;
+	struct snapshot snap;
+	int nr_run, nr_failed;
+
+	/*the row of the summary*/
+	long free_kb;
+	struct snap_cache top[BATCH_TOP_CACHES];
+	unsigned int nr_top;
+	struct snap_task task;
+	char crash_pc[128];
+};
+
+struct batch_dump* batch_dumps;
+unsigned int nr_batch_dumps;
+struct batch_smap* batch_smaps;
+unsigned int nr_batch_smaps;
+volatile LONG next_batch_dump;
+
+/*FNV-1a over the contents of a System.map*/
+unsigned long long smap_content_hash(const char* text)
+{
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+
+	for(; *text; text++)
+		hash = (hash ^ (unsigned char)*text) * 0x100000001b3ULL;
+
+	return hash;
+}
+
+/*The System.map read from path, or one with the same contents*/
+struct smap* batch_smap(const char* path)
+{
+	struct batch_smap* b;
+	struct smap* smap;
+	unsigned long long hash;
+	unsigned int i;
+	long size;
+	char* text;
+
+	for(i = 0; i < nr_batch_smaps; i++) {
+		if(!strcmp(batch_smaps[i].path, path))
+			return batch_smaps[i].smap;
+	}
+
+	text = read_smap(path, &size);
+	if(!text)
+		return NULL;
+	hash = smap_content_hash(text);
+
+	b = realloc(batch_smaps, (nr_batch_smaps + 1) * sizeof(*b));
+	if(!b) {
+		printf("Out of memory for the system map %s\n", path);
+		free(text);
+		return NULL;
+	}
+	batch_smaps = b;
+	b = &batch_smaps[nr_batch_smaps];
+	snprintf(b->path, sizeof(b->path), "%s", path);
+	b->hash = hash;
+
+	for(i = 0; i < nr_batch_smaps; i++) {
+		if(batch_smaps[i].hash == hash && !strcmp(batch_smaps[i].smap->text, text)) {
+			free(text);
+			b->smap = batch_smaps[i].smap;
+			nr_batch_smaps++;
+			return b->smap;
+		}
+	}
+
+	smap = calloc(1, sizeof(*smap) + strlen(path) + 1);
+	if(!smap) {
+		printf("Out of memory for the system map %s\n", path);
+		free(text);
+		return NULL;
+	}
+	smap->path = strcpy((char*)(smap + 1), path);
+	smap->text = text;
+	InitializeCriticalSection(&smap->lock);
+	b->smap = smap;
+	nr_batch_smaps++;
+
+	return smap;
+}
+
+int file_exists(const char* path)
+{
+	DWORD attributes = GetFileAttributes(path);
+
+	return attributes != INVALID_FILE_ATTRIBUTES && !(attributes & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+int is_smap_name(const char* name)
+{
+	size_t len = strlen(name);
+
+	return !strcmp(name, "System.map") || (len > 4 && !strcmp(name + len - 4, ".map"));
+}
+
+/*The ramdumps of a directory, in the order of their names*/
+int cmp_batch_dump(const void* a, const void* b)
+{
+	return strcmp(((const struct batch_dump*)a)->name, ((const struct batch_dump*)b)->name);
+}
+
+int find_batch_dumps(const char* dir)
+{
+	WIN32_FIND_DATA data;
+	HANDLE find;
+	struct batch_dump* b;
+	unsigned int max = 0;
+	char pattern[MAX_PATH];
+
+	snprintf(pattern, sizeof(pattern), "%s\\*", dir);
+	find = FindFirstFile(pattern, &data);
+	if(find == INVALID_HANDLE_VALUE) {
+		printf("Error reading the directory %s\n", dir);
+		return -1;
+	}
+
+	do {
+		if((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || is_smap_name(data.cFileName))
+			continue;
+		if(nr_batch_dumps == max) {
+			max = max ? max * 2 : 64;
+			b = realloc(batch_dumps, max * sizeof(*b));
+			if(!b) {
+				printf("Out of memory listing %s\n", dir);
+				FindClose(find);
+				return -1;
+			}
+			batch_dumps = b;
+		}
+		b = &batch_dumps[nr_batch_dumps++];
+		memset(b, 0, sizeof(*b));
+		snprintf(b->name, sizeof(b->name), "%s", data.cFileName);
+		snprintf(b->path, sizeof(b->path), "%s\\%s", dir, data.cFileName);
+		snprintf(b->dir, sizeof(b->dir), "%s.out", data.cFileName);
+	} while(FindNextFile(find, &data));
+	FindClose(find);
+
+	qsort(batch_dumps, nr_batch_dumps, sizeof(*batch_dumps), cmp_batch_dump);
+
+	return 0;
+}
+
+/*The System.map that goes with a ramdump of the directory*/
+const char* batch_smap_path(const char* dir, const char* name, char* buf)
+{
+	const char* dot = strrchr(name, '.');
+
+	snprintf(buf, MAX_PATH, "%s\\%.*s.map", dir, dot ? (int)(dot - name) : (int)strlen(name), name);
+	if(file_exists(buf))
+		return buf;
+
+	snprintf(buf, MAX_PATH, "%s\\System.map", dir);
+	if(file_exists(buf))
+		return buf;
+
+	return main_smap.path;
+}
+
+int cmp_cache_size(const void* a, const void* b)
+{
+	const struct snap_cache *x = a, *y = b;
+	unsigned long long sx = (unsigned long long)x->num_objs * x->size;
+	unsigned long long sy = (unsigned long long)y->num_objs * y->size;
+
+	if(sx != sy)
+		return sx > sy ? -1 : 1;
+	return strcmp(x->name, y->name);
+}
+
+/*The last "PC is at" of the kernel log of a dump*/
+void batch_crash_pc(struct batch_dump* b)
+{
+	char line[512], *pc, *end;
+	FILE* fp;
+
+	strcpy(b->crash_pc, "-");
+	fp = open_output(output_kernel_log_file_path, "r");
+	if(!fp)
+		return;
+
+	while(fgets(line, sizeof(line), fp)) {
+		pc = strstr(line, "PC is at ");
+		if(!pc)
+			continue;
+		pc += strlen("PC is at ");
+		end = pc + strcspn(pc, "\r\n");
+		*end = 0;
+		snprintf(b->crash_pc, sizeof(b->crash_pc), "%s", pc);
+	}
+	fclose(fp);
+}
+
+/*Keeps the row of the summary and frees the snapshot*/
+void batch_row(struct batch_dump* b)
+{
+	struct snapshot* s = &b->snap;
+	unsigned int i;
+
+	b->free_kb = s->vm_stat_valid ? (long)s->vm_stat[NR_FREE_PAGES] * (PAGE_SIZE / 1024) : -1;
+
+	qsort(s->caches, s->nr_caches, sizeof(*s->caches), cmp_cache_size);
+	for(b->nr_top = 0; b->nr_top < BATCH_TOP_CACHES && b->nr_top < s->nr_caches; b->nr_top++)
+		b->top[b->nr_top] = s->caches[b->nr_top];
+
+	b->task.pid = -1;
+	for(i = 0; i < s->nr_tasks; i++) {
+		if(b->task.pid < 0 || s->tasks[i].rss > b->task.rss)
+			b->task = s->tasks[i];
+	}
+
+	free(s->caches);
+	free(s->tasks);
+	s->caches = NULL;
+	s->tasks = NULL;
+}
+
+void batch_one(struct batch_dump* b)
+{
+	struct extractor* e;
+	unsigned int i;
+
+	cur_dump = &b->dump;
+	cur_snapshot = &b->snap;
+	output_dir = b->dir;
+	b->snap.dump = &b->dump;
+	b->snap.dir = b->dir;
+	CreateDirectory(b->dir, NULL);
+
+	if(map_ramdump(&b->dump)) {
+		b->nr_failed = 1;
+		return;
+	}
+
+	for(i = 0; i < NR_BATCH_EXTRACTORS; i++) {
+		e = find_extractor(batch_extractors[i], strlen(batch_extractors[i]));
+		if(e->skip)
+			continue;
+		b->nr_run++;
+		if(e->extract()) {
+			printf("Failed to extract %s of %s..but continuing\n", e->name, b->path);
+			b->nr_failed++;
+		}
+	}
+	unmap_ramdump(&b->dump);
+
+	batch_crash_pc(b);
+	batch_row(b);
+}
+
+DWORD WINAPI batch_thread(LPVOID arg)
+{
+	LONG i;
+
+	while((i = InterlockedIncrement(&next_batch_dump) - 1) < (LONG)nr_batch_dumps) {
+		if(batch_dumps[i].dump.smap)
+			batch_one(&batch_dumps[i]);
+	}
+
+	return 0;
+}
+
+void write_batch_summary(void)
+{
+	struct batch_dump* b;
+	unsigned int i, j;
+	char task[64], free_kb[16];
+
+	fprintf(output_fp, "%-32s%12s%8s  %-28s%-40s%s\n", "DUMP", "FREE_KB", "STATUS",
+			"LARGEST_RSS (pid comm kb)", "CRASH_PC", "SLAB_TOP5 (name kb)");
+	for(i = 0; i < nr_batch_dumps; i++) {
+		b = &batch_dumps[i];
+		if(b->task.pid >= 0)
+			snprintf(task, sizeof(task), "%d %s %lu", b->task.pid, b->task.comm,
+					b->task.rss * (PAGE_SIZE / 1024));
+		else
+			strcpy(task, "-");
+		if(b->free_kb >= 0)
+			sprintf(free_kb, "%ld", b->free_kb);
+		else
+			strcpy(free_kb, "-");
+
+		fprintf(output_fp, "%-32s%12s%8s  %-28s%-40s", b->name, free_kb,
+				!b->dump.smap ? "no map" : b->nr_failed >= b->nr_run ? "failed" :
+				b->nr_failed ? "partial" : "ok", task, b->crash_pc);
+		for(j = 0; j < b->nr_top; j++)
+			fprintf(output_fp, "%s%s %llu", j ? ", " : "", b->top[j].name,
+					(unsigned long long)b->top[j].num_objs * b->top[j].size / 1024);
+		fprintf(output_fp, "%s\n", b->nr_top ? "" : "-");
+	}
+}
+
+int run_batch(const char* dir, int nr_threads, unsigned long long budget)
+{
+	HANDLE threads[MAXIMUM_WAIT_OBJECTS];
+	SYSTEM_INFO info;
+	char smap_path[MAX_PATH];
+	const char* path;
+	unsigned int i;
+	int n = 0;
+
+	if(find_batch_dumps(dir))
+		return -1;
+
+	for(i = 0; i < nr_batch_dumps; i++) {
+		batch_dumps[i].dump.path = batch_dumps[i].path;
+		batch_dumps[i].dump.budget = budget;
+		path = batch_smap_path(dir, batch_dumps[i].name, smap_path);
+		if(!path)
+			printf("No system map for %s\n", batch_dumps[i].path);
+		else
+			batch_dumps[i].dump.smap = batch_smap(path);
+		batch_dumps[i].free_kb = -1;
+		batch_dumps[i].task.pid = -1;
+		strcpy(batch_dumps[i].crash_pc, "-");
+	}
+
+	if(nr_threads <= 0) {
+		GetSystemInfo(&info);
+		nr_threads = info.dwNumberOfProcessors;
+	}
+	if(nr_threads > (int)nr_batch_dumps)
+		nr_threads = nr_batch_dumps;
+	if(nr_threads > MAXIMUM_WAIT_OBJECTS)
+		nr_threads = MAXIMUM_WAIT_OBJECTS;
+
+	for(i = 0; i < (unsigned int)nr_threads; i++) {
+		threads[n] = CreateThread(NULL, 0, batch_thread, NULL, 0, NULL);
+		if(!threads[n]) {
+			printf("Error starting the thread %d\n", i);
+			break;
+		}
+		n++;
+	}
+
+	//no thread could be started, run them here
+	if(!n)
+		batch_thread(NULL);
+
+	WaitForMultipleObjects(n, threads, TRUE, INFINITE);
+	for(i = 0; i < (unsigned int)n; i++)
+		CloseHandle(threads[i]);
+
+	output_fp = open_output(output_batch_file_path, "w");
+	if(!output_fp) {
+		printf("Error opening the output file %s\n", output_batch_file_path);
+		return -1;
+	}
+	write_batch_summary();
+	fclose(output_fp);
+
+	for(i = 0; i < nr_batch_smaps; i++) {
+		for(n = 0; n < (int)i && batch_smaps[n].smap != batch_smaps[i].smap; n++)
+			;
+		if(n == (int)i) {
+			free_smap(batch_smaps[i].smap);
+			free(batch_smaps[i].smap);
+		}
+	}
+	free(batch_smaps);
+	free(batch_dumps);
+
+	return 0;
+}
+
+/*-C: the files of every extractor are kept under
+ *<cache>\<dump hash>-<System.map hash>-<VERSION>\<key>.<version> and
+ *copied from there while none of these change. The hash of a dump is
+ *kept in <cache>\dumps.txt against its path, size and time, so an
+ *unchanged dump is not read again either.
+ */
+#define HASH_CHUNK (4 << 20)
+
+unsigned long long* chunk_hashes;
+unsigned char* chunk_hashed;	/*a chunk that could not be read stays 0*/
+unsigned long long nr_chunks;
+volatile LONG next_chunk;
+
+/*A word at a time, the chunks of a dump are hashed in parallel*/
+unsigned long long hash_words(const unsigned char* buf, unsigned int len, unsigned long long hash)
+{
+	unsigned long long word;
+	unsigned int i;
+
+	for(i = 0; i + 8 <= len; i += 8) {
+		memcpy(&word, buf + i, 8);
+		hash = (hash ^ word) * 0x100000001b3ULL;
+		hash ^= hash >> 29;
+	}
+	for(; i < len; i++)
+		hash = (hash ^ buf[i]) * 0x100000001b3ULL;
+
+	return hash;
+}
+
+DWORD WINAPI hash_thread(LPVOID arg)
+{
+	unsigned char* buf = NULL;
+	unsigned long long start;
+	unsigned int len;
+	LONG i;
+
+	cur_dump = arg;
+	if(!cur_dump->image) {
+		buf = malloc(HASH_CHUNK);
+		if(!buf)
+			return 0;
+	}
+
+	while((i = InterlockedIncrement(&next_chunk) - 1) < (LONG)nr_chunks) {
+		start = (unsigned long long)i * HASH_CHUNK;
+		len = cur_dump->size - start < HASH_CHUNK ? cur_dump->size - start : HASH_CHUNK;
+		if(cur_dump->image)
+			chunk_hashes[i] = hash_words(cur_dump->image + start, len, 0xcbf29ce484222325ULL ^ i);
+		else if(!read_ramdump(RAM_START + start, len, buf))
+			chunk_hashes[i] = hash_words(buf, len, 0xcbf29ce484222325ULL ^ i);
+		else
+			continue;
+		chunk_hashed[i] = 1;
+	}
+	free(buf);
+
+	return 0;
+}
+
+int hash_ramdump(struct ramdump* dump, int nr_threads, unsigned long long* hash)
+{
+	HANDLE threads[MAXIMUM_WAIT_OBJECTS];
+	SYSTEM_INFO info;
+	unsigned long long i;
+	int n = 0;
+
+	nr_chunks = (dump->size + HASH_CHUNK - 1) / HASH_CHUNK;
+	chunk_hashes = calloc(nr_chunks + 1, sizeof(*chunk_hashes));
+	chunk_hashed = calloc(nr_chunks + 1, 1);
+	if(!chunk_hashes || !chunk_hashed) {
+		printf("Out of memory hashing %s\n", dump->path);
+		free(chunk_hashes);
+		free(chunk_hashed);
+		return -1;
+	}
+	next_chunk = 0;
+
+	if(nr_threads <= 0) {
+		GetSystemInfo(&info);
+		nr_threads = info.dwNumberOfProcessors;
+	}
+	if(nr_threads > MAXIMUM_WAIT_OBJECTS)
+		nr_threads = MAXIMUM_WAIT_OBJECTS;
+	if(nr_threads > (int)nr_chunks)
+		nr_threads = nr_chunks;
+
+	for(i = 0; i < (unsigned long long)nr_threads; i++) {
+		threads[n] = CreateThread(NULL, 0, hash_thread, dump, 0, NULL);
+		if(threads[n])
+			n++;
+	}
+	if(!n)
+		hash_thread(dump);
+	WaitForMultipleObjects(n, threads, TRUE, INFINITE);
+	for(i = 0; i < (unsigned long long)n; i++)
+		CloseHandle(threads[i]);
+
+	/*a part of the dump that was not hashed would make a wrong key*/
+	for(i = 0; i < nr_chunks && chunk_hashed[i]; i++)
+		;
+	if(i < nr_chunks)
+		printf("Error hashing %s at 0x%llx\n", dump->path, i * HASH_CHUNK);
+	else
+		*hash = hash_words((unsigned char*)chunk_hashes, nr_chunks * sizeof(*chunk_hashes), dump->size);
+	free(chunk_hashes);
+	free(chunk_hashed);
+
+	return i < nr_chunks ? -1 : 0;
+}
+
+/*The hash of the dump, from dumps.txt when its size and time match*/
+int cached_dump_hash(const char* dir, struct ramdump* dump, int nr_threads, unsigned long long* hash)
+{
+	FILETIME time;
+	unsigned long long mtime, size, t, h;
+	char path[MAX_PATH], line[MAX_PATH + 64];
+	FILE* fp;
+	int n;
+
+	if(!GetFileTime(dump->file, NULL, NULL, &time))
+		return hash_ramdump(dump, nr_threads, hash);
+	mtime = ((unsigned long long)time.dwHighDateTime << 32) | time.dwLowDateTime;
+
+	snprintf(path, sizeof(path), "%s\\dumps.txt", dir);
+	fp = fopen(path, "r");
+	if(fp) {
+		while(fgets(line, sizeof(line), fp)) {
+			line[strcspn(line, "\r\n")] = 0;
+			if(sscanf(line, "%llx %llu %llu %n", &h, &size, &t, &n) == 3 &&
+					size == dump->size && t == mtime && !strcmp(line + n, dump->path)) {
+				fclose(fp);
+				*hash = h;
+				return 0;
+			}
+		}
+		fclose(fp);
+	}
+
+	if(hash_ramdump(dump, nr_threads, hash))
+		return -1;
+
+	fp = fopen(path, "a");
+	if(fp) {
+		fprintf(fp, "%016llx %llu %llu %s\n", *hash, dump->size, mtime, dump->path);
+		fclose(fp);
+	}
+
+	return 0;
+}
+
+int open_cache(const char* dir, int nr_threads)
+{
+	struct smap* smap = main_dump.smap;
+	unsigned long long dump_hash, smap_hash;
+	long size;
+
+	CreateDirectory(dir, NULL);
+
+	if(!smap->text && !(smap->text = read_smap(smap->path, &size)))
+		return -1;
+	smap_hash = smap_content_hash(smap->text);
+
+	if(cached_dump_hash(dir, &main_dump, nr_threads, &dump_hash))
+		return -1;
+
+	snprintf(cache_entry, sizeof(cache_entry), "%s\\%016llx-%016llx-%s", dir, dump_hash, smap_hash, VERSION);
+	CreateDirectory(cache_entry, NULL);
+
+	return 0;
+}
+
+int copy_tree(const char* from, const char* to)
+{
+	WIN32_FIND_DATA data;
+	HANDLE find;
+	char pattern[MAX_PATH], src[MAX_PATH], dst[MAX_PATH];
+	int ret = 0;
+
+	CreateDirectory(to, NULL);
+	snprintf(pattern, sizeof(pattern), "%s\\*", from);
+	find = FindFirstFile(pattern, &data);
+	if(find == INVALID_HANDLE_VALUE)
+		return -1;
+
+	do {
+		if(!strcmp(data.cFileName, ".") || !strcmp(data.cFileName, ".."))
+			continue;
+		snprintf(src, sizeof(src), "%s\\%s", from, data.cFileName);
+		snprintf(dst, sizeof(dst), "%s\\%s", to, data.cFileName);
+		if(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			ret |= copy_tree(src, dst);
+		else if(!CopyFile(src, dst, FALSE))
+			ret = -1;
+	} while(FindNextFile(find, &data));
+	FindClose(find);
+
+	return ret;
+}
+
+/*Copies the files of an extractor from the cache, or extracts them
+ *there first. Only a run that succeeded is kept for the next one.
+ */
+int run_cached(struct extractor* e)
+{
+	char entry[MAX_PATH], work[MAX_PATH];
+	DWORD attributes;
+	int ret;
+
+	snprintf(entry, sizeof(entry), "%s\\%s.%d", cache_entry, e->key, e->version);
+	attributes = GetFileAttributes(entry);
+	if(attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+		e->cached = 1;
+		return copy_tree(entry, ".");
+	}
+
+	snprintf(work, sizeof(work), "%s.tmp", entry);
+	CreateDirectory(work, NULL);
+	output_dir = work;
+	ret = e->extract();
+	output_dir = NULL;
+
+	if(copy_tree(work, "."))
+		printf("Error copying %s from the cache\n", e->name);
+	if(!ret && !MoveFile(work, entry))
+		printf("Error keeping %s in the cache\n", e->name);
+
+	return ret;
+}
+
+/*--bench: the loops the extractors spend their time in, each timed
+ *alone on the loaded dump, then every extractor alone on this thread.
+ *The inputs only depend on the dump and System.map, and the best of
+ *BENCH_RUNS is kept, so the JSON of two builds can be compared.
+ */
+#define BENCH_RUNS 3
+#define BENCH_OPS (1 << 20)
+#define BENCH_READ_SIZE (256ULL << 20)	/*read in 4K blocks at most*/
+#define BENCH_SEARCH_VAL 0xdeadbeef
+
+struct bench {
+	const char* name;
+	int (*run)(struct bench* b);
+	unsigned long long ops;
+	unsigned long long bytes;
+	double ms;
+	int skip;	/*nothing in this dump to run it on*/
+};
+
+volatile unsigned int bench_sink;
+unsigned int* bench_offsets;	/*of random words of the dump*/
+unsigned int* bench_vas;	/*symbols the page tables translate*/
+unsigned int nr_bench_vas;
+
+/*The i-th symbol, spread over the table*/
+struct smap_sym* bench_sym(unsigned int i)
+{
+	struct smap* smap = cur_dump->smap;
+
+	return &smap->syms[(unsigned int)((i * 2654435761ULL) % smap->nr_syms)];
+}
+
+int bench_read_uint(struct bench* b)
+{
+	unsigned int i, val;
+
+	for(i = 0; i < BENCH_OPS; i++) {
+		if(read_uint_from_ramdump(RAM_START + bench_offsets[i], &val))
+			return -1;
+		bench_sink += val;
+	}
+	b->ops = BENCH_OPS;
+	b->bytes = b->ops * 4;
+
+	return 0;
+}
+
+int bench_read_4k(struct bench* b)
+{
+	static char buf[PAGE_SIZE];
+	unsigned long long pos, size = cur_dump->size < BENCH_READ_SIZE ? cur_dump->size : BENCH_READ_SIZE;
+
+	b->ops = 0;
+	for(pos = 0; pos + PAGE_SIZE <= size; pos += PAGE_SIZE, b->ops++) {
+		if(read_buf_from_ramdump(RAM_START + (unsigned int)pos, PAGE_SIZE, buf))
+			return -1;
+		bench_sink += buf[0];
+	}
+	b->bytes = b->ops * PAGE_SIZE;
+
+	return 0;
+}
+
+int bench_smap_lookup(struct bench* b)
+{
+	struct smap_sym* sym;
+	unsigned int i;
+
+	for(i = 0; i < BENCH_OPS; i++) {
+		sym = bench_sym(i);
+		bench_sink += get_addr_from_smap(sym->name, strlen(sym->name));
+	}
+	b->ops = BENCH_OPS;
+
+	return 0;
+}
+
+int bench_smap_symbol(struct bench* b)
+{
+	unsigned int i, offset;
+
+	for(i = 0; i < BENCH_OPS; i++)
+		bench_sink += shell_symbol(bench_sym(i)->address + (i & 0xff), &offset) != NULL;
+	b->ops = BENCH_OPS;
+
+	return 0;
+}
+
+int bench_pt_walk(struct bench* b)
+{
+	unsigned int i;
+
+	if(!nr_bench_vas)
+		return -1;
+
+	for(i = 0; i < BENCH_OPS; i++)
+		bench_sink += do_pg_tbl_wlkthr_non_logical(bench_vas[i % nr_bench_vas]);
+	b->ops = BENCH_OPS;
+
+	return 0;
+}
+
+/*init_task's tasks list through the linear map, as Extract_tasks*/
+int bench_list_tasks(struct bench* b)
+{
+	unsigned int head, next, count;
+
+	head = get_addr_from_smap("init_task", 9);
+	if(!head)
+		return -1;
+
+	for(b->ops = 0; b->ops < BENCH_OPS; b->ops += count) {
+		if(read_uint_from_ramdump(__pa(head + OFFSETOF_TASKS), &next))
+			return -1;
+		for(count = 1; next != head + OFFSETOF_TASKS && count < LIST_WALK_LIMIT; count++) {
+			if(read_uint_from_ramdump(__pa(next), &next))
+				return -1;
+		}
+	}
+	b->bytes = b->ops * 4;
+
+	return 0;
+}
+
+/*cache_chain through the page tables, as the list-walk query*/
+int bench_list_walk(struct bench* b)
+{
+	unsigned int head, next, count;
+
+	head = get_addr_from_smap("cache_chain", 11);
+	if(!head)
+		return -1;
+
+	for(b->ops = 0; b->ops < BENCH_OPS; b->ops += count) {
+		if(shell_read_uint(head, &next))
+			return -1;
+		for(count = 1; next != head && count < LIST_WALK_LIMIT; count++) {
+			if(shell_read_uint(next, &next))
+				return -1;
+		}
+	}
+	b->bytes = b->ops * 4;
+
+	return 0;
+}
+
+int bench_search(struct bench* b)
+{
+	show_locations(BENCH_SEARCH_VAL);
+	b->ops = cur_dump->size / 4;
+	b->bytes = b->ops * 4;
+
+	return 0;
+}
+
+struct bench benches[] = {
+	{"read_uint", bench_read_uint},
+	{"read_4k", bench_read_4k},
+	{"smap_lookup", bench_smap_lookup},
+	{"smap_symbol", bench_smap_symbol},
+	{"pt_walk", bench_pt_walk},
+	{"list_walk_tasks", bench_list_tasks},
+	{"list_walk_vm", bench_list_walk},
+	{"search", bench_search},
+};
+
+#define NR_BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+/*The same words, symbols and addresses for every build*/
+int bench_inputs(void)
+{
+	struct smap* smap = cur_dump->smap;
+	struct smap_sym* sym;
+	unsigned long long words = cur_dump->size / 4;
+	unsigned int i, x = 1, pa;
+
+	bench_offsets = malloc(BENCH_OPS * sizeof(unsigned int));
+	bench_vas = malloc(smap->nr_syms * sizeof(unsigned int));
+	if(!bench_offsets || !bench_vas) {
+		printf("Out of memory for the benchmark\n");
+		return -1;
+	}
+
+	for(i = 0; i < BENCH_OPS; i++) {
+		x = x * 1103515245 + 12345;
+		bench_offsets[i] = (unsigned int)(((unsigned long long)x * words) >> 32) * 4;
+	}
+
+	for(i = 0; i < smap->nr_syms; i++) {
+		sym = bench_sym(i);
+		if(sym->mapping || sym->address < PAGE_OFFSET)
+			continue;
+		pa = do_pg_tbl_wlkthr_non_logical(sym->address);
+		if(pa != (unsigned int)-1)
+			bench_vas[nr_bench_vas++] = sym->address;
+	}
+
+	//the address index is built once, not in the timed loops
+	if(smap_addr_index())
+		return -1;
+
+	return 0;
+}
+
+/*ns per operation and GB/s of a bench or an extractor*/
+void bench_rates(FILE* fp, unsigned long long ops, unsigned long long bytes, double ms)
+{
+	fprintf(fp, "\"ms\":%.3f,\"ns_per_op\":%.2f,\"gb_per_s\":%.3f", ms,
+			ops ? ms * 1000000 / ops : 0, ms > 0 ? bytes / (ms * 1000000) : 0);
+}
+
+int run_bench(const char* path)
+{
+	struct bench* b;
+	struct extractor* e;
+	struct stats best;
+	LARGE_INTEGER start, end;
+	const char* p;
+	double ms;
+	FILE* fp;
+	int i, run, ret;
+
+	output_fp = stdout;
+	if(smap_ready() || bench_inputs())
+		return -1;
+
+	printf("%-22s%12s%12s%12s\n", "bench", "ops", "ns/op", "GB/s");
+	for(i = 0; i < (int)NR_BENCHES; i++) {
+		b = &benches[i];
+		b->ms = -1;
+		for(run = 0; run < BENCH_RUNS && !b->skip; run++) {
+			QueryPerformanceCounter(&start);
+			b->skip = b->run(b) ? 1 : 0;
+			QueryPerformanceCounter(&end);
+			ms = elapsed_ms(start, end);
+			if(b->ms < 0 || ms < b->ms)
+				b->ms = ms;
+		}
+		if(b->skip)
+			printf("%-22s%12s\n", b->name, "skipped");
+		else
+			printf("%-22s%12llu%12.2f%12.3f\n", b->name, b->ops, b->ms * 1000000 / b->ops,
+					b->ms > 0 ? b->bytes / (b->ms * 1000000) : 0);
+	}
+
+	printf("%-22s%12s%12s%12s\n", "extractor", "ms", "reads", "pt_walks");
+	for(i = 0; i < (int)NR_EXTRACTORS; i++) {
+		e = &extractors[i];
+		if(e->skip)
+			continue;
+		for(run = 0; run < BENCH_RUNS; run++) {
+			memset(&e->stats, 0, sizeof(e->stats));
+			cur_stats = &e->stats;
+			QueryPerformanceCounter(&cur_stats->start);
+			ret = e->extract();
+			QueryPerformanceCounter(&cur_stats->end);
+			cur_stats = NULL;
+			if(!run || elapsed_ms(e->stats.start, e->stats.end) < elapsed_ms(best.start, best.end))
+				best = e->stats;
+			e->ret |= ret;
+		}
+		e->stats = best;
+		printf("%-22s%12.2f%12llu%12llu\n", e->name, elapsed_ms(best.start, best.end), best.reads, best.walks);
+	}
+
+	fp = open_output(path, "w");
+	if(!fp) {
+		printf("Error opening the benchmark file %s\n", path);
+		return -1;
+	}
+
+	fprintf(fp, "{\"version\":\"%s\",\"ramdump\":\"", VERSION);
+	for(p = cur_dump->path; *p; p++)
+		fprintf(fp, *p == '\\' || *p == '"' ? "\\%c" : "%c", *p);
+	fprintf(fp, "\",\"size\":%llu,\"symbols\":%u,\"runs\":%d,\n\"benches\":[\n",
+			cur_dump->size, cur_dump->smap->nr_syms, BENCH_RUNS);
+	for(i = 0, run = 0; i < (int)NR_BENCHES; i++) {
+		b = &benches[i];
+		if(b->skip)
+			continue;
+		fprintf(fp, "%s{\"name\":\"%s\",\"ops\":%llu,\"bytes\":%llu,", run++ ? ",\n" : "", b->name, b->ops, b->bytes);
+		bench_rates(fp, b->ops, b->bytes, b->ms);
+		fprintf(fp, "}");
+	}
+	fprintf(fp, "\n],\n\"extractors\":[\n");
+	for(i = 0, run = 0; i < (int)NR_EXTRACTORS; i++) {
+		e = &extractors[i];
+		if(e->skip)
+			continue;
+		fprintf(fp, "%s{\"name\":\"%s\",\"reads\":%llu,\"bytes\":%llu,\"pt_walks\":%llu,\"sym_lookups\":%llu,\"ret\":%d,",
+				run++ ? ",\n" : "", e->key, e->stats.reads, e->stats.bytes, e->stats.walks, e->stats.lookups, e->ret);
+		bench_rates(fp, e->stats.reads, e->stats.bytes, elapsed_ms(e->stats.start, e->stats.end));
+		fprintf(fp, "}");
+	}
+	fprintf(fp, "\n]}\n");
+	fclose(fp);
+
+	free(bench_offsets);
+	free(bench_vas);
+
+	return 0;
+}
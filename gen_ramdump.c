@@ -0,0 +1,1120 @@
+/*
+ * Synthetic ramdump generator
+ *
+ * It writes the RAM image of a made-up 32-bit ARM device and
+ * the System.map that goes with it, laid out exactly as
+ * extract_ramdump reads them (the same OFFSETOF_* values,
+ * RAM_START and PAGE_OFFSET). Nothing of a real device is in
+ * it, so the dumps can be shared, and every extractor can be
+ * benchmarked and regression tested on any machine.
+ *
+ * What is in the image:
+ * - swapper_pg_dir. The kernel image (init, text and rodata)
+ *   is mapped with small pages through second level tables,
+ *   the rest of lowmem with sections, and the vectors page
+ *   at 0xffff0000 with a small page off the linear map.
+ * - init_task and the tasks list of -n tasks. User processes
+ *   have -t threads each on their thread_group list, and every
+ *   task has a kernel stack with thread_info, cpu_context,
+ *   STACK_END_MAGIC and some frames in use.
+ * - cache_chain with -c caches, each with its kmem_list3 and
+ *   full, partial and free slabs.
+ * - contig_page_data with one zone and the free lists of every
+ *   order and migrate type, made of the struct pages of mem_map.
+ * - irq_desc of -i irqs with chips, kstat_irqs and actions.
+ * - vm_stat, consistent with the above.
+ * - the kernel log, wrapped around and ending with an Oops.
+ * - -y function symbols in the text, as a real System.map.
+ *
+ * The dump is -s MB, up to 4096. Above 768 MB the rest is
+ * highmem and is left as a hole of the file, so even the
+ * largest ones take only what the kernel structures need on
+ * disk. The same options and seed (-e) give the same files.
+ *	gcc -O2 -o gen_ramdump gen_ramdump.c
+ *	./gen_ramdump -s 1024 -n 10000 -t 8 -r ram.bin -m System.map
+ *
+ * Author: Vinayak Menon <vinayakm.list@gmail.com>
+ */
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+
+#define RAM_START 0x82000000
+#define PAGE_OFFSET 0xc0000000
+#define __pa(x) ((x) - PAGE_OFFSET + RAM_START)
+
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (1U << PAGE_SHIFT)
+#define LOWMEM_MAX (768ULL << 20)	/*the rest is highmem, not mapped*/
+#define MAX_DUMP_MB 4096
+
+/*the static part of the kernel*/
+#define SWAPPER_PG_DIR 0xc0004000
+#define INIT_BEGIN 0xc0008000
+#define INIT_END 0xc0100000
+#define TEXT_START 0xc0100000
+#define TEXT_END 0xc0500000
+#define RODATA_END 0xc0600000	/*small pages up to here*/
+#define DATA_END 0xc0700000
+#define BSS_END 0xc0800000
+
+/*task_struct, as extract_ramdump*/
+#define OFFSETOF_STATE 0x0
+#define OFFSETOF_KSTACK 0x4
+#define OFFSETOF_FLAGS 0xc
+#define OFFSETOF_PRIO 0x18
+#define OFFSETOF_STATICPRIO 0x1c
+#define OFFSETOF_NORMALPRIO 0x20
+#define OFFSETOF_TASKS 0x1c8
+#define OFFSETOF_MM 0x1d0
+#define OFFSETOF_PID 0x1f8
+#define OFFSETOF_TID 0x1fc
+#define OFFSETOF_THREADGROUP 0x250
+#define OFFSETOF_MINFLT 0x298
+#define OFFSETOF_MAJFLT 0x29c
+#define OFFSETOF_COMM 0x2d4
+#define OFFSETOF_SIGNAL 0x30c
+#define TASK_STRUCT_SIZE 0x400
+#define TASK_COMM_LEN 16
+
+#define OFFSETOF_OOMADJ 0x1E4	/*signal_struct*/
+#define SIGNAL_STRUCT_SIZE 0x200
+#define OFFSETOF_RSSSTAT 0x13c	/*mm_struct*/
+#define MM_STRUCT_SIZE 0x180
+
+/*thread_info, at the base of the kernel stack*/
+#define THREAD_SIZE 8192
+#define OFFSETOF_PREEMPTCOUNT 0x4
+#define OFFSETOF_ADDRLIMIT 0x8
+#define OFFSETOF_TASK 0xc
+#define OFFSETOF_CPUCONTEXT 0x1c
+#define THREAD_INFO_SIZE 0x2f0
+#define STACK_END_MAGIC 0x57AC6E9D
+
+#define TASK_RUNNING 0
+#define TASK_INTERRUPTIBLE 1
+#define TASK_UNINTERRUPTIBLE 2
+#define PF_KTHREAD 0x00200000
+#define PF_RANDOMIZE 0x00400000
+
+/*kmem_cache, kmem_list3, array_cache and struct slab*/
+#define OFFSETOF_BATCHCOUNT 0x04
+#define OFFSETOF_LIMIT 0x08
+#define OFFSETOF_SHARED 0x0c
+#define OFFSETOF_BUFFERSIZE 0x10
+#define OFFSETOF_NUM 0x1c
+#define OFFSETOF_KEMEMCACHE_NAME 0x40
+#define OFFSETOF_KMEMCACHE_NEXT 0x44
+#define OFFSETOF_NODELIST 0x4c
+#define KMEM_CACHE_SIZE 0x60
+#define OFFSETOF_SLABSPARTIAL 0x0
+#define OFFSETOF_SLABSFULL 0x8
+#define OFFSETOF_SLABSFREE 0x10
+#define OFFSETOF_FREEOBJECTS 0x18
+#define OFFSETOF_L3_SHARED 0x24
+#define KMEM_LIST3_SIZE 0x40
+#define OFFSETOF_SHAREDAVAIL 0x0
+#define ARRAY_CACHE_SIZE 0x10
+#define OFFSETOF_INUSE 0x10
+#define SLAB_SIZE 0x20
+
+/*contig_page_data, its one zone at 0*/
+#define OFFSETOF_WMARK_MIN 0x0
+#define OFFSETOF_WMARK_LOW 0x4
+#define OFFSETOF_WMARK_HIGH 0x8
+#define OFFSETOF_FREELIST 0x50
+#define OFFSETOF_NRFREE 0x80
+#define OFFSETOF_NEXT_FREELIST 0x34
+#define OFFSETOF_NEXT_NEXT 0x08
+#define OFFSETOF_VMSTAT 0x2d4
+#define OFFSETOF_INACTIVE_RATIO 0x354
+#define OFFSETOF_PARENTNODE 0x364
+#define OFFSETOF_ZONE_START_PFN 0x368
+#define OFFSETOF_SPANNED_PAGES 0x36c
+#define OFFSETOF_PRESENT_PAGES 0x370
+#define OFFSETOF_NAME 0x374
+#define OFFSETOF_NRZONES 0x70c
+#define OFFSETOF_NODESTARTPFN 0x71c
+#define OFFSETOF_NODEPRESENTPAGES 0x720
+#define OFFSETOF_NODESPANNEDPAGES 0x724
+#define OFFSETOF_NODEID 0x728
+#define PGLIST_DATA_SIZE 0x740
+#define MAX_ORDER 11
+#define MIGRATE_TYPES 6
+#define MIGRATE_UNMOVABLE 0
+#define MIGRATE_RECLAIMABLE 1
+#define MIGRATE_MOVABLE 2
+#define MIGRATE_RESERVE 3
+
+/*struct page of mem_map*/
+#define STRUCT_PAGE_SIZE 0x20
+#define OFFSETOF_LRU 0x14
+
+/*irq_desc, irq_chip and irqaction*/
+#define NO_OF_IRQS 492
+#define IRQ_DESC_SIZE 0x60
+#define OFFSETOF_SUA 0x8
+#define OFFSETOF_CHIP 0x0c
+#define OFFSETOF_KSTATIRQS 0x20
+#define OFFSETOF_ACTION 0x28
+#define OFFSETOF_ACTION_NAME 0x24
+#define IRQ_ACTION_SIZE 0x30
+#define IRQD_LEVEL (1 << 13)
+#define IRQD_IRQ_DISABLED (1 << 16)
+#define IRQD_IRQ_MASKED (1 << 17)
+
+/*vm_stat, the VM_BUF_SIZE items extract_ramdump reads*/
+#define VM_BUF_SIZE 31
+#define NR_FREE_PAGES 0
+#define NR_INACTIVE_ANON 1
+#define NR_ACTIVE_ANON 2
+#define NR_INACTIVE_FILE 3
+#define NR_ACTIVE_FILE 4
+#define NR_UNEVICTABLE 5
+#define NR_MLOCK 6
+#define NR_ANON_PAGES 7
+#define NR_FILE_MAPPED 8
+#define NR_FILE_PAGES 9
+#define NR_FILE_DIRTY 10
+#define NR_SLAB_RECLAIMABLE 12
+#define NR_SLAB_UNRECLAIMABLE 13
+#define NR_PAGETABLE 14
+#define NR_KERNEL_STACK 15
+#define NR_SHMEM 22
+
+/*struct printk_log*/
+#define PRINTK_LOG_HDR_SIZE 0x10
+#define OFFSETOF_TS_NSEC 0x0
+#define OFFSETOF_LEN 0x8
+#define OFFSETOF_TEXT_LEN 0xa
+#define OFFSETOF_LOG_LEVEL 0xf
+#define LOG_BUF_LEN (1 << 17)
+
+/*page table entries, as an ARMv7 kernel sets them*/
+#define PMD_TYPE_TABLE 0x1
+#define PMD_SECT 0x1040e	/*section, C, B, P:R/W, shareable*/
+#define PMD_SECT_XN 0x10
+#define PTE_SMALL 0x41e		/*small page, C, B, P:R/W, shareable*/
+#define PTE_SMALL_XN 0x1
+#define VECTORS_BASE 0xffff0000
+
+/*A part of the kernel address space, handed out in order*/
+struct area {
+	const char* name;
+	unsigned int brk, end;
+};
+
+struct area data_area = {"data", RODATA_END, DATA_END};
+struct area bss_area = {"bss", DATA_END, BSS_END};
+struct area rodata_area = {"rodata", TEXT_END, RODATA_END};
+struct area dyn_area = {"lowmem", BSS_END, 0};
+
+struct sym {
+	unsigned int address;
+	char type;
+	char* name;
+};
+
+struct sym* syms;
+int nr_syms, syms_size;
+
+unsigned char* image;
+unsigned long long image_size, image_used;
+unsigned int nr_pages;
+unsigned int rnd_state = 0x12345678;
+
+char* output_file_path = "ramdump.bin";
+char* smap_file_path = "System.map";
+unsigned int dump_mb = 256;
+int nr_tasks = 500;
+int threads_per_process = 4;
+int nr_caches = 150;
+int nr_irqs = NO_OF_IRQS;
+int nr_text_syms = 30000;
+
+/*what vm_stat sums up*/
+unsigned int free_pages, anon_pages, file_pages, slab_pages, nr_stacks, nr_mms;
+unsigned int pgdat;
+
+/*functions other parts point into*/
+unsigned int switch_to_addr, irq_handler_addr;
+char* oops_func;
+
+const char* const kthread_names[] = {
+	"kthreadd", "ksoftirqd/%d", "kworker/%d:0", "migration/%d", "watchdog/%d",
+	"khelper", "kswapd0", "fsnotify_mark", "mmcqd/%d", "kblockd", "rcu_bh",
+	"jbd2/mmcblk0p%d", "ext4-dio-unwri", "irq/%d-msm_ipc", "binder", "kauditd",
+};
+
+const char* const process_names[] = {
+	"init", "ueventd", "logd", "servicemanager", "vold", "surfaceflinger",
+	"zygote", "system_server", "mediaserver", "netd", "installd", "keystore",
+	"rild", "drmserver", "com.android.phone", "com.android.systemui",
+	"android.process.media", "com.android.launcher", "com.google.process.gapps",
+	"com.android.browser", "com.android.mms", "com.android.email",
+};
+
+const char* const thread_names[] = {
+	"Binder_%d", "HeapTrimmerDaem", "FinalizerDaemon", "ReferenceQueueD",
+	"GC", "Signal Catcher", "JDWP", "AsyncTask #%d", "pool-%d-thread-1",
+	"RenderThread", "hwuiTask%d", "SoundPool",
+};
+
+struct cache_type {
+	const char* name;
+	unsigned int size;
+	int weight;	/*of its share of the slab pages*/
+};
+
+const struct cache_type cache_types[] = {
+	{"kmalloc-32", 32, 6}, {"kmalloc-64", 64, 8}, {"kmalloc-128", 128, 8},
+	{"kmalloc-192", 192, 3}, {"kmalloc-256", 256, 6}, {"kmalloc-512", 512, 5},
+	{"kmalloc-1024", 1024, 4}, {"kmalloc-2048", 2048, 3}, {"kmalloc-4096", 4096, 2},
+	{"dentry", 136, 10}, {"inode_cache", 368, 4}, {"ext4_inode_cache", 624, 8},
+	{"buffer_head", 64, 6}, {"radix_tree_node", 296, 5}, {"vm_area_struct", 88, 6},
+	{"anon_vma", 40, 3}, {"anon_vma_chain", 32, 3}, {"task_struct", 1024, 3},
+	{"signal_cache", 512, 1}, {"sighand_cache", 1312, 1}, {"mm_struct", 384, 1},
+	{"files_cache", 224, 1}, {"filp", 160, 4}, {"sock_inode_cache", 448, 2},
+	{"skbuff_head_cache", 192, 3}, {"sysfs_dir_cache", 72, 3}, {"proc_inode_cache", 392, 2},
+	{"shmem_inode_cache", 464, 2}, {"fuse_request", 400, 1}, {"ashmem_area_cache", 296, 1},
+	{"binder_transaction", 80, 1}, {"selinux_inode_security", 40, 3}, {"avtab_node", 24, 2},
+	{"kmem_cache", 96, 1}, {"size-32768", 32768, 1},
+};
+
+#define NR_CACHE_TYPES (sizeof(cache_types) / sizeof(cache_types[0]))
+
+const char* const irq_names[] = {
+	"arch_timer", "msm_serial_hs", "mmc0", "mmc1", "i2c-qup", "spi_qsd", "kgsl-3d0",
+	"MDSS", "msm_otg", "qpnp_kpdpwr", "wcnss_wlan", "smd_dev", "msm_ipc", "tsens",
+	"msm_vidc", "sps", "qcedev", "gpio_keys", "synaptics_rmi4", "msm_rpm",
+};
+
+#define NR_IRQ_NAMES (sizeof(irq_names) / sizeof(irq_names[0]))
+
+const char* const func_prefixes[] = {
+	"sys", "do", "__", "vfs", "ext4", "mmc", "msm", "binder", "net", "tcp", "ip",
+	"sched", "mm", "page", "kmem", "irq", "gic", "usb", "input", "fb", "mdss",
+	"kgsl", "snd", "i2c", "spi", "clk", "regulator", "pm", "cpufreq", "rpm",
+};
+
+const char* const func_verbs[] = {
+	"init", "probe", "remove", "open", "release", "read", "write", "ioctl", "mmap",
+	"poll", "alloc", "free", "get", "put", "lookup", "start", "stop", "suspend",
+	"resume", "handler", "work", "update", "flush", "submit", "complete",
+};
+
+unsigned int rnd(void)
+{
+	/*xorshift32, the same sequence for a seed on every machine*/
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+void show_help(void)
+{
+	printf("gen_ramdump -s [MB] -n [tasks] -r [ramdump] -m [System.map]\n");
+	printf("r : the ramdump file to write, %s by default\n", output_file_path);
+	printf("m : the system map file to write, %s by default\n", smap_file_path);
+	printf("s : size of the RAM in MB, %d by default, up to %d\n", dump_mb, MAX_DUMP_MB);
+	printf("n : number of tasks, threads included, %d by default\n", nr_tasks);
+	printf("t : threads of each user process, %d by default\n", threads_per_process);
+	printf("c : number of slab caches, %d by default\n", nr_caches);
+	printf("i : number of irqs, %d by default\n", nr_irqs);
+	printf("y : number of function symbols in the text, %d by default\n", nr_text_syms);
+	printf("e : seed of the random contents, the same seed gives the same dump\n");
+	printf("h : help\n");
+	fflush(stdout);
+}
+
+/*The image is written through these, va is a lowmem address*/
+unsigned char* image_ptr(unsigned int va, unsigned int bytes)
+{
+	unsigned long long offset = va - PAGE_OFFSET;
+
+	if(va < PAGE_OFFSET || offset + bytes > image_size) {
+		printf("%s: 0x%x is not in lowmem\n", __func__, va);
+		exit(-1);
+	}
+	if(offset + bytes > image_used)
+		image_used = offset + bytes;
+
+	return image + offset;
+}
+
+void put_uint(unsigned int va, unsigned int val)
+{
+	unsigned char* p = image_ptr(va, 4);
+
+	p[0] = val;
+	p[1] = val >> 8;
+	p[2] = val >> 16;
+	p[3] = val >> 24;
+}
+
+void put_ushort(unsigned int va, unsigned short val)
+{
+	unsigned char* p = image_ptr(va, 2);
+
+	p[0] = val;
+	p[1] = val >> 8;
+}
+
+void put_buf(unsigned int va, const void* buf, unsigned int bytes)
+{
+	memcpy(image_ptr(va, bytes), buf, bytes);
+}
+
+unsigned int get_uint(unsigned int va)
+{
+	unsigned char* p = image_ptr(va, 4);
+
+	return p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24;
+}
+
+/*list_head at head, empty*/
+void init_list(unsigned int head)
+{
+	put_uint(head, head);
+	put_uint(head + 4, head);
+}
+
+/*list_add_tail(entry, head)*/
+void list_add_tail(unsigned int entry, unsigned int head)
+{
+	unsigned int prev = get_uint(head + 4);
+
+	put_uint(entry, head);
+	put_uint(entry + 4, prev);
+	put_uint(prev, entry);
+	put_uint(head + 4, entry);
+}
+
+unsigned int alloc(struct area* area, unsigned int size, unsigned int align)
+{
+	unsigned int va = (area->brk + align - 1) & ~(align - 1);
+
+	if(va < area->brk || size > area->end - va) {
+		printf("Out of %s allocating %u bytes, try a larger -s or fewer -n/-c/-i\n", area->name, size);
+		exit(-1);
+	}
+	area->brk = va + size;
+	image_ptr(va, size);
+
+	return va;
+}
+
+unsigned int alloc_string(const char* s)
+{
+	unsigned int va = alloc(&rodata_area, strlen(s) + 1, 1);
+
+	put_buf(va, s, strlen(s) + 1);
+	return va;
+}
+
+void add_sym(unsigned int address, char type, const char* name)
+{
+	if(nr_syms == syms_size) {
+		syms_size = syms_size ? syms_size * 2 : 1024;
+		syms = realloc(syms, syms_size * sizeof(struct sym));
+		if(!syms) {
+			printf("Out of memory\n");
+			exit(-1);
+		}
+	}
+	syms[nr_syms].address = address;
+	syms[nr_syms].type = type;
+	syms[nr_syms++].name = strdup(name);
+}
+
+/*An address in the middle of a function of the text*/
+unsigned int text_addr(void)
+{
+	return (TEXT_START + rnd() % (TEXT_END - TEXT_START)) & ~3;
+}
+
+/*The text, with a prologue and epilogue at every function*/
+void gen_text(void)
+{
+	const char* const fixed[] = {"stext", "__switch_to", "schedule", "do_fork", "gic_handle_irq",
+			"panic", "__do_kernel_fault", "do_page_fault", "kmem_cache_alloc", "ret_fast_syscall"};
+	unsigned int nr_fixed = sizeof(fixed) / sizeof(fixed[0]);
+	unsigned int step, va, i;
+	char name[64];
+
+	for(va = TEXT_START; va < TEXT_END; va += 4)
+		put_uint(va, 0xe0000000 | (rnd() & 0x0fffffff));
+
+	if(nr_text_syms < (int)nr_fixed)
+		nr_text_syms = nr_fixed;
+	step = ((TEXT_END - TEXT_START) / nr_text_syms) & ~3;
+	for(i = 0; i < (unsigned int)nr_text_syms; i++) {
+		va = TEXT_START + i * step;
+		if(i < nr_fixed)
+			strcpy(name, fixed[i]);
+		else
+			sprintf(name, "%s_%s_%s_%u", func_prefixes[rnd() % (sizeof(func_prefixes) / sizeof(func_prefixes[0]))],
+					func_verbs[rnd() % (sizeof(func_verbs) / sizeof(func_verbs[0]))],
+					func_verbs[rnd() % (sizeof(func_verbs) / sizeof(func_verbs[0]))], i);
+		add_sym(va, rnd() % 3 ? 'T' : 't', name);
+		put_uint(va, 0xe92d4010);		//push {r4, lr}
+		if(step >= 8)
+			put_uint(va + step - 4, 0xe8bd8010);	//pop {r4, pc}
+	}
+
+	switch_to_addr = TEXT_START + 1 * step;
+	irq_handler_addr = TEXT_START + 4 * step;
+	oops_func = syms[nr_syms - 1 - rnd() % (nr_text_syms - nr_fixed + 1)].name;
+
+	add_sym(INIT_BEGIN, 'T', "__init_begin");
+	add_sym(INIT_END, 'T', "__init_end");
+	add_sym(TEXT_START, 'T', "_text");
+	add_sym(TEXT_END, 'T', "_etext");
+	add_sym(RODATA_END, 'D', "_sdata");
+	add_sym(DATA_END, 'D', "_edata");
+	add_sym(DATA_END, 'B', "__bss_start");
+	add_sym(BSS_END, 'B', "__bss_stop");
+}
+
+/*swapper_pg_dir: small pages for the kernel image, sections for the
+ *rest of lowmem, and the vectors page off the linear map
+ */
+void gen_page_tables(void)
+{
+	unsigned int va, pte, table, i;
+	unsigned int lowmem_end = PAGE_OFFSET + (unsigned int)image_size;
+
+	add_sym(SWAPPER_PG_DIR, 'A', "swapper_pg_dir");
+
+	for(va = PAGE_OFFSET; va < lowmem_end; va += 0x100000) {
+		if(va >= RODATA_END) {
+			put_uint(SWAPPER_PG_DIR + ((va >> 20) << 2),
+					(__pa(va) & 0xfff00000) | PMD_SECT | PMD_SECT_XN);
+			continue;
+		}
+
+		table = alloc(&dyn_area, 1024, 1024);
+		put_uint(SWAPPER_PG_DIR + ((va >> 20) << 2), (__pa(table) & 0xfffffc00) | PMD_TYPE_TABLE);
+		for(i = 0; i < 256; i++) {
+			pte = va + (i << PAGE_SHIFT);
+			put_uint(table + (i << 2), (__pa(pte) & 0xfffff000) | PTE_SMALL |
+					(pte >= TEXT_START && pte < TEXT_END ? 0 : PTE_SMALL_XN));
+		}
+	}
+
+	table = alloc(&dyn_area, 1024, 1024);
+	pte = alloc(&dyn_area, PAGE_SIZE, PAGE_SIZE);
+	put_uint(pte, 0xe59ff410);	//ldr pc, [pc, #1040]
+	put_uint(SWAPPER_PG_DIR + ((VECTORS_BASE >> 20) << 2), (__pa(table) & 0xfffffc00) | PMD_TYPE_TABLE);
+	put_uint(table + (((VECTORS_BASE >> PAGE_SHIFT) & 0xff) << 2), (__pa(pte) & 0xfffff000) | PTE_SMALL);
+}
+
+/*A kernel stack with thread_info at its base and a few frames in use*/
+unsigned int gen_kstack(unsigned int task, int kthread)
+{
+	unsigned int stack = alloc(&dyn_area, THREAD_SIZE, THREAD_SIZE);
+	unsigned int sp, va;
+	int i;
+
+	put_uint(stack + OFFSETOF_PREEMPTCOUNT, 0);
+	put_uint(stack + OFFSETOF_ADDRLIMIT, kthread ? 0 : 0xbf000000);
+	put_uint(stack + OFFSETOF_TASK, task);
+	put_uint(stack + THREAD_INFO_SIZE, STACK_END_MAGIC);
+
+	sp = stack + THREAD_SIZE - (0x100 + (rnd() % 0xc00 & ~7));
+	for(va = sp; va < stack + THREAD_SIZE - 8; va += 4) {
+		switch(rnd() % 4) {
+		case 0:
+			put_uint(va, text_addr());
+			break;
+		case 1:
+			put_uint(va, va + 4 * (rnd() % 16));
+			break;
+		case 2:
+			put_uint(va, rnd() % 1024);
+			break;
+		}
+	}
+	put_uint(sp, switch_to_addr + 0x24);
+
+	//cpu_context: r4-r9, sl, fp, sp, pc
+	for(i = 0; i < 6; i++)
+		put_uint(stack + OFFSETOF_CPUCONTEXT + i * 4, i % 2 ? task : rnd() % 256);
+	put_uint(stack + OFFSETOF_CPUCONTEXT + 6 * 4, stack);
+	put_uint(stack + OFFSETOF_CPUCONTEXT + 7 * 4, sp + 0x1c);
+	put_uint(stack + OFFSETOF_CPUCONTEXT + 8 * 4, sp);
+	put_uint(stack + OFFSETOF_CPUCONTEXT + 9 * 4, switch_to_addr + 0x10);
+
+	nr_stacks++;
+	return stack;
+}
+
+unsigned int gen_task(unsigned int task, int pid, int tgid, const char* comm,
+		unsigned int mm, unsigned int signal, int kthread)
+{
+	char comm_buf[TASK_COMM_LEN];
+	unsigned int r = rnd() % 16;
+	int nice = kthread ? 0 : (int)(rnd() % 5) - 2;
+
+	put_uint(task + OFFSETOF_STATE, r == 0 ? TASK_RUNNING : r == 1 ? TASK_UNINTERRUPTIBLE : TASK_INTERRUPTIBLE);
+	put_uint(task + OFFSETOF_KSTACK, gen_kstack(task, kthread));
+	put_uint(task + OFFSETOF_FLAGS, kthread ? PF_KTHREAD | 0x40 : PF_RANDOMIZE | 0x100);
+	put_uint(task + OFFSETOF_PRIO, 120 + nice);
+	put_uint(task + OFFSETOF_STATICPRIO, 120 + nice);
+	put_uint(task + OFFSETOF_NORMALPRIO, 120 + nice);
+	init_list(task + OFFSETOF_TASKS);
+	put_uint(task + OFFSETOF_MM, mm);
+	put_uint(task + OFFSETOF_PID, pid);
+	put_uint(task + OFFSETOF_TID, tgid);
+	init_list(task + OFFSETOF_THREADGROUP);
+	put_uint(task + OFFSETOF_MINFLT, mm ? rnd() % 100000 : 0);
+	put_uint(task + OFFSETOF_MAJFLT, mm ? rnd() % 1000 : 0);
+	memset(comm_buf, 0, sizeof(comm_buf));
+	strncpy(comm_buf, comm, TASK_COMM_LEN - 1);
+	put_buf(task + OFFSETOF_COMM, comm_buf, TASK_COMM_LEN);
+	put_uint(task + OFFSETOF_SIGNAL, signal);
+
+	return task;
+}
+
+unsigned int gen_signal(int oom_adj)
+{
+	unsigned int signal = alloc(&dyn_area, SIGNAL_STRUCT_SIZE, 64);
+
+	put_uint(signal + OFFSETOF_OOMADJ, oom_adj);
+	return signal;
+}
+
+/*mm_struct with rss_stat: file, anon, swap and shmem pages*/
+unsigned int gen_mm(unsigned int avg_rss)
+{
+	unsigned int mm = alloc(&dyn_area, MM_STRUCT_SIZE, 64);
+	unsigned int file = rnd() % (avg_rss + 1);
+	unsigned int anon = rnd() % (2 * avg_rss + 1);
+
+	put_uint(mm + OFFSETOF_RSSSTAT, file);
+	put_uint(mm + OFFSETOF_RSSSTAT + 4, anon);
+	put_uint(mm + OFFSETOF_RSSSTAT + 8, rnd() % (avg_rss / 4 + 1));
+	put_uint(mm + OFFSETOF_RSSSTAT + 12, rnd() % (avg_rss / 8 + 1));
+	file_pages += file;
+	anon_pages += anon;
+	nr_mms++;
+
+	return mm;
+}
+
+/*init_task, then kernel threads and user processes with their
+ *threads. Only group leaders are on the tasks list.
+ */
+void gen_tasks(void)
+{
+	const int oom_adjs[] = {-16, -12, 0, 1, 2, 4, 5, 6, 7, 9, 11, 15};
+	unsigned int init_task, task, leader, mm, signal, avg_rss;
+	int nr_kthreads, nr_processes, threads, pid = 1, tgid, i, j;
+	char comm[64];
+
+	init_task = alloc(&data_area, TASK_STRUCT_SIZE, 64);
+	add_sym(init_task, 'D', "init_task");
+	signal = gen_signal(0);
+	gen_task(init_task, 0, 0, "swapper/0", 0, signal, 1);
+
+	nr_kthreads = nr_tasks > 1 ? (nr_tasks - 1) / 10 + 1 : 0;
+	if(nr_kthreads > nr_tasks - 1)
+		nr_kthreads = nr_tasks - 1;
+	for(i = 0; i < nr_kthreads; i++) {
+		sprintf(comm, kthread_names[i % (sizeof(kthread_names) / sizeof(kthread_names[0]))], i / 16);
+		pid++;
+		task = gen_task(alloc(&dyn_area, TASK_STRUCT_SIZE, 64), pid, pid, comm, 0, gen_signal(0), 1);
+		list_add_tail(task + OFFSETOF_TASKS, init_task + OFFSETOF_TASKS);
+	}
+
+	threads = threads_per_process > 0 ? threads_per_process : 1;
+	nr_processes = (nr_tasks - 1 - nr_kthreads + threads - 1) / threads;
+	avg_rss = nr_processes ? nr_pages / 2 / nr_processes : 0;
+	for(i = nr_kthreads + 1, j = 0; i < nr_tasks; j++) {
+		if(j < (int)(sizeof(process_names) / sizeof(process_names[0])))
+			strcpy(comm, process_names[j]);
+		else
+			sprintf(comm, "com.app.%d", j);
+		tgid = j ? ++pid : 1;	//init is pid 1, the kthreads come before it in the list
+		mm = gen_mm(avg_rss);
+		signal = gen_signal(j < 12 ? -16 : oom_adjs[rnd() % (sizeof(oom_adjs) / sizeof(oom_adjs[0]))]);
+		leader = gen_task(alloc(&dyn_area, TASK_STRUCT_SIZE, 64), tgid, tgid, comm, mm, signal, 0);
+		list_add_tail(leader + OFFSETOF_TASKS, init_task + OFFSETOF_TASKS);
+		i++;
+
+		for(threads = 1; threads < threads_per_process && i < nr_tasks; threads++, i++) {
+			sprintf(comm, thread_names[rnd() % (sizeof(thread_names) / sizeof(thread_names[0]))], threads);
+			task = gen_task(alloc(&dyn_area, TASK_STRUCT_SIZE, 64), ++pid, tgid, comm, mm, signal, 0);
+			list_add_tail(task + OFFSETOF_THREADGROUP, leader + OFFSETOF_THREADGROUP);
+		}
+	}
+}
+
+/*cache_chain: slab pages are shared out by weight, 70% of the slabs
+ *full, 20% partial and 10% free
+ */
+void gen_caches(void)
+{
+	unsigned int cache_chain, cache, l3, ac, slab, name, num, size;
+	unsigned int total_weight = 0, slabs, full, partial, free_objects, inuse, i, k;
+	char name_buf[64];
+
+	cache_chain = alloc(&data_area, 8, 8);
+	add_sym(cache_chain, 'd', "cache_chain");
+	init_list(cache_chain);
+
+	for(i = 0; i < (unsigned int)nr_caches; i++)
+		total_weight += cache_types[i % NR_CACHE_TYPES].weight;
+
+	for(i = 0; i < (unsigned int)nr_caches; i++) {
+		size = cache_types[i % NR_CACHE_TYPES].size;
+		if(i < NR_CACHE_TYPES)
+			name = alloc_string(cache_types[i].name);
+		else {
+			sprintf(name_buf, "%s-%u", cache_types[i % NR_CACHE_TYPES].name, (unsigned int)(i / NR_CACHE_TYPES));
+			name = alloc_string(name_buf);
+		}
+		num = size < PAGE_SIZE ? PAGE_SIZE / size : 1;
+
+		cache = alloc(&dyn_area, KMEM_CACHE_SIZE, 64);
+		put_uint(cache + OFFSETOF_BATCHCOUNT, size > 1024 ? 8 : 60);
+		put_uint(cache + OFFSETOF_LIMIT, size > 1024 ? 24 : 120);
+		put_uint(cache + OFFSETOF_SHARED, size > 1024 ? 0 : 8);
+		put_uint(cache + OFFSETOF_BUFFERSIZE, size);
+		put_uint(cache + OFFSETOF_NUM, num);
+		put_uint(cache + OFFSETOF_KEMEMCACHE_NAME, name);
+		list_add_tail(cache + OFFSETOF_KMEMCACHE_NEXT, cache_chain);
+
+		l3 = alloc(&dyn_area, KMEM_LIST3_SIZE, 64);
+		put_uint(cache + OFFSETOF_NODELIST, l3);
+		init_list(l3 + OFFSETOF_SLABSPARTIAL);
+		init_list(l3 + OFFSETOF_SLABSFULL);
+		init_list(l3 + OFFSETOF_SLABSFREE);
+		if(size <= 1024) {
+			ac = alloc(&dyn_area, ARRAY_CACHE_SIZE, 16);
+			put_uint(ac + OFFSETOF_SHAREDAVAIL, rnd() % 8);
+			put_uint(ac + 4, 8 * num);
+			put_uint(ac + 8, 60);
+			put_uint(l3 + OFFSETOF_L3_SHARED, ac);
+		}
+
+		slabs = (unsigned long long)nr_pages / 16 * cache_types[i % NR_CACHE_TYPES].weight / total_weight;
+		if(!slabs)
+			slabs = 1;
+		full = slabs * 7 / 10;
+		partial = slabs * 2 / 10;
+		free_objects = 0;
+		for(k = 0; k < slabs; k++) {
+			slab = alloc(&dyn_area, SLAB_SIZE, SLAB_SIZE);
+			if(k < full)
+				inuse = num;
+			else if(k < full + partial)
+				inuse = num > 1 ? 1 + rnd() % (num - 1) : 0;
+			else
+				inuse = 0;
+			put_uint(slab + OFFSETOF_INUSE, inuse);
+			free_objects += num - inuse;
+			list_add_tail(slab, l3 + (k < full ? OFFSETOF_SLABSFULL : k < full + partial ?
+					OFFSETOF_SLABSPARTIAL : OFFSETOF_SLABSFREE));
+		}
+		put_uint(l3 + OFFSETOF_FREEOBJECTS, free_objects);
+		slab_pages += slabs;
+	}
+}
+
+/*contig_page_data, its zone and the free lists, blocks of every
+ *order taken from the top of the RAM down
+ */
+void gen_zone(void)
+{
+	unsigned int mem_map, head, page, pfn, blocks, share[MIGRATE_TYPES];
+	unsigned int order, type, k, nr_free;
+
+	mem_map = alloc(&dyn_area, nr_pages * STRUCT_PAGE_SIZE, 64);
+	add_sym(alloc(&data_area, 4, 4), 'D', "mem_map");
+	put_uint(syms[nr_syms - 1].address, mem_map);
+
+	pgdat = alloc(&data_area, PGLIST_DATA_SIZE, 64);
+	add_sym(pgdat, 'D', "contig_page_data");
+	put_uint(pgdat + OFFSETOF_WMARK_MIN, nr_pages / 256);
+	put_uint(pgdat + OFFSETOF_WMARK_LOW, nr_pages / 256 * 5 / 4);
+	put_uint(pgdat + OFFSETOF_WMARK_HIGH, nr_pages / 256 * 3 / 2);
+	put_uint(pgdat + OFFSETOF_INACTIVE_RATIO, 1);
+	put_uint(pgdat + OFFSETOF_PARENTNODE, pgdat);
+	put_uint(pgdat + OFFSETOF_ZONE_START_PFN, RAM_START >> PAGE_SHIFT);
+	put_uint(pgdat + OFFSETOF_SPANNED_PAGES, nr_pages);
+	put_uint(pgdat + OFFSETOF_PRESENT_PAGES, nr_pages);
+	put_uint(pgdat + OFFSETOF_NAME, alloc_string("Normal"));
+	put_uint(pgdat + OFFSETOF_NRZONES, 1);
+	put_uint(pgdat + OFFSETOF_NODESTARTPFN, RAM_START >> PAGE_SHIFT);
+	put_uint(pgdat + OFFSETOF_NODEPRESENTPAGES, nr_pages);
+	put_uint(pgdat + OFFSETOF_NODESPANNEDPAGES, nr_pages);
+	put_uint(pgdat + OFFSETOF_NODEID, 0);
+
+	pfn = nr_pages & ~((1U << (MAX_ORDER - 1)) - 1);
+	for(order = MAX_ORDER; order-- > 0; ) {
+		blocks = (nr_pages / 64) >> order;
+		share[MIGRATE_UNMOVABLE] = blocks / 8;
+		share[MIGRATE_RECLAIMABLE] = blocks / 16;
+		share[MIGRATE_RESERVE] = blocks > 64 ? 2 : 0;
+		share[MIGRATE_MOVABLE] = blocks - share[0] - share[1] - share[MIGRATE_RESERVE];
+		share[4] = share[5] = 0;
+
+		nr_free = 0;
+		for(type = 0; type < MIGRATE_TYPES; type++) {
+			head = pgdat + OFFSETOF_FREELIST + order * OFFSETOF_NEXT_FREELIST + type * OFFSETOF_NEXT_NEXT;
+			init_list(head);
+			for(k = 0; k < share[type] && pfn >= (1U << order); k++) {
+				pfn -= 1U << order;
+				page = mem_map + pfn * STRUCT_PAGE_SIZE;
+				put_uint(page, 0x4000);	//PG_buddy
+				list_add_tail(page + OFFSETOF_LRU, head);
+				nr_free++;
+			}
+		}
+		put_uint(pgdat + OFFSETOF_NRFREE + order * OFFSETOF_NEXT_FREELIST, nr_free);
+		free_pages += nr_free << order;
+	}
+}
+
+/*A flat irq_desc[nr_irqs], a GIC and a GPIO chip, an action for
+ *about one irq in four
+ */
+void gen_irqs(void)
+{
+	unsigned int desc, gic, gpio, kstat, action, names[NR_IRQ_NAMES];
+	unsigned int i;
+
+	add_sym(alloc(&data_area, 4, 4), 'D', "nr_irqs");
+	put_uint(syms[nr_syms - 1].address, nr_irqs);
+
+	gic = alloc(&data_area, 0x40, 4);
+	put_uint(gic, alloc_string("GIC"));
+	add_sym(gic, 'd', "gic_chip");
+	gpio = alloc(&data_area, 0x40, 4);
+	put_uint(gpio, alloc_string("msmgpio"));
+	add_sym(gpio, 'd', "msm_gpio_irq_chip");
+	for(i = 0; i < NR_IRQ_NAMES; i++)
+		names[i] = alloc_string(irq_names[i]);
+
+	desc = alloc(&data_area, nr_irqs * IRQ_DESC_SIZE, 64);
+	add_sym(desc, 'D', "irq_desc");
+	kstat = alloc(&dyn_area, nr_irqs * 4, 64);
+	for(i = 0; i < (unsigned int)nr_irqs; i++, desc += IRQ_DESC_SIZE) {
+		put_uint(desc, i);
+		put_uint(desc + OFFSETOF_CHIP, i < 256 ? gic : gpio);
+		put_uint(desc + OFFSETOF_KSTATIRQS, kstat + i * 4);
+		if(i < 16 || rnd() % 4) {
+			put_uint(desc + OFFSETOF_SUA, IRQD_IRQ_DISABLED | IRQD_IRQ_MASKED);
+			continue;
+		}
+
+		put_uint(desc + OFFSETOF_SUA, rnd() % 2 ? IRQD_LEVEL | 0x4 : 0x1);
+		put_uint(kstat + i * 4, rnd() % 1000000);
+		action = alloc(&dyn_area, IRQ_ACTION_SIZE, 32);
+		put_uint(action, irq_handler_addr + (rnd() % 64) * 4);
+		put_uint(action + OFFSETOF_ACTION_NAME, names[rnd() % NR_IRQ_NAMES]);
+		put_uint(desc + OFFSETOF_ACTION, action);
+	}
+}
+
+void gen_vm_stat(void)
+{
+	unsigned int vm_stat = alloc(&data_area, VM_BUF_SIZE * 4, 64);
+
+	add_sym(vm_stat, 'D', "vm_stat");
+	put_uint(vm_stat + NR_FREE_PAGES * 4, free_pages);
+	put_uint(vm_stat + NR_INACTIVE_ANON * 4, anon_pages / 3);
+	put_uint(vm_stat + NR_ACTIVE_ANON * 4, anon_pages - anon_pages / 3);
+	put_uint(vm_stat + NR_INACTIVE_FILE * 4, file_pages / 2);
+	put_uint(vm_stat + NR_ACTIVE_FILE * 4, file_pages - file_pages / 2);
+	put_uint(vm_stat + NR_UNEVICTABLE * 4, nr_pages / 1024);
+	put_uint(vm_stat + NR_MLOCK * 4, nr_pages / 2048);
+	put_uint(vm_stat + NR_ANON_PAGES * 4, anon_pages);
+	put_uint(vm_stat + NR_FILE_MAPPED * 4, file_pages / 4);
+	put_uint(vm_stat + NR_FILE_PAGES * 4, file_pages);
+	put_uint(vm_stat + NR_FILE_DIRTY * 4, file_pages / 64);
+	put_uint(vm_stat + NR_SLAB_RECLAIMABLE * 4, slab_pages / 3);
+	put_uint(vm_stat + NR_SLAB_UNRECLAIMABLE * 4, slab_pages - slab_pages / 3);
+	put_uint(vm_stat + NR_PAGETABLE * 4, nr_mms * 4);
+	put_uint(vm_stat + NR_KERNEL_STACK * 4, nr_stacks);
+	put_uint(vm_stat + NR_SHMEM * 4, file_pages / 32);
+
+	//the zone has all of it
+	put_buf(pgdat + OFFSETOF_VMSTAT, image_ptr(vm_stat, VM_BUF_SIZE * 4), VM_BUF_SIZE * 4);
+}
+
+/*struct printk_log records in log_buf, stored as log_store() does:
+ *the oldest records are dropped to make room, and a zero length
+ *record at the end sends the reader back to the start
+ */
+unsigned int log_buf;
+unsigned int log_first_idx, log_next_idx, log_first_seq, log_next_seq;
+unsigned long long log_ts;
+
+unsigned int log_next(unsigned int idx)
+{
+	unsigned int len = get_uint(log_buf + idx + OFFSETOF_LEN) & 0xffff;
+
+	if(!len)
+		return get_uint(log_buf + OFFSETOF_LEN) & 0xffff;
+	return idx + len;
+}
+
+void log_store(int level, const char* fmt, ...)
+{
+	char text[256];
+	unsigned int size, free_space, text_len;
+	va_list args;
+
+	va_start(args, fmt);
+	vsnprintf(text, sizeof(text), fmt, args);
+	va_end(args);
+
+	text_len = strlen(text);
+	size = (PRINTK_LOG_HDR_SIZE + text_len + 3) & ~3;
+	log_ts += 1000 + rnd() % 5000000;
+
+	while(log_first_seq < log_next_seq) {
+		if(log_next_idx > log_first_idx)
+			free_space = LOG_BUF_LEN - log_next_idx > log_first_idx ?
+					LOG_BUF_LEN - log_next_idx : log_first_idx;
+		else
+			free_space = log_first_idx - log_next_idx;
+		if(free_space > size + PRINTK_LOG_HDR_SIZE)
+			break;
+		log_first_idx = log_next(log_first_idx);
+		log_first_seq++;
+	}
+
+	if(log_next_idx + size + PRINTK_LOG_HDR_SIZE >= LOG_BUF_LEN) {
+		memset(image_ptr(log_buf + log_next_idx, PRINTK_LOG_HDR_SIZE), 0, PRINTK_LOG_HDR_SIZE);
+		log_next_idx = 0;
+	}
+
+	put_uint(log_buf + log_next_idx + OFFSETOF_TS_NSEC, (unsigned int)log_ts);
+	put_uint(log_buf + log_next_idx + OFFSETOF_TS_NSEC + 4, (unsigned int)(log_ts >> 32));
+	put_ushort(log_buf + log_next_idx + OFFSETOF_LEN, size);
+	put_ushort(log_buf + log_next_idx + OFFSETOF_TEXT_LEN, text_len);
+	put_ushort(log_buf + log_next_idx + 0xc, 0);
+	image_ptr(log_buf + log_next_idx + OFFSETOF_LOG_LEVEL, 1)[0] = level << 5;
+	put_buf(log_buf + log_next_idx + PRINTK_LOG_HDR_SIZE, text, text_len);
+	log_next_idx += size;
+	log_next_seq++;
+}
+
+/*Boot messages, a service started for each process, and an Oops
+ *at the end. Twice the buffer is logged, so it has wrapped.
+ */
+void gen_log(void)
+{
+	unsigned int va;
+	int i;
+
+	log_buf = alloc(&bss_area, LOG_BUF_LEN, 4);
+	add_sym(log_buf, 'b', "__log_buf");
+	va = alloc(&data_area, 16, 4);
+	add_sym(va, 'd', "log_buf");
+	put_uint(va, log_buf);
+	add_sym(va + 4, 'd', "log_buf_len");
+	put_uint(va + 4, LOG_BUF_LEN);
+	add_sym(va + 8, 'd', "log_first_idx");
+	add_sym(va + 12, 'd', "log_next_idx");
+
+	log_store(5, "Booting Linux on physical CPU 0");
+	log_store(5, "Linux version 3.4.0-synthetic (gen_ramdump) #1 SMP PREEMPT");
+	log_store(6, "Memory: %uMB = %uMB total", dump_mb, dump_mb);
+	log_store(6, "Virtual kernel memory layout:");
+	log_store(6, "    lowmem  : 0x%08x - 0x%08x   (%4u MB)", PAGE_OFFSET,
+			PAGE_OFFSET + (unsigned int)image_size, (unsigned int)(image_size >> 20));
+	log_store(6, "      .text : 0x%08x - 0x%08x   (%4u kB)", TEXT_START, TEXT_END, (TEXT_END - TEXT_START) >> 10);
+	log_store(6, "NR_IRQS:%d", nr_irqs);
+	log_store(6, "Freeing init memory: %uK", (INIT_END - INIT_BEGIN) >> 10);
+
+	for(i = 0; log_first_seq < 64; i++) {
+		switch(rnd() % 4) {
+		case 0:
+			log_store(6, "init: starting service '%s'...", process_names[i % (sizeof(process_names) / sizeof(process_names[0]))]);
+			break;
+		case 1:
+			log_store(4, "binder: %d:%d transaction failed 29189, size %d-%d", 100 + i, 101 + i, rnd() % 4096, 4);
+			break;
+		case 2:
+			log_store(6, "lowmemorykiller: Killing 'com.app.%d' (%d), adj %d", i, 1000 + i, rnd() % 16);
+			break;
+		default:
+			log_store(7, "mmc0: req done (CMD%d): 0: %08x 00000000 00000000 00000000", rnd() % 64, rnd());
+			break;
+		}
+	}
+
+	log_store(0, "Unable to handle kernel NULL pointer dereference at virtual address 00000008");
+	log_store(0, "Internal error: Oops: 17 [#1] PREEMPT SMP ARM");
+	log_store(4, "CPU: 0    Not tainted  (3.4.0-synthetic #1)");
+	log_store(4, "PC is at %s+0x%x/0x%x", oops_func, 0x1c, 0x88);
+	log_store(4, "LR is at schedule+0x%x/0x%x", 0x2c4, 0x6a0);
+	log_store(4, "pc : [<%08x>]    lr : [<%08x>]    psr: 60000013", text_addr(), text_addr());
+	log_store(0, "Kernel panic - not syncing: Fatal exception");
+
+	put_uint(va + 8, log_first_idx);
+	put_uint(va + 12, log_next_idx);
+}
+
+int cmp_sym(const void* a, const void* b)
+{
+	const struct sym* x = a;
+	const struct sym* y = b;
+
+	if(x->address != y->address)
+		return x->address < y->address ? -1 : 1;
+	return strcmp(x->name, y->name);
+}
+
+int write_smap(void)
+{
+	FILE* fp;
+	int i;
+
+	fp = fopen(smap_file_path, "w");
+	if(!fp) {
+		printf("Error opening the system map file %s\n", smap_file_path);
+		return -1;
+	}
+
+	qsort(syms, nr_syms, sizeof(struct sym), cmp_sym);
+	for(i = 0; i < nr_syms; i++)
+		fprintf(fp, "%08x %c %s\n", syms[i].address, syms[i].type, syms[i].name);
+
+	if(fclose(fp)) {
+		printf("Error writing the system map file %s\n", smap_file_path);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*Only what was written of lowmem goes to the file, the rest is a
+ *hole up to the size of the RAM
+ */
+int write_image(void)
+{
+	FILE* fp;
+	int ret = 0;
+
+	fp = fopen(output_file_path, "wb");
+	if(!fp) {
+		printf("Error opening the ramdump file %s\n", output_file_path);
+		return -1;
+	}
+
+	if(fwrite(image, 1, image_used, fp) != image_used)
+		ret = -1;
+	else if(ftruncate(fileno(fp), (off_t)dump_mb << 20))
+		ret = -1;
+
+	if(fclose(fp) || ret) {
+		printf("Error writing the ramdump file %s\n", output_file_path);
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int c;
+
+	while((c = getopt(argc, argv, ":r:m:s:n:t:c:i:y:e:h")) != -1) {
+		switch(c) {
+			case 'r':
+				output_file_path = optarg;
+				break;
+			case 'm':
+				smap_file_path = optarg;
+				break;
+			case 's':
+				dump_mb = atoi(optarg);
+				break;
+			case 'n':
+				nr_tasks = atoi(optarg);
+				break;
+			case 't':
+				threads_per_process = atoi(optarg);
+				break;
+			case 'c':
+				nr_caches = atoi(optarg);
+				break;
+			case 'i':
+				nr_irqs = atoi(optarg);
+				break;
+			case 'y':
+				nr_text_syms = atoi(optarg);
+				break;
+			case 'e':
+				rnd_state = strtoul(optarg, NULL, 0) | 1;
+				break;
+			case 'h':
+				show_help();
+				exit(2);
+				break;
+			case ':':
+				printf("Option -%c needs an argument\n", optopt);
+				show_help();
+				exit(2);
+				break;
+			case '?':
+				printf("Unknown option\n");
+				show_help();
+				exit(2);
+				break;
+		}
+	}
+
+	if(dump_mb < 16 || dump_mb > MAX_DUMP_MB) {
+		printf("The size should be 16 to %d MB\n", MAX_DUMP_MB);
+		exit(2);
+	}
+	if(nr_tasks < 1 || threads_per_process < 1 || nr_caches < 1 || nr_irqs < 1 ||
+			nr_irqs > (DATA_END - RODATA_END) / 2 / IRQ_DESC_SIZE || nr_text_syms > (TEXT_END - TEXT_START) / 8) {
+		printf("Bad number of tasks, threads, caches, irqs or symbols\n");
+		exit(2);
+	}
+
+	nr_pages = ((unsigned long long)dump_mb << 20) >> PAGE_SHIFT;
+	image_size = (unsigned long long)dump_mb << 20;
+	if(image_size > LOWMEM_MAX)
+		image_size = LOWMEM_MAX;
+	dyn_area.end = PAGE_OFFSET + (unsigned int)image_size;
+
+	//pages never written stay untouched, so this costs what is used
+	image = calloc(1, image_size);
+	if(!image) {
+		printf("Out of memory for %llu MB of lowmem\n", image_size >> 20);
+		return -1;
+	}
+
+	gen_text();
+	gen_page_tables();
+	gen_tasks();
+	gen_caches();
+	gen_zone();
+	gen_irqs();
+	gen_vm_stat();
+	gen_log();
+
+	if(write_image() || write_smap())
+		return -1;
+
+	printf("%s: %u MB, %llu MB written, %d tasks, %d caches, %u slab pages, %u free pages, %d irqs\n",
+			output_file_path, dump_mb, image_used >> 20, nr_tasks, nr_caches, slab_pages, free_pages, nr_irqs);
+	printf("%s: %d symbols\n", smap_file_path, nr_syms);
+
+	free(image);
+	return 0;
+}
@@ -1,51 +1,648 @@
 /*
  * Kernel stack parser
  *
+ * It reads a kernel stack dumped by extract_ramdump
+ * (kstack.bin) in one go and writes every word of it
+ * to kstack.dump. Words that fall in the kernel text
+ * (_stext to _etext of the vmlinux, or -r) are return
+ * addresses candidates and get the function and source
+ * file and line printed next to them. They are resolved
+ * in-process from the symbol tables, each distinct
+ * address once.
+ *
+ * -w 8 reads the stack of a 64-bit kernel, and -t
+ * leaves out the words that are not text addresses.
+ *
+ * -d parses a whole kstacks_per_task directory, one
+ * kstack_<pid>_<tid>_<comm>.bin per thread, with a pool
+ * of threads (-j) that share the symbol tables and the
+ * address cache. The stacks are written to one report,
+ * ordered by pid and tid, each under a header with the
+ * pid, tid and comm taken from its file name.
+ *
+ * -u prints the stack usage of each stack instead, the
+ * deepest stack in use first. The stack grows down
+ * towards thread_info, so the lowest non-zero word above
+ * thread_info is the high-water mark. The end of
+ * thread_info is found from the STACK_END_MAGIC the kernel
+ * puts right after it, the same for every stack, or given
+ * with -T; without either the usage of a 32-bit stack is
+ * reported as unknown. Stacks that come
+ * close to thread_info, lost their magic or have a bad
+ * task pointer or preempt count in thread_info are
+ * flagged as overflow suspects. The figures are exact only
+ * with CONFIG_DEBUG_STACK_USAGE, which zeroes new stacks;
+ * otherwise stale data of an earlier stack can add to them.
+ *
  * Author: Vinayak Menon <vinayakm.list@gmail.com>
  */
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
+#include "symbolizer.h"
 
 char* input_file = "./kstack.bin";
 char* output_file = "./kstack.dump";
-char exec_buf[100];
+char* vmlinux_path = "./vmlinux";
+
+int word_size = 4;
+int text_only;
+unsigned long text_start, text_end;
+int usage_mode;
+long thread_info_size = -1;
+
+#define STACK_END_MAGIC 0x57AC6E9D
+#define MAGIC_SEARCH_SIZE 1024	/*thread_info of 32-bit ARM is smaller*/
+#define NEAR_OVERFLOW_PCT 90
+#define OFFSETOF_PREEMPTCOUNT 0x4
+#define OFFSETOF_TASK 0xc
+#define PAGE_OFFSET 0xc0000000
+
+/*One stack of a kstacks_per_task directory*/
+struct kstack {
+	char *path;
+	int pid, tid;
+	char *comm;
+	char *report;	/*its part of the combined report*/
+	size_t report_len;
+	/*stack usage*/
+	unsigned long size;
+	long magic;	/*offset of STACK_END_MAGIC, -1 if missing*/
+	long end;	/*where thread_info ends, -1 if unknown*/
+	unsigned long deepest;	/*offset of the lowest word in use*/
+	int bad_thread_info;
+};
+
+struct kstack *kstacks;
+int nr_kstacks, kstacks_size;
+int next_kstack;
+pthread_mutex_t kstack_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void show_help(void)
+{
+	printf("Usage: kstack_parser -i [path to kstack.bin] -o [path to kstack.dump] -v [path to vmlinux]\n");
+	printf("       kstack_parser -d [kstacks_per_task dir] -j [threads] -o [path to kstack.dump] -v [path to vmlinux]\n");
+	printf("       kstack_parser -u -d [kstacks_per_task dir] -T [size of thread_info]\n");
+	printf("options: i,d,j,o,v,w,t,r,u,T,h\n");
+	printf("i : path to the stack dump, ./kstack.bin by default\n");
+	printf("d : parse every kstack_<pid>_<tid>_<comm>.bin of this directory\n");
+	printf("j : number of threads for d, the number of CPUs by default\n");
+	printf("o : path to the output file, ./kstack.dump by default, - for stdout\n");
+	printf("v : path to the vmlinux file, ./vmlinux by default\n");
+	printf("w : word size, 4 or 8\n");
+	printf("t : only print the words that are text addresses\n");
+	printf("r : text range start-end in hex, when the vmlinux has no _stext/_etext\n");
+	printf("u : table of the stack usage, with the overflow suspects flagged\n");
+	printf("T : size of thread_info for u, when the kernel has no STACK_END_MAGIC\n");
+	printf("h : help\n");
+	fflush(stdout);
+}
+
+/*The whole file in one read*/
+unsigned char* read_file(const char *path, unsigned long *size)
+{
+	FILE *fp;
+	struct stat st;
+	unsigned char *buf;
+
+	fp = fopen(path, "rb");
+	if(!fp) {
+		printf("Error opening the input file %s\n", path);
+		return NULL;
+	}
+
+	if(fstat(fileno(fp), &st)) {
+		printf("Error reading file %s\n", path);
+		fclose(fp);
+		return NULL;
+	}
+
+	buf = malloc(st.st_size ? st.st_size : 1);
+	if(!buf) {
+		printf("Out of memory\n");
+		fclose(fp);
+		return NULL;
+	}
+
+	if(st.st_size && fread(buf, st.st_size, 1, fp) != 1) {
+		printf("Error reading file %s\n", path);
+		free(buf);
+		fclose(fp);
+		return NULL;
+	}
+
+	fclose(fp);
+	*size = st.st_size;
+	return buf;
+}
+
+unsigned long get_word(unsigned char *p)
+{
+	uint32_t w32;
+	uint64_t w64;
+
+	if(word_size == 8) {
+		memcpy(&w64, p, 8);
+		return w64;
+	}
+	memcpy(&w32, p, 4);
+	return w32;
+}
+
+int is_text(unsigned long val)
+{
+	return val >= text_start && val < text_end;
+}
+
+/*Symbolizes the text words of a stack and writes all of them to fp*/
+void write_stack(FILE *fp, unsigned char *buf, unsigned long size)
+{
+	struct sym_entry *sym;
+	unsigned long i, val;
+
+	/*only text addresses are resolved, repeated ones once*/
+	for(i = 0; i < size; i += word_size) {
+		val = get_word(buf + i);
+		if(is_text(val))
+			symbolizer_queue(val);
+	}
+	symbolizer_resolve();
+
+	for(i = 0; i < size; i += word_size) {
+		val = get_word(buf + i);
+		if(!is_text(val)) {
+			if(!text_only)
+				fprintf(fp, "%04lx: %0*lx\n", i, word_size * 2, val);
+			continue;
+		}
+		sym = symbolizer_lookup(val);
+		if(sym)
+			fprintf(fp, "%04lx: %0*lx %s+0x%lx %s\n", i, word_size * 2, val,
+				sym->func, sym->offset, sym->file_line);
+		else
+			fprintf(fp, "%04lx: %0*lx ??\n", i, word_size * 2, val);
+	}
+}
 
-unsigned long input_read_buf=0;
-int main()
+/*Takes pid, tid and comm from a kstack_<pid>_<tid>_<comm>.bin
+ *name. extract_ramdump builds the path with a '\\', which is
+ *part of the name on other systems.
+ */
+int parse_kstack_name(const char *path, struct kstack *k)
 {
-	FILE *input_fp, *output_fp;
+	const char *name = path, *p;
+	int len;
 
-	input_fp = fopen(input_file, "rb");
-	if(!input_fp) {
-		printf("Error opening the input file %s\n", input_file);
+	for(p = path; *p; p++) {
+		if(*p == '/' || *p == '\\')
+			name = p + 1;
+	}
+
+	if(sscanf(name, "kstack_%d_%d_%n", &k->pid, &k->tid, &len) != 2)
+		return -1;
+	p = name + len;
+	len = strlen(p);
+	if(len < 4 || strcmp(p + len - 4, ".bin"))
 		return -1;
+
+	k->comm = strndup(p, len - 4);
+	return k->comm ? 0 : -1;
+}
+
+int add_kstack(const char *path, int pid, int tid, const char *comm)
+{
+	struct kstack *tmp, *k;
+
+	if(nr_kstacks == kstacks_size) {
+		kstacks_size = kstacks_size ? kstacks_size * 2 : 256;
+		tmp = realloc(kstacks, kstacks_size * sizeof(struct kstack));
+		if(!tmp) {
+			printf("Out of memory listing the stacks\n");
+			return -1;
+		}
+		kstacks = tmp;
 	}
 
-        output_fp = fopen(output_file, "w+");
-        if(!output_fp) {
-		printf("Error opening the output file %s\n", output_file);
-		fclose(input_fp);
+	k = &kstacks[nr_kstacks];
+	memset(k, 0, sizeof(*k));
+	k->pid = pid;
+	k->tid = tid;
+	k->path = strdup(path);
+	k->comm = strdup(comm);
+	if(!k->path || !k->comm) {
+		free(k->path);
+		free(k->comm);
+		printf("Out of memory listing the stacks\n");
+		return -1;
+	}
+	nr_kstacks++;
+	return 0;
+}
+
+int add_kstack_dir(const char *path)
+{
+	struct dirent *de;
+	struct kstack k;
+	char *child;
+	DIR *dir;
+	int ret = 0;
+
+	dir = opendir(path);
+	if(!dir) {
+		printf("Error opening the directory %s\n", path);
+		return -1;
+	}
+
+	while(!ret && (de = readdir(dir))) {
+		if(parse_kstack_name(de->d_name, &k))
+			continue;
+
+		child = malloc(strlen(path) + strlen(de->d_name) + 2);
+		if(!child) {
+			printf("Out of memory listing the stacks\n");
+			free(k.comm);
+			ret = -1;
+			break;
+		}
+		sprintf(child, "%s/%s", path, de->d_name);
+		ret = add_kstack(child, k.pid, k.tid, k.comm);
+		free(child);
+		free(k.comm);
+	}
+
+	closedir(dir);
+	return ret;
+}
+
+/*Offset of the first non-zero byte of buf from from on, size if
+ *there is none. 64 bytes are or-ed together per step, a loop gcc
+ *turns into vector instructions.
+ */
+unsigned long first_nonzero(unsigned char *buf, unsigned long from, unsigned long size)
+{
+	uint64_t chunk[8], acc;
+	unsigned long i = from;
+	int j;
+
+	for(; i < size && i % 64; i++) {
+		if(buf[i])
+			return i;
+	}
+	for(; i + 64 <= size; i += 64) {
+		memcpy(chunk, buf + i, 64);
+		acc = 0;
+		for(j = 0; j < 8; j++)
+			acc |= chunk[j];
+		if(acc)
+			break;
+	}
+	for(; i < size; i++) {
+		if(buf[i])
+			return i;
+	}
+
+	return size;
+}
+
+/*Where thread_info ends in the stacks that lost their magic:
+ *right after the magic of the other stacks, else -T. 64-bit
+ *kernels keep thread_info in task_struct. -1 if unknown.
+ */
+long thread_info_end(void)
+{
+	int i;
+
+	for(i = 0; i < nr_kstacks; i++) {
+		if(kstacks[i].magic >= 0)
+			return kstacks[i].magic + word_size;
+	}
+	if(thread_info_size >= 0)
+		return thread_info_size;
+	return word_size == 8 ? 0 : -1;
+}
+
+/*The usage above the magic, else above end*/
+void stack_usage(struct kstack *k, unsigned char *buf, unsigned long size, long end)
+{
+	unsigned long i, start, task;
+
+	k->size = size;
+	k->magic = -1;
+	for(i = 0; i < size && i < MAGIC_SEARCH_SIZE; i += word_size) {
+		if(get_word(buf + i) == STACK_END_MAGIC) {
+			k->magic = i;
+			break;
+		}
+	}
+
+	k->end = k->magic >= 0 ? k->magic + word_size : end;
+	start = k->end >= 0 ? k->end : size;
+	if(start > size)
+		start = size;
+	k->deepest = first_nonzero(buf, start, size);
+	k->deepest -= k->deepest % word_size;
+
+	/*thread_info of a 32-bit kernel is at the stack base*/
+	if(word_size == 4 && size >= OFFSETOF_TASK + 4) {
+		task = get_word(buf + OFFSETOF_TASK);
+		if(task < PAGE_OFFSET || task % 4 || (get_word(buf + OFFSETOF_PREEMPTCOUNT) & 0x80000000))
+			k->bad_thread_info = 1;
+	}
+}
+
+void read_stack_usage(struct kstack *k, long end)
+{
+	unsigned char *buf;
+	unsigned long size;
+
+	buf = read_file(k->path, &size);
+	if(buf) {
+		stack_usage(k, buf, size - size % word_size, end);
+		free(buf);
+	}
+}
+
+/*Parses one stack into its own part of the report*/
+void parse_kstack(struct kstack *k)
+{
+	unsigned char *buf;
+	unsigned long size;
+	FILE *fp;
+
+	/*the end of thread_info of a stack without magic is known
+	 *once all the stacks are read*/
+	if(usage_mode) {
+		read_stack_usage(k, -1);
+		return;
+	}
+
+	fp = open_memstream(&k->report, &k->report_len);
+	if(!fp) {
+		printf("Out of memory parsing %s\n", k->path);
+		return;
+	}
+
+	fprintf(fp, "==== pid %d tid %d comm %s ====\n", k->pid, k->tid, k->comm);
+	buf = read_file(k->path, &size);
+	if(buf) {
+		write_stack(fp, buf, size - size % word_size);
+		free(buf);
+	} else
+		fprintf(fp, "unreadable\n");
+	fprintf(fp, "\n");
+
+	fclose(fp);
+}
+
+void* kstack_worker(void *arg)
+{
+	int i;
+
+	while(1) {
+		pthread_mutex_lock(&kstack_lock);
+		i = next_kstack++;
+		pthread_mutex_unlock(&kstack_lock);
+		if(i >= nr_kstacks)
+			break;
+		parse_kstack(&kstacks[i]);
+	}
+
+	return NULL;
+}
+
+int cmp_usage(const void *a, const void *b)
+{
+	const struct kstack *x = a, *y = b;
+
+	if(x->size - x->deepest != y->size - y->deepest)
+		return x->size - x->deepest < y->size - y->deepest ? 1 : -1;
+	return x->pid != y->pid ? (x->pid < y->pid ? -1 : 1) : x->tid - y->tid;
+}
+
+/*The usage table, the deepest stack first. A stack is suspect
+ *when it reaches into the last tenth above thread_info, when its
+ *magic is gone while the other stacks have one, or when
+ *thread_info itself looks overwritten.
+ */
+void write_usage_table(FILE *fp)
+{
+	unsigned long used, usable;
+	long end = thread_info_end();
+	int i, magic_expected = 0;
+	char flags[64];
+
+	for(i = 0; i < nr_kstacks; i++) {
+		if(kstacks[i].magic >= 0)
+			magic_expected = 1;
+		else if(kstacks[i].size && end >= 0)
+			read_stack_usage(&kstacks[i], end);
+	}
+
+	qsort(kstacks, nr_kstacks, sizeof(struct kstack), cmp_usage);
+
+	fprintf(fp, "%8s %8s %-16s %6s %6s %5s %s\n", "pid", "tid", "comm", "used", "size", "use%", "suspect");
+	for(i = 0; i < nr_kstacks; i++) {
+		if(!kstacks[i].size) {
+			fprintf(fp, "%8d %8d %-16s unreadable\n", kstacks[i].pid, kstacks[i].tid, kstacks[i].comm);
+			continue;
+		}
+
+		used = kstacks[i].size - kstacks[i].deepest;
+		usable = kstacks[i].size > kstacks[i].end ? kstacks[i].size - kstacks[i].end : 1;
+		flags[0] = 0;
+		if(kstacks[i].end < 0)
+			strcat(flags, " unknown");
+		else if(used >= usable)
+			strcat(flags, " overflow");
+		else if(used * 100 >= usable * NEAR_OVERFLOW_PCT)
+			strcat(flags, " near");
+		if(magic_expected && kstacks[i].magic < 0)
+			strcat(flags, " no-magic");
+		if(kstacks[i].bad_thread_info)
+			strcat(flags, " thread_info");
+
+		if(kstacks[i].pid < 0)
+			fprintf(fp, "%8s %8s %-16s", "-", "-", kstacks[i].comm);
+		else
+			fprintf(fp, "%8d %8d %-16s", kstacks[i].pid, kstacks[i].tid, kstacks[i].comm);
+		if(kstacks[i].end < 0)
+			fprintf(fp, " %6s %6s %5s %s\n", "-", "-", "-", flags + 1);
+		else
+			fprintf(fp, " %6lu %6lu %4lu%% %s\n", used, usable, used * 100 / usable,
+				flags[0] ? flags + 1 : "");
+	}
+}
+
+int cmp_kstack(const void *a, const void *b)
+{
+	const struct kstack *x = a, *y = b;
+
+	if(x->pid != y->pid)
+		return x->pid < y->pid ? -1 : 1;
+	if(x->tid != y->tid)
+		return x->tid < y->tid ? -1 : 1;
+	return strcmp(x->comm, y->comm);
+}
+
+/*Parses every stack of the directory and writes them in pid, tid order*/
+int parse_kstack_dir(FILE *fp, int nr_threads)
+{
+	pthread_t *threads;
+	int i, j;
+
+	qsort(kstacks, nr_kstacks, sizeof(struct kstack), cmp_kstack);
+
+	if(nr_threads <= 0)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if(nr_threads <= 0)
+		nr_threads = 1;
+	if(nr_threads > nr_kstacks)
+		nr_threads = nr_kstacks ? nr_kstacks : 1;
+
+	threads = malloc(nr_threads * sizeof(pthread_t));
+	if(!threads) {
+		printf("Out of memory starting the threads\n");
 		return -1;
 	}
-	
-	while(!(feof(input_fp)) && !(ferror(input_fp))) {	
-		if(!(fread(&input_read_buf, 4, 1, input_fp))) {
-			if(!feof(input_fp))
-				printf("Error reading file\n");
-			goto out;
+
+	for(i = 0; i < nr_threads; i++) {
+		if(pthread_create(&threads[i], NULL, kstack_worker, NULL)) {
+			printf("Error starting the thread %d\n", i);
+			break;
 		}
-		sprintf(exec_buf,"addr2line -e ./vmlinux 0x%x\0", input_read_buf);
-		printf("0x%x\n",input_read_buf);
-		fflush(stdout);
-		system(exec_buf);
-		fflush(stdout);
 	}
-out:
-	fclose(input_fp);
-	fclose(output_fp);
+	/*no thread could be started, parse the stacks here*/
+	if(!i)
+		kstack_worker(NULL);
+	for(j = 0; j < i; j++)
+		pthread_join(threads[j], NULL);
+	free(threads);
+
+	if(usage_mode)
+		write_usage_table(fp);
+	for(i = 0; i < nr_kstacks; i++) {
+		if(kstacks[i].report)
+			fwrite(kstacks[i].report, 1, kstacks[i].report_len, fp);
+		free(kstacks[i].report);
+		free(kstacks[i].path);
+		free(kstacks[i].comm);
+	}
+	printf("%d stacks parsed\n", nr_kstacks);
+	free(kstacks);
+
+	return 0;
 }
 
+int main(int argc, char *argv[])
+{
+	FILE *output_fp;
+	unsigned char *buf = NULL;
+	unsigned long size = 0;
+	char *p, *dir = NULL;
+	int c, ret = 0, nr_threads = 0;
+
+	while((c = getopt(argc, argv, ":i:d:j:o:v:w:tr:uT:h")) != -1) {
+		switch(c) {
+			case 'i':
+				input_file = optarg;
+				break;
+			case 'd':
+				dir = optarg;
+				break;
+			case 'j':
+				nr_threads = atoi(optarg);
+				break;
+			case 'o':
+				output_file = optarg;
+				break;
+			case 'v':
+				vmlinux_path = optarg;
+				break;
+			case 'w':
+				word_size = atoi(optarg);
+				if(word_size != 4 && word_size != 8) {
+					printf("Word size should be 4 or 8\n");
+					exit(2);
+				}
+				break;
+			case 't':
+				text_only = 1;
+				break;
+			case 'u':
+				usage_mode = 1;
+				break;
+			case 'T':
+				thread_info_size = strtol(optarg, NULL, 0);
+				break;
+			case 'r':
+				text_start = strtoul(optarg, &p, 16);
+				text_end = *p == '-' ? strtoul(p + 1, NULL, 16) : 0;
+				if(text_end <= text_start) {
+					printf("Bad text range %s\n", optarg);
+					exit(2);
+				}
+				break;
+			case 'h':
+				show_help();
+				exit(2);
+				break;
+			case '?':
+				printf("Unknown option\n");
+				show_help();
+				exit(2);
+				break;
+		}
+	}
+
+	if(dir) {
+		if(add_kstack_dir(dir))
+			return -1;
+	} else if(usage_mode) {
+		if(add_kstack(input_file, -1, -1, input_file))
+			return -1;
+	} else {
+		buf = read_file(input_file, &size);
+		if(!buf)
+			return -1;
+		if(size % word_size)
+			printf("%s: ignoring the last %lu bytes\n", input_file, size % word_size);
+		size -= size % word_size;
+	}
 
+	if(!strcmp(output_file, "-"))
+		output_fp = stdout;
+	else
+		output_fp = fopen(output_file, "w");
+	if(!output_fp) {
+		printf("Error opening the output file %s\n", output_file);
+		free(buf);
+		return -1;
+	}
+
+	if(!usage_mode && symbolizer_open(vmlinux_path))
+		printf("Error loading symbols from vmlinux, symbols will not be available\n");
+	if(!usage_mode && !text_end && symbolizer_text_range(&text_start, &text_end))
+		printf("Kernel text range unknown, no word will be symbolized\n");
+
+	if(dir || usage_mode)
+		ret = parse_kstack_dir(output_fp, nr_threads);
+	else
+		write_stack(output_fp, buf, size);
+
+	if(fflush(output_fp) || ferror(output_fp)) {
+		printf("Error writing the output file %s\n", output_file);
+		ret = -1;
+	}
+
+	symbolizer_close();
+	if(output_fp != stdout)
+		fclose(output_fp);
+	free(buf);
+	return ret;
+}
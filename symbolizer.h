@@ -0,0 +1,1545 @@
+/*
+ * symbolizer
+ *
+ * Resolves kernel addresses to function name and source
+ * file:line for crash_search and kstack_parser, without
+ * running addr2line. The vmlinux ELF is read once:
+ * .symtab becomes sorted address -> function and address ->
+ * data object tables (the symbols nm -S lists with a size) and
+ * the DWARF line programs in .debug_line become a sorted
+ * address -> file:line table. Any address is then resolved
+ * with a binary search.
+ *
+ * Both tables are saved in a cache file named after the
+ * build-id of the vmlinux ($SYMCACHE_DIR, or ~/.cache/symcache
+ * by default). Later runs against the same kernel just mmap
+ * the cache and start instantly.
+ *
+ * Usage:
+ *	symbolizer_open(vmlinux);
+ *	symbolizer_queue(addr);		for every address of interest
+ *	symbolizer_resolve();		resolves all queued addresses
+ *	symbolizer_lookup(addr);	the cached result
+ *	symbolizer_address(name);	where a function starts, for
+ *					traces that print no addresses
+ *	symbolizer_text_range(&s, &e);	bounds of the kernel text
+ *
+ * The tables are read only once opened, and the address cache
+ * is locked, so any number of threads can queue and look up
+ * addresses at the same time. Entries never move, the pointer
+ * returned by symbolizer_lookup() stays valid till close.
+ *
+ * It is included directly by the tools, so that each of them
+ * still builds from a single gcc command line.
+ *
+ * Author: Vinayak Menon <vinayakm.list@gmail.com>
+ */
+#ifndef SYMBOLIZER_H
+#define SYMBOLIZER_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <elf.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#define SYMCACHE_MAGIC "KSYMC01"
+#define SYMCACHE_VERSION 2
+#define MAX_BUILD_ID 32
+
+/*One row of the line table. Rows of a sequence end with a row
+ *that has file NO_FILE, addresses from there on have no line.
+ */
+struct line_row {
+	uint64_t addr;
+	uint32_t file;
+	uint32_t line;
+};
+#define NO_FILE 0xffffffffU
+
+struct func_sym {
+	uint64_t addr;
+	uint64_t size;
+	uint32_t name;	/*offset in the string table*/
+	uint32_t rank;	/*preferred symbol when several share an address*/
+};
+
+/*Layout of the cache file, all offsets are from the start of the file*/
+struct symcache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t build_id_len;
+	unsigned char build_id[MAX_BUILD_ID];
+	uint64_t nr_lines, lines_off;
+	uint64_t nr_files, files_off;	/*uint32_t offsets in the string table*/
+	uint64_t nr_syms, syms_off;
+	uint64_t nr_objs, objs_off;
+	uint64_t strings_size, strings_off;
+};
+
+struct sym_entry {
+	unsigned long addr;
+	char *func;
+	unsigned long offset;	/*of addr from the start of func*/
+	char *file_line;
+	int used;
+	int resolved;
+};
+
+/*The tables, either built from the ELF or pointing into the cache*/
+static struct line_row *sym_lines;
+static uint64_t sym_nr_lines;
+static uint32_t *sym_files;
+static uint64_t sym_nr_files;
+static struct func_sym *sym_funcs;
+static uint64_t sym_nr_funcs;
+static struct func_sym *sym_objs;
+static uint64_t sym_nr_objs;
+static char *sym_strings;
+static uint64_t sym_strings_size;
+static unsigned long sym_text_end;	/*end of the last sized function*/
+
+static void *symcache_map;
+static size_t symcache_map_size;
+static int sym_tables_allocated;
+
+/*Address -> result cache, so each address is formatted once.
+ *The queue of a thread is its own, the cache is shared.
+ */
+static struct sym_entry **sym_table;
+static unsigned long sym_table_size;
+static unsigned long sym_table_count;
+static pthread_mutex_t sym_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct sym_entry **sym_pending;
+static __thread unsigned long sym_pending_count, sym_pending_size;
+
+/*Function name -> index in sym_funcs + 1, built on first use*/
+static uint32_t *sym_name_index;
+static uint64_t sym_name_index_size;
+
+/******************** growing arrays and string table ********************/
+
+static int sym_reserve(void **array, uint64_t *size, uint64_t count, size_t elem)
+{
+	void *tmp;
+	uint64_t new_size;
+
+	if(count < *size)
+		return 0;
+
+	new_size = *size ? *size * 2 : 4096;
+	tmp = realloc(*array, new_size * elem);
+	if(!tmp)
+		return -1;
+	*array = tmp;
+	*size = new_size;
+	return 0;
+}
+
+static uint64_t sym_lines_size, sym_files_size, sym_funcs_size, sym_objs_size, sym_strings_alloc;
+
+/*Interned file names, so that a header included by every
+ *compilation unit is stored once.
+ */
+static uint32_t *file_hash;
+static uint64_t file_hash_size;
+
+static uint32_t sym_add_string(const char *s, size_t len)
+{
+	uint32_t off;
+
+	while(sym_strings_size + len + 1 > sym_strings_alloc) {
+		char *tmp;
+		uint64_t size = sym_strings_alloc ? sym_strings_alloc * 2 : 1 << 20;
+
+		tmp = realloc(sym_strings, size);
+		if(!tmp)
+			return 0;
+		sym_strings = tmp;
+		sym_strings_alloc = size;
+	}
+
+	off = sym_strings_size;
+	memcpy(sym_strings + off, s, len);
+	sym_strings[off + len] = '\0';
+	sym_strings_size += len + 1;
+
+	return off;
+}
+
+static uint64_t sym_string_hash(const char *s)
+{
+	uint64_t h = 14695981039346656037ULL;
+
+	while(*s)
+		h = (h ^ (unsigned char)*s++) * 1099511628211ULL;
+
+	return h;
+}
+
+static int file_hash_grow(void)
+{
+	uint64_t i, j, size = file_hash_size ? file_hash_size * 2 : 4096;
+	uint32_t *tmp;
+
+	tmp = malloc(size * sizeof(uint32_t));
+	if(!tmp)
+		return -1;
+	memset(tmp, 0xff, size * sizeof(uint32_t));
+
+	for(i = 0; i < sym_nr_files; i++) {
+		j = sym_string_hash(sym_strings + sym_files[i]) & (size - 1);
+		while(tmp[j] != NO_FILE)
+			j = (j + 1) & (size - 1);
+		tmp[j] = i;
+	}
+
+	free(file_hash);
+	file_hash = tmp;
+	file_hash_size = size;
+	return 0;
+}
+
+/*Returns the index of the file name dir/name, adding it if new*/
+static uint32_t sym_add_file(const char *dir, const char *name)
+{
+	char path[4096];
+	uint64_t j;
+
+	if(dir && *dir && *name != '/')
+		snprintf(path, sizeof(path), "%s/%s", dir, name);
+	else
+		snprintf(path, sizeof(path), "%s", name);
+
+	if((sym_nr_files + 1) * 2 > file_hash_size && file_hash_grow())
+		return NO_FILE;
+
+	j = sym_string_hash(path) & (file_hash_size - 1);
+	while(file_hash[j] != NO_FILE) {
+		if(!strcmp(sym_strings + sym_files[file_hash[j]], path))
+			return file_hash[j];
+		j = (j + 1) & (file_hash_size - 1);
+	}
+
+	if(sym_reserve((void**)&sym_files, &sym_files_size, sym_nr_files, sizeof(uint32_t)))
+		return NO_FILE;
+
+	sym_files[sym_nr_files] = sym_add_string(path, strlen(path));
+	file_hash[j] = sym_nr_files;
+
+	return sym_nr_files++;
+}
+
+/******************** ELF ********************/
+
+struct elf_file {
+	unsigned char *base;
+	size_t size;
+	int is64;
+	int machine;
+	unsigned int shnum;
+	unsigned char *shdrs;
+	const char *shstrtab;
+};
+
+struct elf_section {
+	unsigned char *data;
+	uint64_t size;
+	uint64_t flags;
+	uint32_t type;
+	uint32_t link;
+	uint64_t entsize;
+};
+
+static int elf_get_section(struct elf_file *elf, unsigned int i, struct elf_section *sec, const char **name)
+{
+	uint64_t off;
+
+	if(i >= elf->shnum)
+		return -1;
+
+	if(elf->is64) {
+		Elf64_Shdr *sh = (Elf64_Shdr*)elf->shdrs + i;
+		off = sh->sh_offset;
+		sec->size = sh->sh_size;
+		sec->flags = sh->sh_flags;
+		sec->type = sh->sh_type;
+		sec->link = sh->sh_link;
+		sec->entsize = sh->sh_entsize;
+		if(name)
+			*name = elf->shstrtab + sh->sh_name;
+	} else {
+		Elf32_Shdr *sh = (Elf32_Shdr*)elf->shdrs + i;
+		off = sh->sh_offset;
+		sec->size = sh->sh_size;
+		sec->flags = sh->sh_flags;
+		sec->type = sh->sh_type;
+		sec->link = sh->sh_link;
+		sec->entsize = sh->sh_entsize;
+		if(name)
+			*name = elf->shstrtab + sh->sh_name;
+	}
+
+	if(sec->type == SHT_NOBITS)
+		sec->size = 0;
+	if(off > elf->size || sec->size > elf->size - off)
+		return -1;
+	sec->data = elf->base + off;
+
+	return 0;
+}
+
+static int elf_find_section(struct elf_file *elf, const char *want, struct elf_section *sec)
+{
+	const char *name;
+	unsigned int i;
+
+	for(i = 1; i < elf->shnum; i++) {
+		if(!elf_get_section(elf, i, sec, &name) && !strcmp(name, want))
+			return 0;
+	}
+
+	return -1;
+}
+
+static int elf_open(const char *path, struct elf_file *elf)
+{
+	struct elf_section shstr;
+	unsigned char *e;
+	struct stat st;
+	uint64_t shoff;
+	unsigned int shstrndx;
+	int fd;
+
+	memset(elf, 0, sizeof(*elf));
+
+	fd = open(path, O_RDONLY);
+	if(fd < 0)
+		return -1;
+	if(fstat(fd, &st) || st.st_size < (off_t)sizeof(Elf32_Ehdr)) {
+		close(fd);
+		return -1;
+	}
+
+	elf->size = st.st_size;
+	elf->base = mmap(NULL, elf->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(elf->base == MAP_FAILED) {
+		elf->base = NULL;
+		return -1;
+	}
+
+	e = elf->base;
+	if(memcmp(e, ELFMAG, SELFMAG) || e[EI_DATA] != ELFDATA2LSB) {
+		printf("%s is not a little endian ELF file\n", path);
+		goto err;
+	}
+
+	elf->is64 = (e[EI_CLASS] == ELFCLASS64);
+	if(elf->is64) {
+		Elf64_Ehdr *eh = (Elf64_Ehdr*)e;
+		shoff = eh->e_shoff;
+		elf->shnum = eh->e_shnum;
+		shstrndx = eh->e_shstrndx;
+		elf->machine = eh->e_machine;
+		if(eh->e_shentsize != sizeof(Elf64_Shdr))
+			goto err;
+	} else {
+		Elf32_Ehdr *eh = (Elf32_Ehdr*)e;
+		shoff = eh->e_shoff;
+		elf->shnum = eh->e_shnum;
+		shstrndx = eh->e_shstrndx;
+		elf->machine = eh->e_machine;
+		if(eh->e_shentsize != sizeof(Elf32_Shdr))
+			goto err;
+	}
+
+	if(!shoff || shoff > elf->size ||
+		(uint64_t)elf->shnum * (elf->is64 ? sizeof(Elf64_Shdr) : sizeof(Elf32_Shdr)) > elf->size - shoff)
+		goto err;
+	elf->shdrs = e + shoff;
+
+	/*a dummy name table so that elf_get_section can be used for it*/
+	elf->shstrtab = "";
+	if(elf_get_section(elf, shstrndx, &shstr, NULL))
+		goto err;
+	elf->shstrtab = (const char*)shstr.data;
+
+	return 0;
+err:
+	munmap(elf->base, elf->size);
+	elf->base = NULL;
+	return -1;
+}
+
+static void elf_close(struct elf_file *elf)
+{
+	if(elf->base)
+		munmap(elf->base, elf->size);
+	elf->base = NULL;
+}
+
+static int elf_build_id(struct elf_file *elf, unsigned char *id)
+{
+	struct elf_section sec;
+	unsigned char *p, *end;
+	uint32_t namesz, descsz, type;
+	unsigned int i;
+
+	for(i = 1; i < elf->shnum; i++) {
+		if(elf_get_section(elf, i, &sec, NULL) || sec.type != SHT_NOTE)
+			continue;
+
+		p = sec.data;
+		end = sec.data + sec.size;
+		while(p + 12 <= end) {
+			memcpy(&namesz, p, 4);
+			memcpy(&descsz, p + 4, 4);
+			memcpy(&type, p + 8, 4);
+			p += 12;
+			if(p + ((namesz + 3) & ~3) + descsz > end)
+				break;
+			if(type == NT_GNU_BUILD_ID && namesz == 4 && !memcmp(p, "GNU", 4)) {
+				p += 4;
+				if(descsz > MAX_BUILD_ID)
+					descsz = MAX_BUILD_ID;
+				memcpy(id, p, descsz);
+				return descsz;
+			}
+			p += ((namesz + 3) & ~3) + ((descsz + 3) & ~3);
+		}
+	}
+
+	return 0;
+}
+
+/******************** .symtab ********************/
+
+static int func_sym_cmp(const void *a, const void *b)
+{
+	const struct func_sym *x = a, *y = b;
+
+	if(x->addr != y->addr)
+		return x->addr < y->addr ? -1 : 1;
+	return (int)x->rank - (int)y->rank;
+}
+
+/*Sorts syms and keeps only the preferred symbol of each address*/
+static uint64_t sym_sort_unique(struct func_sym *syms, uint64_t count)
+{
+	uint64_t i, j;
+
+	qsort(syms, count, sizeof(struct func_sym), func_sym_cmp);
+
+	for(i = 0, j = 0; i < count; i++) {
+		if(j && syms[j - 1].addr == syms[i].addr)
+			continue;
+		syms[j++] = syms[i];
+	}
+
+	return j;
+}
+
+static int load_symtab(struct elf_file *elf)
+{
+	struct elf_section symtab, strtab;
+	const char *name;
+	uint64_t i, n;
+	uint64_t value, size;
+	unsigned int type, bind, shndx;
+
+	if(elf_find_section(elf, ".symtab", &symtab) ||
+		elf_get_section(elf, symtab.link, &strtab, NULL)) {
+		printf("No .symtab in vmlinux, function names will not be available\n");
+		return 0;
+	}
+
+	n = symtab.size / (elf->is64 ? sizeof(Elf64_Sym) : sizeof(Elf32_Sym));
+	for(i = 1; i < n; i++) {
+		if(elf->is64) {
+			Elf64_Sym *s = (Elf64_Sym*)symtab.data + i;
+			value = s->st_value;
+			size = s->st_size;
+			type = ELF64_ST_TYPE(s->st_info);
+			bind = ELF64_ST_BIND(s->st_info);
+			shndx = s->st_shndx;
+			name = (const char*)strtab.data + s->st_name;
+		} else {
+			Elf32_Sym *s = (Elf32_Sym*)symtab.data + i;
+			value = s->st_value;
+			size = s->st_size;
+			type = ELF32_ST_TYPE(s->st_info);
+			bind = ELF32_ST_BIND(s->st_info);
+			shndx = s->st_shndx;
+			name = (const char*)strtab.data + s->st_name;
+		}
+
+		if(shndx == SHN_UNDEF || shndx >= SHN_LORESERVE || !*name || !value)
+			continue;
+
+		/*variables, with the size nm -S would show*/
+		if(type == STT_OBJECT) {
+			if(sym_reserve((void**)&sym_objs, &sym_objs_size, sym_nr_objs, sizeof(struct func_sym)))
+				return -1;
+			sym_objs[sym_nr_objs].addr = value;
+			sym_objs[sym_nr_objs].size = size;
+			sym_objs[sym_nr_objs].name = sym_add_string(name, strlen(name));
+			sym_objs[sym_nr_objs].rank = (bind == STB_GLOBAL ? 0 : 1) + (size ? 0 : 2);
+			sym_nr_objs++;
+			continue;
+		}
+
+		/*ARM mapping symbols ($a, $d, $t) are not functions*/
+		if((type != STT_FUNC && type != STT_NOTYPE) || *name == '$')
+			continue;
+
+		/*bit 0 only marks thumb code*/
+		if(elf->machine == EM_ARM && type == STT_FUNC)
+			value &= ~1ULL;
+
+		if(sym_reserve((void**)&sym_funcs, &sym_funcs_size, sym_nr_funcs, sizeof(struct func_sym)))
+			return -1;
+		sym_funcs[sym_nr_funcs].addr = value;
+		sym_funcs[sym_nr_funcs].size = size;
+		sym_funcs[sym_nr_funcs].name = sym_add_string(name, strlen(name));
+		sym_funcs[sym_nr_funcs].rank = (type == STT_FUNC ? 0 : 2) + (bind == STB_GLOBAL ? 0 : 1);
+		sym_nr_funcs++;
+	}
+
+	sym_nr_funcs = sym_sort_unique(sym_funcs, sym_nr_funcs);
+	sym_nr_objs = sym_sort_unique(sym_objs, sym_nr_objs);
+
+	return 0;
+}
+
+/******************** .debug_line ********************/
+
+struct dwarf_reader {
+	unsigned char *p;
+	unsigned char *end;
+	int bad;
+};
+
+static uint64_t dw_u(struct dwarf_reader *r, int bytes)
+{
+	uint64_t v = 0;
+
+	if(r->p + bytes > r->end) {
+		r->bad = 1;
+		r->p = r->end;
+		return 0;
+	}
+	memcpy(&v, r->p, bytes);
+	r->p += bytes;
+	return v;
+}
+
+static uint64_t dw_uleb(struct dwarf_reader *r)
+{
+	uint64_t v = 0;
+	int shift = 0;
+	unsigned char b;
+
+	do {
+		if(r->p >= r->end) {
+			r->bad = 1;
+			return 0;
+		}
+		b = *r->p++;
+		if(shift < 64)
+			v |= (uint64_t)(b & 0x7f) << shift;
+		shift += 7;
+	} while(b & 0x80);
+
+	return v;
+}
+
+static int64_t dw_sleb(struct dwarf_reader *r)
+{
+	int64_t v = 0;
+	int shift = 0;
+	unsigned char b;
+
+	do {
+		if(r->p >= r->end) {
+			r->bad = 1;
+			return 0;
+		}
+		b = *r->p++;
+		if(shift < 64)
+			v |= (int64_t)(b & 0x7f) << shift;
+		shift += 7;
+	} while(b & 0x80);
+
+	if(shift < 64 && (b & 0x40))
+		v |= -((int64_t)1 << shift);
+
+	return v;
+}
+
+static const char* dw_str(struct dwarf_reader *r)
+{
+	const char *s = (const char*)r->p;
+	unsigned char *nul = memchr(r->p, 0, r->end - r->p);
+
+	if(!nul) {
+		r->bad = 1;
+		r->p = r->end;
+		return "";
+	}
+	r->p = nul + 1;
+	return s;
+}
+
+#define DW_LNS_copy 1
+#define DW_LNS_advance_pc 2
+#define DW_LNS_advance_line 3
+#define DW_LNS_set_file 4
+#define DW_LNS_const_add_pc 8
+#define DW_LNS_fixed_advance_pc 9
+#define DW_LNE_end_sequence 1
+#define DW_LNE_set_address 2
+#define DW_LNE_define_file 3
+
+#define DW_LNCT_path 1
+#define DW_LNCT_directory_index 2
+
+#define DW_FORM_block2 0x03
+#define DW_FORM_block4 0x04
+#define DW_FORM_data2 0x05
+#define DW_FORM_data4 0x06
+#define DW_FORM_data8 0x07
+#define DW_FORM_string 0x08
+#define DW_FORM_block 0x09
+#define DW_FORM_block1 0x0a
+#define DW_FORM_data1 0x0b
+#define DW_FORM_sdata 0x0d
+#define DW_FORM_strp 0x0e
+#define DW_FORM_udata 0x0f
+#define DW_FORM_data16 0x1e
+#define DW_FORM_line_strp 0x1f
+
+struct dwarf_strs {
+	struct elf_section str;		/*.debug_str*/
+	struct elf_section line_str;	/*.debug_line_str*/
+};
+
+/*Reads one attribute of a DWARF 5 directory/file entry. Strings are
+ *returned in *s, numbers in *v.
+ */
+static void dw_form(struct dwarf_reader *r, uint64_t form, int offset_size,
+		struct dwarf_strs *strs, const char **s, uint64_t *v)
+{
+	uint64_t off;
+
+	*s = NULL;
+	*v = 0;
+
+	switch(form) {
+	case DW_FORM_string:
+		*s = dw_str(r);
+		break;
+	case DW_FORM_strp:
+	case DW_FORM_line_strp:
+		off = dw_u(r, offset_size);
+		if(form == DW_FORM_strp && off < strs->str.size)
+			*s = (const char*)strs->str.data + off;
+		else if(form == DW_FORM_line_strp && off < strs->line_str.size)
+			*s = (const char*)strs->line_str.data + off;
+		else
+			*s = "??";
+		break;
+	case DW_FORM_udata:
+		*v = dw_uleb(r);
+		break;
+	case DW_FORM_sdata:
+		*v = dw_sleb(r);
+		break;
+	case DW_FORM_data1:
+		*v = dw_u(r, 1);
+		break;
+	case DW_FORM_data2:
+		*v = dw_u(r, 2);
+		break;
+	case DW_FORM_data4:
+		*v = dw_u(r, 4);
+		break;
+	case DW_FORM_data8:
+		*v = dw_u(r, 8);
+		break;
+	case DW_FORM_data16:
+		r->p += 16;
+		break;
+	case DW_FORM_block1:
+		r->p += dw_u(r, 1);
+		break;
+	case DW_FORM_block2:
+		r->p += dw_u(r, 2);
+		break;
+	case DW_FORM_block4:
+		r->p += dw_u(r, 4);
+		break;
+	case DW_FORM_block:
+		r->p += dw_uleb(r);
+		break;
+	default:
+		r->bad = 1;
+		break;
+	}
+
+	if(r->p > r->end) {
+		r->p = r->end;
+		r->bad = 1;
+	}
+}
+
+/*Reads a DWARF 5 directory or file name table. Returns the number of
+ *entries, with the path and the directory index of each one, or -1
+ *on error.
+ */
+static int64_t dw5_entries(struct dwarf_reader *r, int offset_size, struct dwarf_strs *strs,
+		const char ***paths, uint64_t **dir_index)
+{
+	uint64_t formats[32][2];
+	uint64_t nr_formats, count, i, j, v;
+	const char *s;
+
+	nr_formats = dw_u(r, 1);
+	if(nr_formats > 32)
+		return -1;
+	for(i = 0; i < nr_formats; i++) {
+		formats[i][0] = dw_uleb(r);
+		formats[i][1] = dw_uleb(r);
+	}
+
+	count = dw_uleb(r);
+	if(r->bad || count > (uint64_t)(r->end - r->p))
+		return -1;
+
+	*paths = calloc(count ? count : 1, sizeof(char*));
+	*dir_index = calloc(count ? count : 1, sizeof(uint64_t));
+	if(!*paths || !*dir_index)
+		return -1;
+
+	for(i = 0; i < count; i++) {
+		(*paths)[i] = "??";
+		for(j = 0; j < nr_formats; j++) {
+			dw_form(r, formats[j][1], offset_size, strs, &s, &v);
+			if(formats[j][0] == DW_LNCT_path && s)
+				(*paths)[i] = s;
+			else if(formats[j][0] == DW_LNCT_directory_index)
+				(*dir_index)[i] = v;
+		}
+	}
+
+	return r->bad ? -1 : (int64_t)count;
+}
+
+static int add_line_row(uint64_t addr, uint32_t file, uint32_t line)
+{
+	if(sym_reserve((void**)&sym_lines, &sym_lines_size, sym_nr_lines, sizeof(struct line_row)))
+		return -1;
+
+	sym_lines[sym_nr_lines].addr = addr;
+	sym_lines[sym_nr_lines].file = file;
+	sym_lines[sym_nr_lines].line = line;
+	sym_nr_lines++;
+
+	return 0;
+}
+
+/*Runs the line number program of one unit*/
+static int load_line_unit(struct dwarf_reader *unit, struct dwarf_strs *strs, int offset_size)
+{
+	struct dwarf_reader r = *unit;
+	uint64_t header_length, nr_dirs = 0, nr_files = 0, i;
+	unsigned char *program;
+	unsigned int version;
+	unsigned int min_inst_len, line_range, opcode_base;
+	int line_base;
+	unsigned char std_len[256];
+	const char **dirs = NULL, **names = NULL;
+	uint64_t *dir_index = NULL, *name_dir_index = NULL;
+	uint32_t *files = NULL;
+	int64_t n;
+	int ret = -1;
+
+	/*state machine registers*/
+	uint64_t address = 0;
+	uint64_t file = 1;
+	int64_t line = 1;
+	uint64_t seq_first_row = sym_nr_lines;
+	uint32_t last_file = NO_FILE, last_line = 0;
+
+	version = dw_u(&r, 2);
+	if(version < 2 || version > 5)
+		return 0;
+
+	if(version >= 5) {
+		dw_u(&r, 1);	/*address size*/
+		dw_u(&r, 1);	/*segment selector size*/
+	}
+
+	header_length = dw_u(&r, offset_size);
+	if(header_length > (uint64_t)(r.end - r.p))
+		return -1;
+	program = r.p + header_length;
+
+	min_inst_len = dw_u(&r, 1);
+	if(version >= 4)
+		dw_u(&r, 1);	/*maximum_operations_per_instruction, VLIW only*/
+	dw_u(&r, 1);		/*default_is_stmt*/
+	line_base = (signed char)dw_u(&r, 1);
+	line_range = dw_u(&r, 1);
+	opcode_base = dw_u(&r, 1);
+	if(!line_range || !opcode_base)
+		return -1;
+
+	memset(std_len, 0, sizeof(std_len));
+	for(i = 1; i < opcode_base; i++)
+		std_len[i] = dw_u(&r, 1);
+
+	if(version >= 5) {
+		n = dw5_entries(&r, offset_size, strs, &dirs, &dir_index);
+		if(n < 0)
+			goto out;
+		nr_dirs = n;
+		n = dw5_entries(&r, offset_size, strs, &names, &name_dir_index);
+		if(n < 0)
+			goto out;
+		nr_files = n;
+		files = malloc((nr_files ? nr_files : 1) * sizeof(uint32_t));
+		if(!files)
+			goto out;
+		for(i = 0; i < nr_files; i++)
+			files[i] = sym_add_file(name_dir_index[i] < nr_dirs ? dirs[name_dir_index[i]] : NULL, names[i]);
+	} else {
+		uint64_t dir, size_dirs = 0, size_files = 0;
+		const char *s;
+
+		/*directory 0 is the compilation directory, which is not in .debug_line*/
+		if(sym_reserve((void**)&dirs, &size_dirs, nr_dirs, sizeof(char*)))
+			goto out;
+		dirs[nr_dirs++] = NULL;
+		while(r.p < r.end && *r.p) {
+			if(sym_reserve((void**)&dirs, &size_dirs, nr_dirs, sizeof(char*)))
+				goto out;
+			dirs[nr_dirs++] = dw_str(&r);
+		}
+		r.p++;
+
+		/*file 0 is unused before DWARF 5*/
+		if(sym_reserve((void**)&files, &size_files, nr_files, sizeof(uint32_t)))
+			goto out;
+		files[nr_files++] = NO_FILE;
+		while(r.p < r.end && *r.p) {
+			s = dw_str(&r);
+			dir = dw_uleb(&r);
+			dw_uleb(&r);	/*mtime*/
+			dw_uleb(&r);	/*length*/
+			if(sym_reserve((void**)&files, &size_files, nr_files, sizeof(uint32_t)))
+				goto out;
+			files[nr_files++] = sym_add_file(dir < nr_dirs ? dirs[dir] : NULL, s);
+		}
+	}
+
+	if(r.bad)
+		goto out;
+
+	r.p = program;
+	while(r.p < r.end && !r.bad) {
+		unsigned int op = *r.p++;
+
+		if(op >= opcode_base) {
+			/*special opcode: advance address and line, then emit a row*/
+			op -= opcode_base;
+			address += (op / line_range) * min_inst_len;
+			line += line_base + (int)(op % line_range);
+		} else if(op == 0) {
+			uint64_t len = dw_uleb(&r);
+			unsigned char *next = r.p + len;
+
+			if(!len || len > (uint64_t)(r.end - r.p))
+				break;
+
+			switch(*r.p++) {
+			case DW_LNE_end_sequence:
+				/*sequences of discarded code sit at address 0*/
+				if(sym_nr_lines > seq_first_row && sym_lines[seq_first_row].addr) {
+					if(add_line_row(address, NO_FILE, 0))
+						goto out;
+				} else
+					sym_nr_lines = seq_first_row;
+				address = 0;
+				file = 1;
+				line = 1;
+				seq_first_row = sym_nr_lines;
+				last_file = NO_FILE;
+				r.p = next;
+				continue;
+			case DW_LNE_set_address:
+				address = dw_u(&r, len - 1 > 8 ? 8 : len - 1);
+				break;
+			case DW_LNE_define_file:
+				break;
+			default:
+				break;
+			}
+			r.p = next;
+			continue;
+		} else {
+			switch(op) {
+			case DW_LNS_copy:
+				break;
+			case DW_LNS_advance_pc:
+				address += dw_uleb(&r) * min_inst_len;
+				continue;
+			case DW_LNS_advance_line:
+				line += dw_sleb(&r);
+				continue;
+			case DW_LNS_set_file:
+				file = dw_uleb(&r);
+				continue;
+			case DW_LNS_const_add_pc:
+				address += ((255 - opcode_base) / line_range) * min_inst_len;
+				continue;
+			case DW_LNS_fixed_advance_pc:
+				address += dw_u(&r, 2);
+				continue;
+			default:
+				/*operands we do not care about*/
+				for(i = 0; i < std_len[op]; i++)
+					dw_uleb(&r);
+				continue;
+			}
+		}
+
+		/*emit a row, only where the file or line changes. Of several
+		 *rows at one address the last one applies, like in addr2line.
+		 */
+		if(file < nr_files && (files[file] != last_file || (uint32_t)line != last_line)) {
+			if(sym_nr_lines > seq_first_row && sym_lines[sym_nr_lines - 1].addr == address) {
+				sym_lines[sym_nr_lines - 1].file = files[file];
+				sym_lines[sym_nr_lines - 1].line = line;
+			} else if(add_line_row(address, files[file], line))
+				goto out;
+			last_file = files[file];
+			last_line = line;
+		}
+	}
+
+	/*a sequence without an end is of no use*/
+	sym_nr_lines = seq_first_row;
+	ret = 0;
+out:
+	free(dirs);
+	free(names);
+	free(dir_index);
+	free(name_dir_index);
+	free(files);
+	return ret;
+}
+
+static int line_row_cmp(const void *a, const void *b)
+{
+	const struct line_row *x = a, *y = b;
+
+	if(x->addr != y->addr)
+		return x->addr < y->addr ? -1 : 1;
+	/*an end of sequence goes before a row starting at the same address*/
+	return (x->file != NO_FILE) - (y->file != NO_FILE);
+}
+
+static int load_debug_line(struct elf_file *elf)
+{
+	struct elf_section line;
+	struct dwarf_strs strs;
+	struct dwarf_reader r, unit;
+	uint64_t len;
+	int offset_size;
+
+	if(elf_find_section(elf, ".debug_line", &line)) {
+		printf("No .debug_line in vmlinux, source lines will not be available\n");
+		return 0;
+	}
+	if(line.flags & SHF_COMPRESSED) {
+		printf("Compressed .debug_line is not supported, source lines will not be available\n");
+		return 0;
+	}
+
+	memset(&strs, 0, sizeof(strs));
+	elf_find_section(elf, ".debug_str", &strs.str);
+	elf_find_section(elf, ".debug_line_str", &strs.line_str);
+
+	r.p = line.data;
+	r.end = line.data + line.size;
+	r.bad = 0;
+
+	while(r.p + 4 <= r.end) {
+		/*0xffffffff starts a 64 bit DWARF unit*/
+		offset_size = 4;
+		len = dw_u(&r, 4);
+		if(len == 0xffffffff) {
+			len = dw_u(&r, 8);
+			offset_size = 8;
+		}
+		if(len > (uint64_t)(r.end - r.p))
+			break;
+
+		unit.p = r.p;
+		unit.end = r.p + len;
+		unit.bad = 0;
+		if(load_line_unit(&unit, &strs, offset_size))
+			return -1;
+		r.p += len;
+	}
+
+	qsort(sym_lines, sym_nr_lines, sizeof(struct line_row), line_row_cmp);
+
+	return 0;
+}
+
+/******************** cache ********************/
+
+static void symcache_path(char *path, size_t size, unsigned char *id, int id_len, int mkdirs)
+{
+	const char *dir = getenv("SYMCACHE_DIR");
+	char base[4096];
+	int i, n;
+
+	if(!dir) {
+		snprintf(base, sizeof(base), "%s/.cache", getenv("HOME") ? getenv("HOME") : ".");
+		if(mkdirs)
+			mkdir(base, 0755);
+		snprintf(base + strlen(base), sizeof(base) - strlen(base), "/symcache");
+		dir = base;
+	}
+	if(mkdirs)
+		mkdir(dir, 0755);
+
+	n = snprintf(path, size, "%s/", dir);
+	for(i = 0; i < id_len && n + 3 < (int)size; i++)
+		n += snprintf(path + n, size - n, "%02x", id[i]);
+	snprintf(path + n, size - n, ".symcache");
+}
+
+static int symcache_load(unsigned char *id, int id_len)
+{
+	struct symcache_header *h;
+	char path[4096];
+	struct stat st;
+	int fd;
+
+	symcache_path(path, sizeof(path), id, id_len, 0);
+	fd = open(path, O_RDONLY);
+	if(fd < 0)
+		return -1;
+	if(fstat(fd, &st) || st.st_size < (off_t)sizeof(*h)) {
+		close(fd);
+		return -1;
+	}
+
+	symcache_map_size = st.st_size;
+	symcache_map = mmap(NULL, symcache_map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(symcache_map == MAP_FAILED) {
+		symcache_map = NULL;
+		return -1;
+	}
+
+	h = symcache_map;
+	if(memcmp(h->magic, SYMCACHE_MAGIC, 8) || h->version != SYMCACHE_VERSION ||
+		h->build_id_len != (uint32_t)id_len || memcmp(h->build_id, id, id_len) ||
+		h->lines_off + h->nr_lines * sizeof(struct line_row) > symcache_map_size ||
+		h->files_off + h->nr_files * sizeof(uint32_t) > symcache_map_size ||
+		h->syms_off + h->nr_syms * sizeof(struct func_sym) > symcache_map_size ||
+		h->objs_off + h->nr_objs * sizeof(struct func_sym) > symcache_map_size ||
+		h->strings_off + h->strings_size > symcache_map_size) {
+		munmap(symcache_map, symcache_map_size);
+		symcache_map = NULL;
+		return -1;
+	}
+
+	sym_lines = (struct line_row*)((char*)symcache_map + h->lines_off);
+	sym_nr_lines = h->nr_lines;
+	sym_files = (uint32_t*)((char*)symcache_map + h->files_off);
+	sym_nr_files = h->nr_files;
+	sym_funcs = (struct func_sym*)((char*)symcache_map + h->syms_off);
+	sym_nr_funcs = h->nr_syms;
+	sym_objs = (struct func_sym*)((char*)symcache_map + h->objs_off);
+	sym_nr_objs = h->nr_objs;
+	sym_strings = (char*)symcache_map + h->strings_off;
+	sym_strings_size = h->strings_size;
+
+	return 0;
+}
+
+static uint64_t symcache_align(uint64_t off)
+{
+	return (off + 7) & ~7ULL;
+}
+
+/*Writes buf and pads the file to the next 8 byte boundary*/
+static int symcache_write(FILE *fp, const void *buf, uint64_t len)
+{
+	static const char zero[8];
+
+	if(fwrite(buf, 1, len, fp) != len)
+		return -1;
+	if(fwrite(zero, 1, symcache_align(len) - len, fp) != symcache_align(len) - len)
+		return -1;
+
+	return 0;
+}
+
+static void symcache_save(unsigned char *id, int id_len)
+{
+	struct symcache_header h;
+	char path[4096], tmp_path[4200];
+	FILE *fp;
+	uint64_t off;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SYMCACHE_MAGIC, 8);
+	h.version = SYMCACHE_VERSION;
+	h.build_id_len = id_len;
+	memcpy(h.build_id, id, id_len);
+
+	off = symcache_align(sizeof(h));
+	h.nr_lines = sym_nr_lines;
+	h.lines_off = off;
+	off = symcache_align(off + sym_nr_lines * sizeof(struct line_row));
+	h.nr_files = sym_nr_files;
+	h.files_off = off;
+	off = symcache_align(off + sym_nr_files * sizeof(uint32_t));
+	h.nr_syms = sym_nr_funcs;
+	h.syms_off = off;
+	off = symcache_align(off + sym_nr_funcs * sizeof(struct func_sym));
+	h.nr_objs = sym_nr_objs;
+	h.objs_off = off;
+	off = symcache_align(off + sym_nr_objs * sizeof(struct func_sym));
+	h.strings_size = sym_strings_size;
+	h.strings_off = off;
+
+	symcache_path(path, sizeof(path), id, id_len, 1);
+	snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, (int)getpid());
+	fp = fopen(tmp_path, "wb");
+	if(!fp)
+		return;
+
+	if(!symcache_write(fp, &h, sizeof(h)) &&
+		!symcache_write(fp, sym_lines, sym_nr_lines * sizeof(struct line_row)) &&
+		!symcache_write(fp, sym_files, sym_nr_files * sizeof(uint32_t)) &&
+		!symcache_write(fp, sym_funcs, sym_nr_funcs * sizeof(struct func_sym)) &&
+		!symcache_write(fp, sym_objs, sym_nr_objs * sizeof(struct func_sym)) &&
+		!symcache_write(fp, sym_strings, sym_strings_size)) {
+		if(!fclose(fp)) {
+			/*readers see either no cache or a complete one*/
+			rename(tmp_path, path);
+			return;
+		}
+		unlink(tmp_path);
+		return;
+	}
+
+	fclose(fp);
+	unlink(tmp_path);
+}
+
+/******************** interface ********************/
+
+static void symbolizer_close(void);
+
+static void sym_find_text_end(void)
+{
+	uint64_t i;
+
+	sym_text_end = 0;
+	for(i = 0; i < sym_nr_funcs; i++) {
+		if(sym_funcs[i].rank < 2 && sym_funcs[i].addr + sym_funcs[i].size > sym_text_end)
+			sym_text_end = sym_funcs[i].addr + sym_funcs[i].size;
+	}
+}
+
+static int symbolizer_open(const char *vmlinux)
+{
+	struct elf_file elf;
+	unsigned char id[MAX_BUILD_ID];
+	int id_len;
+
+	if(elf_open(vmlinux, &elf)) {
+		printf("Error reading the vmlinux file %s\n", vmlinux);
+		return -1;
+	}
+
+	id_len = elf_build_id(&elf, id);
+	if(id_len && !symcache_load(id, id_len)) {
+		elf_close(&elf);
+		sym_find_text_end();
+		return 0;
+	}
+
+	sym_tables_allocated = 1;
+	if(load_symtab(&elf) || load_debug_line(&elf)) {
+		printf("Error decoding the vmlinux file %s\n", vmlinux);
+		elf_close(&elf);
+		symbolizer_close();
+		return -1;
+	}
+	elf_close(&elf);
+	free(file_hash);
+	file_hash = NULL;
+	file_hash_size = 0;
+	sym_find_text_end();
+
+	if(id_len)
+		symcache_save(id, id_len);
+
+	return 0;
+}
+
+static void symbolizer_close(void)
+{
+	unsigned long i;
+
+	if(symcache_map)
+		munmap(symcache_map, symcache_map_size);
+	symcache_map = NULL;
+
+	if(sym_tables_allocated) {
+		free(sym_lines);
+		free(sym_files);
+		free(sym_funcs);
+		free(sym_objs);
+		free(sym_strings);
+		sym_tables_allocated = 0;
+	}
+	sym_lines = NULL;
+	sym_files = NULL;
+	sym_funcs = NULL;
+	sym_objs = NULL;
+	sym_strings = NULL;
+	sym_nr_lines = sym_nr_files = sym_nr_funcs = sym_nr_objs = sym_strings_size = 0;
+	sym_text_end = 0;
+	sym_lines_size = sym_files_size = sym_funcs_size = sym_objs_size = sym_strings_alloc = 0;
+
+	for(i = 0; i < sym_table_size; i++) {
+		if(!sym_table[i])
+			continue;
+		free(sym_table[i]->func);
+		free(sym_table[i]->file_line);
+		free(sym_table[i]);
+	}
+	free(sym_table);
+	free(sym_pending);
+	free(sym_name_index);
+	sym_name_index = NULL;
+	sym_name_index_size = 0;
+	sym_table = NULL;
+	sym_pending = NULL;
+	sym_table_size = sym_table_count = 0;
+	sym_pending_count = sym_pending_size = 0;
+}
+
+/*Index of the last symbol of syms at or below addr, -1 if none*/
+static int64_t func_sym_search(struct func_sym *syms, uint64_t count, unsigned long addr)
+{
+	int64_t lo = 0, hi = (int64_t)count - 1, mid, found = -1;
+
+	while(lo <= hi) {
+		mid = lo + (hi - lo) / 2;
+		if(syms[mid].addr <= addr) {
+			found = mid;
+			lo = mid + 1;
+		} else
+			hi = mid - 1;
+	}
+
+	return found;
+}
+
+/*Index of the last line row at or below addr, -1 if none*/
+static int64_t line_row_search(unsigned long addr)
+{
+	int64_t lo = 0, hi = (int64_t)sym_nr_lines - 1, mid, found = -1;
+
+	while(lo <= hi) {
+		mid = lo + (hi - lo) / 2;
+		if(sym_lines[mid].addr <= addr) {
+			found = mid;
+			lo = mid + 1;
+		} else
+			hi = mid - 1;
+	}
+
+	return found;
+}
+
+/*Function that contains addr. Returns its name or NULL. Symbols
+ *without a size reach up to the next one, but not past the end
+ *of the last sized function.
+ */
+static const char* symbolizer_function(unsigned long addr, unsigned long *offset)
+{
+	int64_t i = func_sym_search(sym_funcs, sym_nr_funcs, addr);
+
+	if(i < 0 || (sym_text_end && addr >= sym_text_end))
+		return NULL;
+
+	*offset = addr - sym_funcs[i].addr;
+	if(sym_funcs[i].size && *offset >= sym_funcs[i].size)
+		return NULL;
+
+	return sym_strings + sym_funcs[i].name;
+}
+
+/*Variable that contains addr. Returns its name or NULL. Objects
+ *without a size only match their own address.
+ */
+static inline const char* symbolizer_data(unsigned long addr, unsigned long *offset)
+{
+	int64_t i = func_sym_search(sym_objs, sym_nr_objs, addr);
+
+	if(i < 0)
+		return NULL;
+
+	*offset = addr - sym_objs[i].addr;
+	if(*offset && *offset >= sym_objs[i].size)
+		return NULL;
+
+	return sym_strings + sym_objs[i].name;
+}
+
+/*Source line of addr. Returns the file name or NULL*/
+static const char* symbolizer_line(unsigned long addr, unsigned int *line)
+{
+	int64_t i = line_row_search(addr);
+
+	if(i < 0 || sym_lines[i].file == NO_FILE || sym_lines[i].file >= sym_nr_files)
+		return NULL;
+
+	*line = sym_lines[i].line;
+	return sym_strings + sym_files[sym_lines[i].file];
+}
+
+static unsigned long sym_hash(unsigned long addr)
+{
+	return (addr * 0x9E3779B97F4A7C15ULL) >> 16;
+}
+
+/*Finds the slot of addr, or the free slot it would go into*/
+static struct sym_entry** sym_find(unsigned long addr)
+{
+	unsigned long i = sym_hash(addr) & (sym_table_size - 1);
+
+	while(sym_table[i] && sym_table[i]->addr != addr)
+		i = (i + 1) & (sym_table_size - 1);
+
+	return &sym_table[i];
+}
+
+static int sym_grow(void)
+{
+	struct sym_entry **old = sym_table;
+	unsigned long old_size = sym_table_size;
+	unsigned long i;
+
+	sym_table_size = old_size ? old_size * 2 : 1024;
+	sym_table = calloc(sym_table_size, sizeof(struct sym_entry*));
+	if(!sym_table) {
+		sym_table = old;
+		sym_table_size = old_size;
+		return -1;
+	}
+
+	for(i = 0; i < old_size; i++) {
+		if(old[i])
+			*sym_find(old[i]->addr) = old[i];
+	}
+	free(old);
+
+	return 0;
+}
+
+/*The entry of addr, added if it is new. Called with sym_lock held*/
+static struct sym_entry* sym_get(unsigned long addr)
+{
+	struct sym_entry **slot;
+
+	if((sym_table_count + 1) * 2 > sym_table_size && sym_grow())
+		return NULL;
+
+	slot = sym_find(addr);
+	if(*slot)
+		return *slot;
+
+	*slot = calloc(1, sizeof(struct sym_entry));
+	if(!*slot)
+		return NULL;
+	(*slot)->used = 1;
+	(*slot)->addr = addr;
+	sym_table_count++;
+
+	return *slot;
+}
+
+/*Called with sym_lock held*/
+static void sym_resolve_entry(struct sym_entry *e)
+{
+	const char *name;
+	unsigned int line;
+	char buf[4200];
+
+	name = symbolizer_function(e->addr, &e->offset);
+	e->func = strdup(name ? name : "??");
+
+	name = symbolizer_line(e->addr, &line);
+	if(name)
+		snprintf(buf, sizeof(buf), "%s:%u", name, line);
+	else
+		snprintf(buf, sizeof(buf), "??:0");
+	e->file_line = strdup(buf);
+
+	e->resolved = 1;
+}
+
+/*Adds addr to the next batch, unless it is already known*/
+static int symbolizer_queue(unsigned long addr)
+{
+	struct sym_entry *e, **tmp;
+	int ret = 0;
+
+	pthread_mutex_lock(&sym_lock);
+	e = sym_get(addr);
+	if(!e) {
+		ret = -1;
+		goto out;
+	}
+	if(e->resolved)
+		goto out;
+
+	if(sym_pending_count == sym_pending_size) {
+		sym_pending_size = sym_pending_size ? sym_pending_size * 2 : 256;
+		tmp = realloc(sym_pending, sym_pending_size * sizeof(struct sym_entry*));
+		if(!tmp) {
+			ret = -1;
+			goto out;
+		}
+		sym_pending = tmp;
+	}
+	sym_pending[sym_pending_count++] = e;
+
+out:
+	pthread_mutex_unlock(&sym_lock);
+	return ret;
+}
+
+/*Resolves everything queued so far by this thread*/
+static void symbolizer_resolve(void)
+{
+	unsigned long i;
+
+	pthread_mutex_lock(&sym_lock);
+	for(i = 0; i < sym_pending_count; i++) {
+		if(!sym_pending[i]->resolved)
+			sym_resolve_entry(sym_pending[i]);
+	}
+	pthread_mutex_unlock(&sym_lock);
+
+	sym_pending_count = 0;
+}
+
+/*The result for addr, which is resolved now if it was not queued*/
+static struct sym_entry* symbolizer_lookup(unsigned long addr)
+{
+	struct sym_entry *e;
+
+	pthread_mutex_lock(&sym_lock);
+	e = sym_get(addr);
+	if(e && !e->resolved)
+		sym_resolve_entry(e);
+	pthread_mutex_unlock(&sym_lock);
+
+	return e;
+}
+
+/*Called with sym_lock held*/
+static int sym_build_name_index(void)
+{
+	uint64_t i, j, size = 1024;
+
+	while(size < sym_nr_funcs * 2)
+		size *= 2;
+
+	sym_name_index = calloc(size, sizeof(uint32_t));
+	if(!sym_name_index)
+		return -1;
+	sym_name_index_size = size;
+
+	for(i = 0; i < sym_nr_funcs; i++) {
+		j = sym_string_hash(sym_strings + sym_funcs[i].name) & (size - 1);
+		while(sym_name_index[j])
+			j = (j + 1) & (size - 1);
+		sym_name_index[j] = i + 1;
+	}
+
+	return 0;
+}
+
+/*Start of the function called name, 0 if it is not known*/
+static inline unsigned long symbolizer_address(const char *name)
+{
+	unsigned long addr = 0;
+	uint64_t j;
+	uint32_t i;
+
+	pthread_mutex_lock(&sym_lock);
+	if(!sym_name_index && sym_build_name_index())
+		goto out;
+
+	j = sym_string_hash(name) & (sym_name_index_size - 1);
+	while((i = sym_name_index[j])) {
+		if(!strcmp(sym_strings + sym_funcs[i - 1].name, name)) {
+			addr = sym_funcs[i - 1].addr;
+			break;
+		}
+		j = (j + 1) & (sym_name_index_size - 1);
+	}
+
+out:
+	pthread_mutex_unlock(&sym_lock);
+	return addr;
+}
+
+/*The kernel text, _stext to _etext, or else the span of the sized
+ *functions. Returns -1 if there are no symbols.
+ */
+static inline int symbolizer_text_range(unsigned long *start, unsigned long *end)
+{
+	uint64_t i;
+
+	*start = symbolizer_address("_stext");
+	*end = symbolizer_address("_etext");
+	if(*start && *end > *start)
+		return 0;
+
+	*start = *end = 0;
+	for(i = 0; i < sym_nr_funcs; i++) {
+		if(sym_funcs[i].rank >= 2 || !sym_funcs[i].size)
+			continue;
+		if(!*start || sym_funcs[i].addr < *start)
+			*start = sym_funcs[i].addr;
+		if(sym_funcs[i].addr + sym_funcs[i].size > *end)
+			*end = sym_funcs[i].addr + sym_funcs[i].size;
+	}
+
+	return *end ? 0 : -1;
+}
+
+#endif